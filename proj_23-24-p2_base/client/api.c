@@ -1,22 +1,116 @@
 #include "api.h"
 
+#include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "common/messages.h"
 #include "common/constants.h"
+#include "common/io.h"
+#include "common/partition.h"
+#include "frame.h"
+
+/// Session with one server.
+struct Connection {
+  int req_fd;                 /// Request pipe, -1 if there is no session.
+  int resp_fd;                /// Response pipe.
+  unsigned int session_id;    /// Session id given by the server.
+  unsigned int last_request;  /// Request id of the last frame sent, the next response must echo it.
+
+  char* in;       /// Responses read ahead, NULL until the first response.
+  size_t in_pos;  /// Bytes of in belonging to frames already received.
+  size_t in_len;  /// Bytes of in filled.
+  size_t in_cap;  /// Capacity of in.
+};
+
+//Session state is per thread, so each client thread can hold its own sessions, one per server of the cluster
+static _Thread_local struct Connection shards[MAX_CLUSTER_SIZE];
+static _Thread_local unsigned int shard_count = 0;
+static _Thread_local struct Connection replica = {.req_fd = -1};
+static _Thread_local int notify_fd = -1;
+static _Thread_local char notify_path[PATH_MAX];
+
+
+/// Closes the pipes of a session that could not be set up.
+static void drop_pipes(struct Connection* conn) {
+  if (conn->req_fd != -1) close(conn->req_fd);
+  if (conn->resp_fd != -1) close(conn->resp_fd);
+  conn->req_fd = conn->resp_fd = -1;
+}
 
-static int req_fd, resp_fd;
-static unsigned session_id;
+/// Sends one setup request to the server and waits for its answer.
+/// @param retry_after_ms Set to the delay suggested by the server when it is busy.
+/// @return 0 if a session was established, SETUP_BUSY if the server turned us away, 1 on error.
+static int setup_attempt(struct Connection* conn, char const* req_pipe_path, char const* resp_pipe_path,
+                         char const* server_pipe_path, unsigned int* retry_after_ms) {
+  //Open server pipe
+  int server_fd = open(server_pipe_path, O_WRONLY);
+  if (server_fd == -1) {
+    return 1;
+  }
 
-//Builds core_request from given opcode and global session_id and writes to global req_fd
-#define SEND_CORE(op) do { core_request core = { .opcode = op, .session_id = session_id }; if (write(req_fd, &core, sizeof(core_request)) == -1) { return 1; }} while(0)
+  //Build setup request
+  setup_request request;
+  memset(request.request_fifo_name, 0, 40);
+  memset(request.response_fifo_name, 0, 40);
+  strncpy(request.request_fifo_name, req_pipe_path, 40);
+  strncpy(request.response_fifo_name, resp_pipe_path, 40);
 
-int ems_setup(char const* req_pipe_path, char const* resp_pipe_path, char const* server_pipe_path) {
+  //Send opcode and request in a single write, so concurrent clients cannot interleave on the server pipe
+  char message[sizeof(char) + sizeof(setup_request)];
+  message[0] = MSG_SETUP;
+  memcpy(message + 1, &request, sizeof(setup_request));
+  if (write(server_fd, message, sizeof(message)) == -1) {
+    close(server_fd);
+    return 1;
+  }
+
+  //Open client pipes now that server has all needed information
+  conn->req_fd = open(req_pipe_path, O_WRONLY);
+  conn->resp_fd = conn->req_fd == -1 ? -1 : open(resp_pipe_path, O_RDONLY);
+
+  //Read server response
+  setup_response response;
+  int ret = conn->resp_fd == -1 || read(conn->resp_fd, &response, sizeof(setup_response)) <= 0;
+
+  //Close server pipe, whatever happened, attempts are retried while the server is busy
+  if (close(server_fd) == -1) {
+    ret = 1;
+  }
+  if (ret) {
+    drop_pipes(conn);
+    return 1;
+  }
+
+  //Server is overloaded, drop the pipes it already closed on its side
+  if (response.return_code == SETUP_BUSY) {
+    drop_pipes(conn);
+    *retry_after_ms = response.retry_after_ms;
+    return SETUP_BUSY;
+  }
+  if (response.return_code) {
+    drop_pipes(conn);
+    return 1;
+  }
+
+  //Store session_id, responses are read ahead from now on
+  conn->session_id = response.session_id;
+  conn->last_request = 0;
+  conn->in_pos = conn->in_len = 0;
+  return 0;
+}
+
+/// Creates the pipes of a session and sets it up, retrying while the server is busy.
+/// @return 0 if a session was established, 1 otherwise.
+static int connect_session(struct Connection* conn, char const* req_pipe_path, char const* resp_pipe_path,
+                           char const* server_pipe_path) {
   //[Delete and] create pipes
   unlink(req_pipe_path);
   unlink(resp_pipe_path);
@@ -26,199 +120,850 @@ int ems_setup(char const* req_pipe_path, char const* resp_pipe_path, char const*
   if (mkfifo(resp_pipe_path, FIFO_PERMS) == -1) {
     return 1;
   }
-  
-  //Open server pipe
-  int server_fd = open(server_pipe_path, O_WRONLY);
-  if (server_fd == -1) {
+
+  //Retry with jittered exponential backoff while the server is busy
+  unsigned int seed = (unsigned int)time(NULL) ^ (unsigned int)getpid();
+  unsigned int backoff_ms = ADMISSION_MIN_RETRY_MS;
+  for (int attempt = 0; attempt < SETUP_MAX_ATTEMPTS; attempt++) {
+    unsigned int retry_after_ms = 0;
+    int ret = setup_attempt(conn, req_pipe_path, resp_pipe_path, server_pipe_path, &retry_after_ms);
+    if (ret != SETUP_BUSY) {
+      return ret;
+    }
+
+    //Wait somewhere between half and one and a half times the delay, so rejected clients spread out
+    unsigned int base_ms = retry_after_ms > backoff_ms ? retry_after_ms : backoff_ms;
+    unsigned int wait_ms = base_ms / 2 + (unsigned int)rand_r(&seed) % (base_ms + 1);
+    struct timespec delay = {wait_ms / 1000, (long)(wait_ms % 1000) * 1000000};
+    nanosleep(&delay, NULL);
+
+    backoff_ms *= 2;
+  }
+
+  return 1;
+}
+
+int ems_setup(char const* req_pipe_path, char const* resp_pipe_path, char const* server_pipe_path) {
+  //Notification pipe, only created if the session subscribes to events, shared by the sessions of the cluster
+  snprintf(notify_path, sizeof(notify_path), "%s.notify", resp_pipe_path);
+
+  //A single server keeps the given pipes, the sessions of a cluster get theirs suffixed by partition
+  char servers[PATH_MAX * 2];
+  snprintf(servers, sizeof(servers), "%s", server_pipe_path);
+  int clustered = strchr(servers, ',') != NULL;
+
+  shard_count = 0;
+  char* save = NULL;
+  for (char* server = strtok_r(servers, ",", &save); server != NULL; server = strtok_r(NULL, ",", &save)) {
+    if (shard_count == MAX_CLUSTER_SIZE) {
+      return 1;
+    }
+
+    char req_path[PATH_MAX], resp_path[PATH_MAX];
+    if (clustered) {
+      snprintf(req_path, sizeof(req_path), "%.*s.s%u", PATH_MAX - 16, req_pipe_path, shard_count);
+      snprintf(resp_path, sizeof(resp_path), "%.*s.s%u", PATH_MAX - 16, resp_pipe_path, shard_count);
+    } else {
+      snprintf(req_path, sizeof(req_path), "%s", req_pipe_path);
+      snprintf(resp_path, sizeof(resp_path), "%s", resp_pipe_path);
+    }
+
+    if (connect_session(&shards[shard_count], req_path, resp_path, server)) {
+      return 1;
+    }
+    shard_count++;
+  }
+
+  return shard_count == 0;
+}
+
+/// Finds the session of the server that owns an event.
+static struct Connection* shard_of(unsigned int event_id) { return &shards[partition_of(event_id, shard_count)]; }
+
+/// Writes exactly len bytes to an output file.
+/// @return 0 if the bytes were written, 1 otherwise.
+static int write_all(int out_fd, const char* data, size_t len) {
+  while (len > 0) {
+    ssize_t ret = write(out_fd, data, len);
+    if (ret <= 0) {
+      return 1;
+    }
+
+    data += ret;
+    len -= (size_t)ret;
+  }
+
+  return 0;
+}
+
+/// Writes a whole frame to the request pipe of a session, under a new request id.
+/// @return 0 if the frame was written, 1 otherwise.
+static int send_frame(struct Connection* conn, void* frame, size_t len) {
+  frame_set_request(frame, ++conn->last_request);
+
+  const char* data = frame;
+  while (len > 0) {
+    ssize_t written = write(conn->req_fd, data, len);
+    if (written == -1) {
+      return 1;
+    }
+
+    data += written;
+    len -= (size_t)written;
+  }
+
+  return 0;
+}
+
+/// Reads from the response pipe of a session until the read-ahead buffer holds len bytes, growing it if needed.
+/// @return 0 if the bytes were read, 1 otherwise.
+static int fill_to(struct Connection* conn, size_t len) {
+  if (len > conn->in_cap) {
+    size_t cap = len > RESPONSE_BUFFER_SIZE ? len : RESPONSE_BUFFER_SIZE;
+    char* grown = realloc(conn->in, cap);
+    if (grown == NULL) {
+      return 1;
+    }
+    conn->in = grown;
+    conn->in_cap = cap;
+  }
+
+  //Reads take whatever the server wrote, usually the whole frame at once
+  while (conn->in_len < len) {
+    ssize_t ret = read(conn->resp_fd, conn->in + conn->in_len, conn->in_cap - conn->in_len);
+    if (ret <= 0) {
+      return 1;
+    }
+    conn->in_len += (size_t)ret;
+  }
+
+  return 0;
+}
+
+/// Receives the response frame to the last request sent over a session.
+/// @param len Set to the size of the payload.
+/// @return Payload of the response, valid until the next response of the session is received, NULL on error.
+static const char* receive_frame(struct Connection* conn, size_t* len) {
+  //Drop the previous frame, keeping whatever was read past it
+  conn->in_len -= conn->in_pos;
+  if (conn->in_len > 0) memmove(conn->in, conn->in + conn->in_pos, conn->in_len);
+  conn->in_pos = 0;
+
+  response_header header;
+  if (fill_to(conn, sizeof(response_header))) {
+    return NULL;
+  }
+  memcpy(&header, conn->in, sizeof(response_header));
+
+  //A response to another request means the session lost track of its frames
+  if (header.request_id != conn->last_request || fill_to(conn, sizeof(response_header) + header.payload_len)) {
+    return NULL;
+  }
+
+  conn->in_pos = sizeof(response_header) + header.payload_len;
+  *len = header.payload_len;
+  return conn->in + sizeof(response_header);
+}
+
+/// Reads the response of a request that only answers with a return code.
+/// @return 0 if the request succeeded, 1 otherwise.
+static int receive_return_code(struct Connection* conn) {
+  //create_response, reserve_response, cancel_response and staleness_response share this layout
+  size_t len;
+  const char* payload = receive_frame(conn, &len);
+  int return_code;
+  if (payload == NULL || len < sizeof(int)) {
+    return 1;
+  }
+  memcpy(&return_code, payload, sizeof(int));
+
+  return return_code ? 1 : 0;
+}
+
+/// Reads a show response and prints the seats.
+/// @return 0 if the event was printed, REPLICA_STALE if a replica could not answer, 1 otherwise.
+static int receive_show(struct Connection* conn, int out_fd) {
+  //Read response
+  size_t len;
+  const char* payload = receive_frame(conn, &len);
+  show_response response;
+  if (payload == NULL || len < sizeof(show_response)) {
+    return 1;
+  }
+  memcpy(&response, payload, sizeof(show_response));
+  size_t num_seats = response.num_rows * response.num_cols;
+  if (len != sizeof(show_response) + num_seats * sizeof(unsigned int)) {
     return 1;
   }
 
-  //Send setup opcode
-  char opcode = MSG_SETUP;
-  if (write(server_fd, &opcode, sizeof(char)) == -1) {
+  //Format every seat into one buffer, written at once, up to 10 digits and a space per seat
+  char* text = malloc(num_seats * (UINT_TEXT_MAX + 1) + response.num_rows + 1);
+  if (text == NULL) {
     return 1;
   }
+  size_t text_len = 0;
+  const char* seats = payload + sizeof(show_response);
+  for (size_t y = 0; y < response.num_rows; y++) {
+    for (size_t x = 0; x < response.num_cols; x++) {
+      unsigned int seat;
+      memcpy(&seat, seats + (y * response.num_cols + x) * sizeof(unsigned int), sizeof(unsigned int));
+      text_len += format_uint(text + text_len, seat);
+      text[text_len++] = ' ';
+    }
 
-  //Send setup request
-  setup_request request;
-  memset(request.request_fifo_name, 0, 40);
-  memset(request.response_fifo_name, 0, 40);
-  strncpy(request.request_fifo_name, req_pipe_path, 40);
-  strncpy(request.response_fifo_name, resp_pipe_path, 40);
-  if (write(server_fd, &request, sizeof(setup_request)) == -1) {
+    //Write line separator as well
+    text[text_len++] = '\n';
+  }
+
+  int ret = write_all(out_fd, text, text_len);
+  free(text);
+  if (ret) {
     return 1;
   }
 
-  //Open client pipes now that server has all needed information
-  req_fd = open(req_pipe_path, O_WRONLY);
-  if (req_fd == -1) {
+  //Return based on return_code
+  if (response.return_code == REPLICA_STALE) return REPLICA_STALE;
+  return response.return_code ? 1 : 0;
+}
+
+/// Reads a reservation seats response and prints the seats, as "Event: <id> reservation <id> seats (<x>,<y>) ...".
+/// @return 0 if the seats were printed, REPLICA_STALE if a replica could not answer, 1 otherwise.
+static int receive_seats(struct Connection* conn, int out_fd) {
+  size_t len;
+  const char* payload = receive_frame(conn, &len);
+  seats_response response;
+  if (payload == NULL || len < sizeof(seats_response)) {
     return 1;
   }
-  resp_fd = open(resp_pipe_path, O_RDONLY);
-  if (resp_fd == -1) {
+  memcpy(&response, payload, sizeof(seats_response));
+  if (response.return_code != 0) {
+    return response.return_code == REPLICA_STALE ? REPLICA_STALE : 1;
+  }
+  if (len != sizeof(seats_response) + 2 * response.num_seats * sizeof(size_t)) {
     return 1;
   }
 
-  //Read server response
-  setup_response response;
-  if (read(resp_fd, &response, sizeof(setup_response)) == -1) {
+  //Two coordinates of up to 20 digits each, parentheses, comma and space per seat
+  char* line = malloc(64 + response.num_seats * (2 * 20 + 4));
+  if (line == NULL) {
     return 1;
   }
-  
-  //Store session_id
-  session_id = response.session_id;
+  size_t line_len = (size_t)sprintf(line, "Event: %u reservation %u seats", response.event_id,
+                                    response.reservation_id);
+  const char* xs = payload + sizeof(seats_response);
+  const char* ys = xs + response.num_seats * sizeof(size_t);
+  for (size_t i = 0; i < response.num_seats; i++) {
+    size_t x, y;
+    memcpy(&x, xs + i * sizeof(size_t), sizeof(size_t));
+    memcpy(&y, ys + i * sizeof(size_t), sizeof(size_t));
+    line_len += (size_t)sprintf(line + line_len, " (%zu,%zu)", x, y);
+  }
+  line[line_len++] = '\n';
 
-  //Close server pipe
-  if (close(server_fd) == -1) {
+  int ret = write_all(out_fd, line, line_len);
+  free(line);
+  return ret;
+}
+
+/// Reads a list response, checking it holds as many ids as it says.
+/// @param ids Set to the event ids of the response, within its payload.
+/// @return Payload of the response, NULL on error.
+static const char* receive_list_ids(struct Connection* conn, list_response* response, const char** ids) {
+  size_t len;
+  const char* payload = receive_frame(conn, &len);
+  if (payload == NULL || len < sizeof(list_response)) {
+    return NULL;
+  }
+  memcpy(response, payload, sizeof(list_response));
+  if (len != sizeof(list_response) + response->num_events * sizeof(unsigned int)) {
+    return NULL;
+  }
+
+  *ids = payload + sizeof(list_response);
+  return payload;
+}
+
+/// Runs a SHOW, LIST or SEATS frame on the replica, falling back to the server if there is none or it is too stale.
+/// @param conn Session with the server owning the event.
+/// @param receive Reads the response of the frame.
+/// @return 0 if the request succeeded, 1 otherwise.
+static int send_read(struct Connection* conn, int out_fd, void* frame, size_t len,
+                     int (*receive)(struct Connection*, int)) {
+  if (replica.req_fd != -1) {
+    frame_set_session(frame, replica.session_id);
+    if (send_frame(&replica, frame, len)) {
+      return 1;
+    }
+
+    int ret = receive(&replica, out_fd);
+    if (ret != REPLICA_STALE) {
+      return ret;
+    }
+  }
+
+  frame_set_session(frame, conn->session_id);
+  if (send_frame(conn, frame, len)) {
     return 1;
   }
-  return 0;
+  return receive(conn, out_fd) ? 1 : 0;
 }
 
-int ems_quit(void) {
-  //Send opcode and session_id
-  SEND_CORE(MSG_QUIT);
+/// Orders event ids for qsort.
+static int compare_ids(const void* a, const void* b) {
+  unsigned int x = *(const unsigned int*)a, y = *(const unsigned int*)b;
+  return (x > y) - (x < y);
+}
 
-  //Close client pipes
-  if (close(req_fd) == -1) {
+/// Prints a list of event ids, one "Event: <id>" line each.
+/// @return 0 if the events were printed, 1 otherwise.
+static int print_ids(int out_fd, const unsigned int* ids, size_t count) {
+  //Every line formatted into one buffer, written at once
+  static const char prefix[] = "Event: ";
+  char* text = malloc(count * (sizeof(prefix) + UINT_TEXT_MAX) + 1);
+  if (text == NULL) {
+    return 1;
+  }
+
+  size_t len = 0;
+  for (size_t i = 0; i < count; i++) {
+    memcpy(text + len, prefix, sizeof(prefix) - 1);
+    len += sizeof(prefix) - 1;
+    len += format_uint(text + len, ids[i]);
+    text[len++] = '\n';
+  }
+
+  int ret = write_all(out_fd, text, len);
+  free(text);
+  return ret;
+}
+
+/// Reads a list response and prints the events.
+/// @return 0 if the events were printed, REPLICA_STALE if a replica could not answer, 1 otherwise.
+static int receive_list(struct Connection* conn, int out_fd) {
+  list_response response;
+  const char* ids;
+  if (receive_list_ids(conn, &response, &ids) == NULL) {
+    return 1;
+  }
+
+  //Ids are copied out of the payload, it is not aligned
+  unsigned int* events = malloc(response.num_events * sizeof(unsigned int) + 1);
+  if (events == NULL) {
+    return 1;
+  }
+  memcpy(events, ids, response.num_events * sizeof(unsigned int));
+  int ret = print_ids(out_fd, events, response.num_events);
+  free(events);
+  if (ret) {
+    return 1;
+  }
+
+  //Return based on return_code
+  if (response.return_code == REPLICA_STALE) return REPLICA_STALE;
+  return response.return_code ? 1 : 0;
+}
+
+/// Runs a LIST frame on every server of the cluster and prints the merged events, in id order.
+/// @return 0 if every server listed its events, 1 otherwise.
+static int list_cluster(int out_fd, void* frame, size_t len) {
+  if (shard_count == 1) {
+    return send_read(&shards[0], out_fd, frame, len, receive_list);
+  }
+
+  //Send every request before reading any response, so the servers list at the same time
+  for (unsigned int i = 0; i < shard_count; i++) {
+    frame_set_session(frame, shards[i].session_id);
+    if (send_frame(&shards[i], frame, len)) {
+      return 1;
+    }
+  }
+
+  //Gather the responses, every one of them is read even if a server failed
+  int ret = 0;
+  unsigned int* ids = NULL;
+  size_t count = 0;
+  for (unsigned int i = 0; i < shard_count; i++) {
+    list_response response;
+    const char* shard_ids;
+    unsigned int* grown = NULL;
+    if (receive_list_ids(&shards[i], &response, &shard_ids) == NULL ||
+        (grown = realloc(ids, (count + response.num_events) * sizeof(unsigned int) + 1)) == NULL) {
+      free(ids);
+      return 1;
+    }
+    memcpy(grown + count, shard_ids, response.num_events * sizeof(unsigned int));
+    ids = grown;
+    count += response.num_events;
+    ret |= response.return_code != 0;
+  }
+
+  //Each server lists in creation order, the merged list is sorted instead
+  qsort(ids, count, sizeof(unsigned int), compare_ids);
+  if (ret == 0) {
+    ret = print_ids(out_fd, ids, count);
+  }
+
+  free(ids);
+  return ret;
+}
+
+/// Fetches the pages of a MSG_LIST_PAGE frame from one session, moving the cursor of the frame after every page.
+/// Stopping on a stale replica leaves the cursor where the server should pick up.
+/// @param ids Array the event ids are appended to, grown as needed.
+/// @return 0 if the whole range was fetched, REPLICA_STALE if a replica could not answer, 1 otherwise.
+static int fetch_pages(struct Connection* conn, void* frame, size_t len, unsigned int** ids, size_t* count) {
+  frame_set_session(frame, conn->session_id);
+  while (1) {
+    if (send_frame(conn, frame, len)) {
+      return 1;
+    }
+
+    size_t payload_len;
+    const char* payload = receive_frame(conn, &payload_len);
+    list_page_response response;
+    if (payload == NULL || payload_len < sizeof(list_page_response)) {
+      return 1;
+    }
+    memcpy(&response, payload, sizeof(list_page_response));
+    if (payload_len != sizeof(list_page_response) + response.num_events * sizeof(unsigned int)) {
+      return 1;
+    }
+
+    unsigned int* grown = realloc(*ids, (*count + response.num_events) * sizeof(unsigned int) + 1);
+    if (grown == NULL) {
+      return 1;
+    }
+    *ids = grown;
+    memcpy(grown + *count, payload + sizeof(list_page_response), response.num_events * sizeof(unsigned int));
+    *count += response.num_events;
+
+    if (response.return_code == REPLICA_STALE) return REPLICA_STALE;
+    if (response.return_code != 0) return 1;
+    if (!response.more) return 0;
+    frame_set_list_cursor(frame, response.next_id);
+  }
+}
+
+/// Runs a MSG_LIST_PAGE frame on every server of the cluster, page by page, and prints the merged events in id order.
+/// A single server is read from its replica when there is one.
+/// @return 0 if every server listed its events, 1 otherwise.
+static int list_range(int out_fd, void* frame, size_t len) {
+  list_page_request request;
+  memcpy(&request, (char*)frame + sizeof(core_request), sizeof(list_page_request));
+
+  int ret = 0;
+  unsigned int* ids = NULL;
+  size_t count = 0;
+  for (unsigned int i = 0; i < shard_count && ret == 0; i++) {
+    frame_set_list_cursor(frame, request.from_id);
+    ret = shard_count == 1 && replica.req_fd != -1 ? fetch_pages(&replica, frame, len, &ids, &count) : REPLICA_STALE;
+    if (ret == REPLICA_STALE) {
+      ret = fetch_pages(&shards[i], frame, len, &ids, &count) ? 1 : 0;
+    }
+  }
+
+  //Every server pages in id order, the merged pages of a cluster are sorted again
+  if (shard_count > 1) {
+    qsort(ids, count, sizeof(unsigned int), compare_ids);
+  }
+  if (ret == 0) {
+    ret = print_ids(out_fd, ids, count);
+  }
+
+  free(ids);
+  return ret;
+}
+
+int ems_setup_replica(char const* req_pipe_path, char const* resp_pipe_path, char const* replica_pipe_path,
+                      unsigned int max_staleness_ms) {
+  //A replica follows a single server, it would miss the events of the other partitions
+  if (shard_count != 1) {
+    return 1;
+  }
+
+  if (connect_session(&replica, req_pipe_path, resp_pipe_path, replica_pipe_path)) {
+    replica.req_fd = -1;
     return 1;
   }
-  if (close(resp_fd) == -1) {
+
+  //Send the staleness bound, reads only go to the replica once it accepted it
+  char frame[FRAME_FIXED_MAX_SIZE];
+  if (send_frame(&replica, frame, frame_staleness(frame, replica.session_id, max_staleness_ms)) ||
+      receive_return_code(&replica)) {
+    close(replica.req_fd);
+    close(replica.resp_fd);
+    replica.req_fd = -1;
     return 1;
   }
+
   return 0;
 }
 
-int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols) {
+/// Ends a session and closes its pipes.
+/// @return 0 in case of success, 1 otherwise.
+static int quit_session(struct Connection* conn) {
   //Send opcode and session_id
-  SEND_CORE(MSG_CREATE);
+  char frame[FRAME_FIXED_MAX_SIZE];
+  if (send_frame(conn, frame, frame_core(frame, MSG_QUIT, conn->session_id))) {
+    return 1;
+  }
 
-  //Build and send request
-  create_request request;
-  request.event_id = event_id;
-  request.num_rows = num_rows;
-  request.num_cols = num_cols;
-  if (write(req_fd, &request, sizeof(create_request)) == -1) {
+  //Close client pipes
+  int ret = close(conn->req_fd) == -1 || close(conn->resp_fd) == -1;
+  conn->req_fd = -1;
+  free(conn->in);
+  conn->in = NULL;
+  conn->in_pos = conn->in_len = conn->in_cap = 0;
+  return ret;
+}
+
+int ems_quit(void) {
+  if (replica.req_fd != -1 && quit_session(&replica)) {
     return 1;
   }
 
-  //Read response
-  create_response response;
-  if (read(resp_fd, &response, sizeof(create_response)) == -1) {
+  //Drop the notification pipe, if any
+  if (notify_fd != -1) {
+    close(notify_fd);
+    unlink(notify_path);
+    notify_fd = -1;
+  }
+
+  int ret = 0;
+  for (unsigned int i = 0; i < shard_count; i++) {
+    ret |= quit_session(&shards[i]);
+  }
+  shard_count = 0;
+  return ret;
+}
+
+int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols) {
+  //Build and send request to the server owning the event
+  struct Connection* conn = shard_of(event_id);
+  char frame[FRAME_FIXED_MAX_SIZE];
+  if (send_frame(conn, frame, frame_create(frame, conn->session_id, event_id, num_rows, num_cols))) {
     return 1;
   }
 
-  //Return based on return_code
-  return response.return_code ? 1 : 0;
+  //Read response
+  return receive_return_code(conn);
 }
 
 int ems_reserve(unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys) {
-  //Send opcode and session_id
-  SEND_CORE(MSG_RESERVE);
-  
-  //Build and send request
-  reserve_request request;
-  request.event_id = event_id;
-  request.num_seats = num_seats;
-  if (write(req_fd, &request, sizeof(reserve_request)) == -1) {
+  //Build request with its coordinate arrays and send it in one go
+  //The payload length of a frame must fit its header
+  struct Connection* conn = shard_of(event_id);
+  char* frame = frame_reserve_size(num_seats) > UINT_MAX ? NULL : malloc(frame_reserve_size(num_seats));
+  if (frame == NULL) {
     return 1;
   }
 
-  //Send aditional arguments
-  if (write(req_fd, xs, num_seats * sizeof(size_t)) == -1) {
+  size_t len = frame_reserve(frame, conn->session_id, event_id, num_seats, xs, ys);
+  int ret = send_frame(conn, frame, len);
+  free(frame);
+  if (ret) {
     return 1;
   }
-  if (write(req_fd, ys, num_seats * sizeof(size_t)) == -1) {
+
+  //Read response
+  return receive_return_code(conn);
+}
+
+int ems_cancel(unsigned int event_id, unsigned int reservation_id) {
+  //Build and send request to the server owning the event
+  struct Connection* conn = shard_of(event_id);
+  char frame[FRAME_FIXED_MAX_SIZE];
+  if (send_frame(conn, frame, frame_cancel(frame, conn->session_id, event_id, reservation_id))) {
     return 1;
   }
 
   //Read response
-  reserve_response response;
-  if (read(resp_fd, &response, sizeof(reserve_response)) == -1) {
+  return receive_return_code(conn);
+}
+
+/// Reads a stats response, keeping its records to print them in request order.
+/// @param records Set to a buffer with the event_stats records of the response, each followed by its free seat
+/// counts, to be freed by the caller whatever the result.
+/// @return 0 if the response was read, REPLICA_STALE if a replica could not answer, 1 otherwise.
+static int receive_stats(struct Connection* conn, char** records) {
+  size_t len;
+  const char* payload = receive_frame(conn, &len);
+  stats_response response;
+  if (payload == NULL || len < sizeof(stats_response)) {
     return 1;
   }
+  memcpy(&response, payload, sizeof(stats_response));
 
-  //Return based on return_code
+  //Every record must be complete, they are printed straight from the copy
+  size_t records_len = len - sizeof(stats_response);
+  for (size_t offset = 0, i = 0; i < response.num_events; i++) {
+    event_stats record;
+    if (offset + sizeof(event_stats) > records_len) {
+      return 1;
+    }
+    memcpy(&record, payload + sizeof(stats_response) + offset, sizeof(event_stats));
+    offset += sizeof(event_stats);
+    if (record.num_rows > (records_len - offset) / sizeof(size_t)) {
+      return 1;
+    }
+    offset += record.num_rows * sizeof(size_t);
+  }
+
+  *records = malloc(records_len + 1);
+  if (*records == NULL) {
+    return 1;
+  }
+  memcpy(*records, payload + sizeof(stats_response), records_len);
+
+  if (response.return_code == REPLICA_STALE) return REPLICA_STALE;
   return response.return_code ? 1 : 0;
 }
 
-int ems_show(int out_fd, unsigned int event_id) {
-  //Send opcode and session_id
-  SEND_CORE(MSG_SHOW);
+/// Sends a MSG_STATS frame over a session and reads its response.
+/// @return 0 if the request succeeded, REPLICA_STALE if a replica could not answer, 1 otherwise.
+static int fetch_stats(struct Connection* conn, void* frame, size_t len, char** records) {
+  frame_set_session(frame, conn->session_id);
+  if (send_frame(conn, frame, len)) {
+    return 1;
+  }
+  return receive_stats(conn, records);
+}
 
-  //Build and send request
-  show_request request;
-  request.event_id = event_id;
-  if (write(req_fd, &request, sizeof(show_request)) == -1) {
+/// Prints one event_stats record, as "Event: <id> sold <sold>/<seats> reservations <count> free <row 1> ...".
+/// @param size Set to the size of the record and its free seat counts.
+/// @return 0 if the record was printed, 1 otherwise.
+static int print_stats(int out_fd, const char* data, size_t* size) {
+  event_stats record;
+  memcpy(&record, data, sizeof(event_stats));
+  *size = sizeof(event_stats) + record.num_rows * sizeof(size_t);
+
+  //Room for every count of the line, printed with a single write
+  size_t cap = 128 + record.num_rows * 21;
+  char* line = malloc(cap);
+  if (line == NULL) {
     return 1;
   }
 
-  //Read response
-  show_response response;
-  if (read(resp_fd, &response, sizeof(show_response)) == -1) {
+  int len;
+  if (!record.found) {
+    len = snprintf(line, cap, "Event: %u not found\n", record.event_id);
+  } else {
+    len = snprintf(line, cap, "Event: %u sold %zu/%zu reservations %u free", record.event_id, record.sold,
+                   record.num_rows * record.num_cols, record.reservations);
+    for (size_t row = 0; row < record.num_rows; row++) {
+      size_t row_free;
+      memcpy(&row_free, data + sizeof(event_stats) + row * sizeof(size_t), sizeof(size_t));
+      len += snprintf(line + len, cap - (size_t)len, " %zu", row_free);
+    }
+    line[len++] = '\n';
+  }
+
+  int ret = write(out_fd, line, (size_t)len) == -1;
+  free(line);
+  return ret;
+}
+
+/// Asks every server owning some of the events for their occupancy and prints it, in request order.
+/// A single server is asked through its replica when there is one.
+/// @return 0 if every server answered, 1 otherwise.
+static int stats_cluster(int out_fd, const unsigned int* event_ids, size_t count) {
+  if (count == 0 || count > STATS_MAX_EVENTS) {
     return 1;
   }
 
-  //String buffer for printing
-  char buff[1024];
-  //Read returned data
-  for (size_t y = 0; y < response.num_rows; y++)
-  {
-    for (size_t x = 0; x < response.num_cols; x++)
-    {
-      //Read seat
-      unsigned int seats;
-      if (read(resp_fd, &seats, sizeof(seats)) == -1) {
-        return 1;
+  char frame[sizeof(core_request) + sizeof(stats_request) + STATS_MAX_EVENTS * sizeof(unsigned int)];
+  char* records[MAX_CLUSTER_SIZE] = {NULL};
+  int ret = 0;
+  if (shard_count == 1) {
+    size_t len = frame_stats(frame, 0, count, event_ids);
+    ret = replica.req_fd != -1 ? fetch_stats(&replica, frame, len, &records[0]) : REPLICA_STALE;
+    if (ret == REPLICA_STALE) {
+      free(records[0]);
+      records[0] = NULL;
+      ret = fetch_stats(&shards[0], frame, len, &records[0]) ? 1 : 0;
+    }
+  } else {
+    //Send every request before reading any response, so the servers answer at the same time
+    int asked[MAX_CLUSTER_SIZE] = {0};
+    for (unsigned int i = 0; i < shard_count && ret == 0; i++) {
+      unsigned int owned[STATS_MAX_EVENTS];
+      size_t num_owned = 0;
+      for (size_t j = 0; j < count; j++) {
+        if (partition_of(event_ids[j], shard_count) == i) owned[num_owned++] = event_ids[j];
       }
+      if (num_owned == 0) continue;
 
-      //Format string for printing
-      snprintf(buff, 1024, "%u ", seats);
-      if (write(out_fd, buff, strlen(buff)) == -1) {
-        return 1;
-      }
+      asked[i] = 1;
+      ret = send_frame(&shards[i], frame, frame_stats(frame, shards[i].session_id, num_owned, owned));
     }
 
-    //Write line separator as well
-    if (write(out_fd, "\n", 1) == -1) {
-      return 1;
+    //Every response is read even if a server failed
+    for (unsigned int i = 0; i < shard_count; i++) {
+      if (asked[i] && receive_stats(&shards[i], &records[i]) != 0) ret = 1;
     }
   }
 
-  //Return based on return_code
-  return response.return_code ? 1 : 0;
+  //Each server answers its events in request order, so every event is next in the records of its server
+  size_t offsets[MAX_CLUSTER_SIZE] = {0};
+  for (size_t j = 0; j < count && ret == 0; j++) {
+    unsigned int shard = shard_count == 1 ? 0 : partition_of(event_ids[j], shard_count);
+    size_t size;
+    ret = print_stats(out_fd, records[shard] + offsets[shard], &size);
+    offsets[shard] += size;
+  }
+
+  for (unsigned int i = 0; i < shard_count; i++) {
+    free(records[i]);
+  }
+  return ret;
 }
 
-int ems_list_events(int out_fd) {
-  //Send opcode and session_id
-  SEND_CORE(MSG_LIST);
+int ems_show(int out_fd, unsigned int event_id) {
+  //Build request, sent to the replica if there is one
+  char frame[FRAME_FIXED_MAX_SIZE];
+  struct Connection* conn = shard_of(event_id);
+  return send_read(conn, out_fd, frame, frame_show(frame, conn->session_id, event_id), receive_show);
+}
 
+int ems_seats(int out_fd, unsigned int event_id, unsigned int reservation_id) {
+  char frame[FRAME_FIXED_MAX_SIZE];
+  struct Connection* conn = shard_of(event_id);
+  return send_read(conn, out_fd, frame, frame_seats(frame, conn->session_id, event_id, reservation_id),
+                   receive_seats);
+}
+
+int ems_list_events(int out_fd) {
   //There is no extra data after the core, so no need to build a request
+  char frame[FRAME_FIXED_MAX_SIZE];
+  return list_cluster(out_fd, frame, frame_core(frame, MSG_LIST, 0));
+}
+
+int ems_list_range(int out_fd, unsigned int from_id, unsigned int to_id, unsigned int min_free_seats) {
+  char frame[FRAME_FIXED_MAX_SIZE];
+  return list_range(out_fd, frame, frame_list_page(frame, 0, from_id, to_id, LIST_PAGE_SIZE, min_free_seats));
+}
+
+int ems_stats(int out_fd, size_t num_events, const unsigned int* event_ids) {
+  return stats_cluster(out_fd, event_ids, num_events);
+}
+
+int ems_subscribe(unsigned int event_id) {
+  //Open the notification pipe for reading before the server opens it for writing, so neither side blocks
+  if (notify_fd == -1) {
+    if (strlen(notify_path) >= sizeof(((subscribe_request*)NULL)->notify_fifo_name)) {
+      return 1;
+    }
+
+    unlink(notify_path);
+    if (mkfifo(notify_path, FIFO_PERMS) == -1) {
+      return 1;
+    }
+    notify_fd = open(notify_path, O_RDONLY | O_NONBLOCK);
+    if (notify_fd == -1) {
+      return 1;
+    }
+  }
+
+  //Build and send request to the server owning the event
+  struct Connection* conn = shard_of(event_id);
+  char frame[FRAME_FIXED_MAX_SIZE];
+  if (send_frame(conn, frame, frame_subscribe(frame, conn->session_id, event_id, notify_path))) {
+    return 1;
+  }
 
   //Read response
-  list_response response;
-  if(read(resp_fd, &response, sizeof(list_response)) == -1) {
+  return receive_return_code(conn);
+}
+
+int ems_unsubscribe(unsigned int event_id) {
+  //Build and send request to the server owning the event
+  struct Connection* conn = shard_of(event_id);
+  char frame[FRAME_FIXED_MAX_SIZE];
+  if (send_frame(conn, frame, frame_unsubscribe(frame, conn->session_id, event_id))) {
     return 1;
   }
 
-  //String buffer for printing
-  char buff[1024];
-  //Read returned data
-  while (response.num_events--)
-  {
-    //Read event id
-    unsigned int event_id;
-    if(read(resp_fd, &event_id, sizeof(event_id)) == -1) {
-      return 1;
+  //Read response
+  return receive_return_code(conn);
+}
+
+int ems_poll_updates(ems_update_callback callback, void* arg) {
+  if (notify_fd == -1) {
+    return 0;
+  }
+
+  int delivered = 0;
+  while (1) {
+    //Nothing pending, or no writer yet
+    notify_header header;
+    ssize_t ret = read(notify_fd, &header, sizeof(notify_header));
+    if (ret == 0 || (ret == -1 && errno == EAGAIN)) {
+      return delivered;
+    }
+    if (ret != sizeof(notify_header)) {
+      return -1;
     }
 
-    //Format string for printing
-    snprintf(buff, 1024, "Event: %u\n", event_id);
-    if(write(out_fd, buff, strlen(buff)) == -1) {
-      return 1;
+    if (header.kind == NOTIFY_RESYNC) {
+      struct ems_update update = {.resync = 1};
+      callback(&update, arg);
+      delivered++;
+      continue;
+    }
+
+    //The server writes each message at once, so its records are already in the pipe
+    seat_change changes[PIPE_BUF / sizeof(seat_change)];
+    size_t len = header.count * sizeof(seat_change);
+    if (header.count > PIPE_BUF / sizeof(seat_change) || read(notify_fd, changes, len) != (ssize_t)len) {
+      return -1;
+    }
+
+    for (unsigned int i = 0; i < header.count; i++) {
+      struct ems_update update = {.resync = 0,
+                                  .event_id = changes[i].event_id,
+                                  .reservation_id = changes[i].reservation_id,
+                                  .row = changes[i].row,
+                                  .col = changes[i].col};
+      callback(&update, arg);
+      delivered++;
     }
   }
+}
 
-  //Return based on return_code
-  return response.return_code ? 1 : 0;
+int ems_send_frame(int out_fd, void* frame, size_t len) {
+  //Frames are built ahead of time, only the session id is ours to fill in, reads may go to the replica
+  char opcode = ((char*)frame)[0];
+  if (opcode == MSG_LIST) return list_cluster(out_fd, frame, len);
+  if (opcode == MSG_LIST_PAGE) return list_range(out_fd, frame, len);
+  if (opcode == MSG_STATS) {
+    //The events may belong to several servers, the request is split again
+    stats_request request;
+    memcpy(&request, (char*)frame + sizeof(core_request), sizeof(stats_request));
+    unsigned int event_ids[STATS_MAX_EVENTS];
+    if (request.num_events > STATS_MAX_EVENTS) return 1;
+    memcpy(event_ids, (char*)frame + sizeof(core_request) + sizeof(stats_request),
+           request.num_events * sizeof(unsigned int));
+    return stats_cluster(out_fd, event_ids, request.num_events);
+  }
+
+  //Every other frame names its event first, which picks the server
+  struct Connection* conn = shard_of(frame_event_id(frame));
+  if (opcode == MSG_SHOW) return send_read(conn, out_fd, frame, len, receive_show);
+  if (opcode == MSG_SEATS) return send_read(conn, out_fd, frame, len, receive_seats);
+
+  frame_set_session(frame, conn->session_id);
+  if (send_frame(conn, frame, len)) {
+    return 1;
+  }
+
+  //Read the response matching the opcode of the frame
+  switch (opcode) {
+    case MSG_CREATE:
+    case MSG_RESERVE:
+    case MSG_CANCEL:
+      return receive_return_code(conn);
+
+    default:
+      return 1;
+  }
 }
@@ -4,13 +4,26 @@
 #include <stddef.h>
 
 /// Connects to an EMS server.
+/// @note Sessions are per thread: every thread that talks to the server calls this with its own pipes.
 /// @param req_pipe_path Path to the name pipe to be created for requests.
 /// @param resp_pipe_path Path to the name pipe to be created for responses.
-/// @param server_pipe_path Path to the name pipe where the server is listening.
+/// @param server_pipe_path Path to the name pipe where the server is listening. For a cluster partitioned by event id,
+/// the comma separated pipes of its servers in partition order: each gets a session, over pipes suffixed by ".s<i>".
 /// @return 0 if the connection was established successfully, 1 otherwise.
 int ems_setup(char const* req_pipe_path, char const* resp_pipe_path, char const* server_pipe_path);
 
-/// Disconnects from an EMS server.
+/// Connects the calling thread to a read replica as well, which then answers its SHOW and LIST requests.
+/// @note Only available with a single server, not a partitioned cluster.
+/// Requests the replica is too far behind to answer, and all writes, go to the server given to ems_setup.
+/// @param req_pipe_path Path to the name pipe to be created for requests to the replica.
+/// @param resp_pipe_path Path to the name pipe to be created for responses from the replica.
+/// @param replica_pipe_path Path to the name pipe where the replica is listening.
+/// @param max_staleness_ms How far behind the primary the replica may be when answering.
+/// @return 0 if the connection was established successfully, 1 otherwise.
+int ems_setup_replica(char const* req_pipe_path, char const* resp_pipe_path, char const* replica_pipe_path,
+                      unsigned int max_staleness_ms);
+
+/// Disconnects from an EMS server, and from the read replica if any.
 /// @return 0 in case of success, 1 otherwise.
 int ems_quit(void);
 
@@ -29,15 +42,83 @@ int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols);
 /// @return 0 if the reservation was created successfully, 1 otherwise.
 int ems_reserve(unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys);
 
+/// Cancels a reservation, releasing all of its seats.
+/// @param event_id Id of the event the reservation belongs to.
+/// @param reservation_id Id of the reservation to cancel.
+/// @return 0 if the reservation was cancelled successfully, 1 otherwise.
+int ems_cancel(unsigned int event_id, unsigned int reservation_id);
+
 /// Prints the given event to the given file.
 /// @param out_fd File descriptor to print the event to.
 /// @param event_id Id of the event to print.
 /// @return 0 if the event was printed successfully, 1 otherwise.
 int ems_show(int out_fd, unsigned int event_id);
 
-/// Prints all the events to the given file.
+/// Prints the seats held by a reservation, as "Event: <id> reservation <id> seats (<x1>,<y1>) (<x2>,<y2>) ...".
+/// The server reads them from its reservation index, so the cost follows the size of the reservation, not the event.
+/// @param out_fd File descriptor to print the seats to.
+/// @param event_id Id of the event the reservation belongs to.
+/// @param reservation_id Id of the reservation.
+/// @return 0 if the seats were printed successfully, 1 otherwise.
+int ems_seats(int out_fd, unsigned int event_id, unsigned int reservation_id);
+
+/// Prints all the events to the given file, gathered from every server of a cluster and then sorted by id.
 /// @param out_fd File descriptor to print the events to.
 /// @return 0 if the events were printed successfully, 1 otherwise.
 int ems_list_events(int out_fd);
 
+/// Prints the events with ids in [from_id, to_id] that have at least min_free_seats free seats, in id order.
+/// The servers answer a page at a time, so a long range never holds up other requests for its whole length.
+/// @param out_fd File descriptor to print the events to.
+/// @param from_id First event id of the range.
+/// @param to_id Last event id of the range.
+/// @param min_free_seats Minimum number of free seats of a listed event, 0 lists every event of the range.
+/// @return 0 if the events were printed successfully, 1 otherwise.
+int ems_list_range(int out_fd, unsigned int from_id, unsigned int to_id, unsigned int min_free_seats);
+
+/// Prints the occupancy of some events, one line each in the given order, without transferring their seats.
+/// Each line holds the sold seats, the reservations holding seats and the free seats of every row.
+/// @param out_fd File descriptor to print the events to.
+/// @param num_events Number of events, at most STATS_MAX_EVENTS.
+/// @param event_ids Ids of the events.
+/// @return 0 if the occupancy was printed successfully, 1 otherwise.
+int ems_stats(int out_fd, size_t num_events, const unsigned int* event_ids);
+
+/// Seat change pushed by the server to a subscribed session.
+struct ems_update {
+  int resync;                   /// 1 if changes were dropped: SHOW the subscribed events again. Other fields are unset.
+  unsigned int event_id;        /// Event the seat belongs to.
+  unsigned int reservation_id;  /// New reservation id of the seat, 0 if it was freed.
+  size_t row;                   /// Row of the seat.
+  size_t col;                   /// Column of the seat.
+};
+
+/// Called by ems_poll_updates for every update received.
+typedef void (*ems_update_callback)(const struct ems_update* update, void* arg);
+
+/// Subscribes to the seat changes of an event. Changes are pushed through a notification pipe next to the response
+/// pipe, created on the first subscription, and consumed with ems_poll_updates.
+/// @param event_id Id of the event to subscribe to.
+/// @return 0 if the subscription was made, 1 otherwise.
+int ems_subscribe(unsigned int event_id);
+
+/// Stops receiving the seat changes of an event.
+/// @param event_id Id of the event to unsubscribe from.
+/// @return 0 if the subscription was dropped, 1 otherwise.
+int ems_unsubscribe(unsigned int event_id);
+
+/// Hands every update received so far to a callback, without blocking.
+/// @param callback Function called for each update.
+/// @param arg Passed to the callback.
+/// @return Number of updates delivered, -1 on error.
+int ems_poll_updates(ems_update_callback callback, void* arg);
+
+/// Sends a prebuilt request frame and handles its response.
+/// @note The session id of the frame is overwritten with the current one.
+/// @param out_fd File descriptor to print SHOW and LIST output to.
+/// @param frame Frame as laid out by the builders in frame.h.
+/// @param len Size of the frame.
+/// @return 0 if the request succeeded, 1 otherwise.
+int ems_send_frame(int out_fd, void* frame, size_t len);
+
 #endif  // CLIENT_API_H
@@ -0,0 +1,286 @@
+#include "compiled.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "api.h"
+#include "common/constants.h"
+#include "common/messages.h"
+#include "frame.h"
+#include "parser.h"
+
+/// Growable output buffer for the compiler.
+struct Output {
+  char* data;
+  size_t len;
+  size_t cap;
+};
+
+/// Reserves room for len more bytes at the end of the output.
+/// @return Pointer to the reserved bytes, NULL on failure.
+static char* output_reserve(struct Output* out, size_t len) {
+  if (out->len + len > out->cap) {
+    size_t cap = out->cap ? out->cap * 2 : 4096;
+    while (cap < out->len + len) cap *= 2;
+
+    char* data = realloc(out->data, cap);
+    if (data == NULL) return NULL;
+
+    out->data = data;
+    out->cap = cap;
+  }
+
+  char* ret = out->data + out->len;
+  out->len += len;
+  return ret;
+}
+
+/// Appends a record with room for a frame of frame_len bytes.
+/// @return Pointer to where the frame goes, NULL on failure.
+static char* output_record(struct Output* out, struct CompiledRecord record) {
+  size_t padded = (record.frame_len + COMPILED_ALIGN - 1) / COMPILED_ALIGN * COMPILED_ALIGN;
+  char* dst = output_reserve(out, sizeof(struct CompiledRecord) + padded);
+  if (dst == NULL) return NULL;
+
+  memcpy(dst, &record, sizeof(struct CompiledRecord));
+  memset(dst + sizeof(struct CompiledRecord) + record.frame_len, 0, padded - record.frame_len);
+  ((struct CompiledHeader*)out->data)->record_count++;
+  return dst + sizeof(struct CompiledRecord);
+}
+
+int compile_jobs(int in_fd, int out_fd) {
+  struct Output out = {NULL, 0, 0};
+
+  struct CompiledHeader* header = (struct CompiledHeader*)output_reserve(&out, sizeof(struct CompiledHeader));
+  if (header == NULL) return 1;
+  memcpy(header->magic, COMPILED_MAGIC, 4);
+  header->version = COMPILED_VERSION;
+  header->record_count = 0;
+
+  // Parse every command and store it as the frame the client would send
+  int ok = 1;
+  size_t* xs = NULL;
+  size_t* ys = NULL;
+  size_t coords_capacity = 0;
+  while (ok) {
+    unsigned int event_id, reservation_id;
+    size_t num_rows, num_columns, num_coords, num_events;
+    unsigned int delay = 0, wait_thread = 0;
+    unsigned int from_id, to_id, min_free_seats;
+    unsigned int event_ids[STATS_MAX_EVENTS];
+    struct CompiledRecord record = {0, 0, 0, 0, 0, 0};
+    char fixed[FRAME_FIXED_MAX_SIZE];
+    char* frame;
+    int has_thread;
+
+    enum Command cmd = get_next(in_fd);
+    record.command = (uint8_t)cmd;
+
+    switch (cmd) {
+      case CMD_CREATE:
+        if (parse_create(in_fd, &event_id, &num_rows, &num_columns) != 0) {
+          fprintf(stderr, "Invalid command. See HELP for usage\n");
+          continue;
+        }
+
+        record.frame_len = (uint32_t)frame_create(fixed, 0, event_id, num_rows, num_columns);
+        break;
+
+      case CMD_RESERVE:
+        num_coords = parse_reserve(in_fd, &event_id, &xs, &ys, &coords_capacity);
+        if (num_coords == 0 || frame_reserve_size(num_coords) > UINT32_MAX) {
+          fprintf(stderr, "Invalid command. See HELP for usage\n");
+          continue;
+        }
+
+        // Built in place, the coordinates do not fit the fixed buffer
+        record.frame_len = (uint32_t)frame_reserve_size(num_coords);
+        frame = output_record(&out, record);
+        if (frame == NULL) ok = 0;
+        else frame_reserve(frame, 0, event_id, num_coords, xs, ys);
+        continue;
+
+      case CMD_CANCEL:
+        if (parse_cancel(in_fd, &event_id, &reservation_id) != 0) {
+          fprintf(stderr, "Invalid command. See HELP for usage\n");
+          continue;
+        }
+
+        record.frame_len = (uint32_t)frame_cancel(fixed, 0, event_id, reservation_id);
+        break;
+
+      case CMD_SHOW:
+        if (parse_show(in_fd, &event_id) != 0) {
+          fprintf(stderr, "Invalid command. See HELP for usage\n");
+          continue;
+        }
+
+        record.frame_len = (uint32_t)frame_show(fixed, 0, event_id);
+        break;
+
+      case CMD_SEATS:
+        if (parse_cancel(in_fd, &event_id, &reservation_id) != 0) {
+          fprintf(stderr, "Invalid command. See HELP for usage\n");
+          continue;
+        }
+
+        record.frame_len = (uint32_t)frame_seats(fixed, 0, event_id, reservation_id);
+        break;
+
+      case CMD_LIST_EVENTS:
+        record.frame_len = (uint32_t)frame_core(fixed, MSG_LIST, 0);
+        break;
+
+      case CMD_LIST_RANGE:
+        if (parse_list_range(in_fd, &from_id, &to_id, &min_free_seats) != 0) {
+          fprintf(stderr, "Invalid command. See HELP for usage\n");
+          continue;
+        }
+
+        record.frame_len = (uint32_t)frame_list_page(fixed, 0, from_id, to_id, LIST_PAGE_SIZE, min_free_seats);
+        break;
+
+      case CMD_STATS:
+        num_events = parse_stats(in_fd, STATS_MAX_EVENTS, event_ids);
+        if (num_events == 0) {
+          fprintf(stderr, "Invalid command. See HELP for usage\n");
+          continue;
+        }
+
+        // Built in place, the event ids do not fit the fixed buffer
+        record.frame_len = (uint32_t)frame_stats_size(num_events);
+        frame = output_record(&out, record);
+        if (frame == NULL) ok = 0;
+        else frame_stats(frame, 0, num_events, event_ids);
+        continue;
+
+      case CMD_WAIT:
+        has_thread = parse_wait(in_fd, &delay, &wait_thread);
+        if (has_thread == -1) {
+          fprintf(stderr, "Invalid command. See HELP for usage\n");
+          continue;
+        }
+
+        record.has_thread = (uint8_t)has_thread;
+        record.delay = delay;
+        record.thread_id = wait_thread;
+        break;
+
+      case CMD_BARRIER:
+        break;
+
+      case CMD_SUBSCRIBE:
+      case CMD_UNSUBSCRIBE:
+        // Subscriptions depend on the notification pipe of the running session
+        parse_show(in_fd, &event_id);
+        fprintf(stderr, "Subscriptions are not supported in compiled jobs, skipped\n");
+        continue;
+
+      case CMD_UPDATES:
+        fprintf(stderr, "Subscriptions are not supported in compiled jobs, skipped\n");
+        continue;
+
+      case CMD_INVALID:
+        fprintf(stderr, "Invalid command. See HELP for usage\n");
+        continue;
+
+      case CMD_HELP:
+      case CMD_EMPTY:
+        continue;
+
+      case EOC:
+        break;
+    }
+
+    if (cmd == EOC) break;
+
+    frame = output_record(&out, record);
+    if (frame == NULL) ok = 0;
+    else memcpy(frame, fixed, record.frame_len);
+  }
+  free(xs);
+  free(ys);
+
+  if (!ok) {
+    fprintf(stderr, "Error allocating memory for compiled jobs\n");
+    free(out.data);
+    return 1;
+  }
+
+  // Write the whole file at once
+  size_t written = 0;
+  while (written < out.len) {
+    ssize_t ret = write(out_fd, out.data + written, out.len - written);
+    if (ret == -1) {
+      free(out.data);
+      return 1;
+    }
+    written += (size_t)ret;
+  }
+
+  free(out.data);
+  return 0;
+}
+
+int replay_compiled(const char* path, int out_fd, unsigned int thread_id, unsigned int thread_count,
+                    pthread_barrier_t* barrier) {
+  int fd = open(path, O_RDONLY);
+  if (fd == -1) {
+    fprintf(stderr, "Failed to open compiled jobs file. Path: %s\n", path);
+    return 1;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(struct CompiledHeader)) {
+    fprintf(stderr, "Invalid compiled jobs file. Path: %s\n", path);
+    close(fd);
+    return 1;
+  }
+
+  // Private writable mapping: session ids are patched into the frames, copying only the touched pages
+  size_t size = (size_t)st.st_size;
+  char* map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    fprintf(stderr, "Failed to map compiled jobs file. Path: %s\n", path);
+    return 1;
+  }
+  posix_madvise(map, size, POSIX_MADV_SEQUENTIAL);
+
+  struct CompiledHeader* header = (struct CompiledHeader*)map;
+  if (memcmp(header->magic, COMPILED_MAGIC, 4) != 0 || header->version != COMPILED_VERSION) {
+    fprintf(stderr, "Compiled jobs file has an unknown format, recompile it. Path: %s\n", path);
+    munmap(map, size);
+    return 1;
+  }
+
+  size_t offset = sizeof(struct CompiledHeader);
+  size_t request_index = 0;
+  for (uint64_t i = 0; i < header->record_count; i++) {
+    if (offset + sizeof(struct CompiledRecord) > size) break;
+    struct CompiledRecord* record = (struct CompiledRecord*)(map + offset);
+    char* frame = map + offset + sizeof(struct CompiledRecord);
+    offset += sizeof(struct CompiledRecord) + (record->frame_len + COMPILED_ALIGN - 1) / COMPILED_ALIGN * COMPILED_ALIGN;
+    if (offset > size) break;
+
+    if (record->command == CMD_BARRIER) {
+      if (barrier != NULL) pthread_barrier_wait(barrier);
+    } else if (record->command == CMD_WAIT) {
+      if (record->delay > 0 && (!record->has_thread || record->thread_id == thread_id)) {
+        struct timespec ts = {record->delay / 1000, (long)(record->delay % 1000) * 1000000};
+        nanosleep(&ts, NULL);
+      }
+    } else if (request_index++ % thread_count == thread_id) {
+      if (ems_send_frame(out_fd, frame, record->frame_len)) fprintf(stderr, "Failed to replay request\n");
+    }
+  }
+
+  munmap(map, size);
+  return 0;
+}
@@ -0,0 +1,53 @@
+#ifndef CLIENT_COMPILED_H
+#define CLIENT_COMPILED_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// Compiled jobs files hold the requests of a .jobs file already laid out as protocol frames,
+/// so they can be replayed straight from a memory mapping.
+///
+/// Layout: a CompiledHeader followed by record_count records. Each record is a CompiledRecord
+/// followed by frame_len bytes of request frame, padded to COMPILED_ALIGN bytes.
+
+#define COMPILED_MAGIC "EMSJ"
+#define COMPILED_VERSION 5
+#define COMPILED_ALIGN 8
+#define COMPILED_EXTENSION ".bjobs"
+
+/// Header of a compiled jobs file.
+struct CompiledHeader {
+  char magic[4];          /// COMPILED_MAGIC.
+  uint32_t version;       /// COMPILED_VERSION, bumped whenever the frame layout changes.
+  uint64_t record_count;  /// Number of records in the file.
+};
+
+/// Header of a record of a compiled jobs file.
+struct CompiledRecord {
+  uint32_t frame_len;  /// Size of the frame following the record, 0 for WAIT and BARRIER.
+  uint8_t command;     /// enum Command of the record.
+  uint8_t has_thread;  /// WAIT only: 1 if the wait applies to thread_id alone.
+  uint16_t reserved;   /// Padding, always 0.
+  uint32_t delay;      /// WAIT only: delay in milliseconds.
+  uint32_t thread_id;  /// WAIT only: thread the wait applies to.
+};
+
+/// Compiles a .jobs file into a compiled jobs file.
+/// @param in_fd File descriptor of the .jobs file.
+/// @param out_fd File descriptor to write the compiled file to.
+/// @return 0 if the file was compiled, 1 otherwise.
+int compile_jobs(int in_fd, int out_fd);
+
+/// Replays a compiled jobs file over the calling thread's session.
+/// Requests are split between threads exactly like the text runner does.
+/// @param path Path of the compiled file.
+/// @param out_fd File descriptor to write SHOW and LIST output to.
+/// @param thread_id Id of the calling thread.
+/// @param thread_count Number of threads replaying the same file.
+/// @param barrier Barrier shared by those threads, NULL if thread_count is 1.
+/// @return 0 if the file was replayed, 1 otherwise.
+int replay_compiled(const char* path, int out_fd, unsigned int thread_id, unsigned int thread_count,
+                    pthread_barrier_t* barrier);
+
+#endif  // CLIENT_COMPILED_H
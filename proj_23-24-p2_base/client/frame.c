@@ -0,0 +1,136 @@
+#include "frame.h"
+
+#include <string.h>
+
+#include "common/messages.h"
+
+/// Builds the header of a frame whose payload is payload_len bytes long.
+static size_t frame_header(void* buf, char opcode, unsigned int session_id, size_t payload_len) {
+  core_request core = {
+      .opcode = opcode, .session_id = session_id, .request_id = 0, .payload_len = (unsigned int)payload_len};
+  memcpy(buf, &core, sizeof(core_request));
+  return sizeof(core_request);
+}
+
+size_t frame_core(void* buf, char opcode, unsigned int session_id) { return frame_header(buf, opcode, session_id, 0); }
+
+size_t frame_create(void* buf, unsigned int session_id, unsigned int event_id, size_t num_rows, size_t num_cols) {
+  size_t len = frame_header(buf, MSG_CREATE, session_id, sizeof(create_request));
+
+  create_request request = {.event_id = event_id, .num_rows = num_rows, .num_cols = num_cols};
+  memcpy((char*)buf + len, &request, sizeof(create_request));
+  return len + sizeof(create_request);
+}
+
+size_t frame_reserve_size(size_t num_seats) {
+  return sizeof(core_request) + sizeof(reserve_request) + 2 * num_seats * sizeof(size_t);
+}
+
+size_t frame_reserve(void* buf, unsigned int session_id, unsigned int event_id, size_t num_seats, size_t* xs,
+                     size_t* ys) {
+  size_t len = frame_reserve_size(num_seats);
+  char* out = (char*)buf + frame_header(buf, MSG_RESERVE, session_id, len - sizeof(core_request));
+
+  reserve_request request = {.event_id = event_id, .num_seats = num_seats};
+  memcpy(out, &request, sizeof(reserve_request));
+  out += sizeof(reserve_request);
+
+  //Coordinate arrays follow the request, all xs then all ys
+  memcpy(out, xs, num_seats * sizeof(size_t));
+  out += num_seats * sizeof(size_t);
+  memcpy(out, ys, num_seats * sizeof(size_t));
+
+  return len;
+}
+
+size_t frame_cancel(void* buf, unsigned int session_id, unsigned int event_id, unsigned int reservation_id) {
+  size_t len = frame_header(buf, MSG_CANCEL, session_id, sizeof(cancel_request));
+
+  cancel_request request = {.event_id = event_id, .reservation_id = reservation_id};
+  memcpy((char*)buf + len, &request, sizeof(cancel_request));
+  return len + sizeof(cancel_request);
+}
+
+size_t frame_show(void* buf, unsigned int session_id, unsigned int event_id) {
+  size_t len = frame_header(buf, MSG_SHOW, session_id, sizeof(show_request));
+
+  show_request request = {.event_id = event_id};
+  memcpy((char*)buf + len, &request, sizeof(show_request));
+  return len + sizeof(show_request);
+}
+
+size_t frame_subscribe(void* buf, unsigned int session_id, unsigned int event_id, const char* notify_fifo_name) {
+  size_t len = frame_header(buf, MSG_SUBSCRIBE, session_id, sizeof(subscribe_request));
+
+  subscribe_request request = {.event_id = event_id};
+  strncpy(request.notify_fifo_name, notify_fifo_name, sizeof(request.notify_fifo_name));
+  memcpy((char*)buf + len, &request, sizeof(subscribe_request));
+  return len + sizeof(subscribe_request);
+}
+
+size_t frame_unsubscribe(void* buf, unsigned int session_id, unsigned int event_id) {
+  size_t len = frame_header(buf, MSG_UNSUBSCRIBE, session_id, sizeof(unsubscribe_request));
+
+  unsubscribe_request request = {.event_id = event_id};
+  memcpy((char*)buf + len, &request, sizeof(unsubscribe_request));
+  return len + sizeof(unsubscribe_request);
+}
+
+size_t frame_staleness(void* buf, unsigned int session_id, unsigned int max_staleness_ms) {
+  size_t len = frame_header(buf, MSG_STALENESS, session_id, sizeof(staleness_request));
+
+  staleness_request request = {.max_staleness_ms = max_staleness_ms};
+  memcpy((char*)buf + len, &request, sizeof(staleness_request));
+  return len + sizeof(staleness_request);
+}
+
+size_t frame_list_page(void* buf, unsigned int session_id, unsigned int from_id, unsigned int to_id,
+                       unsigned int page_size, unsigned int min_free_seats) {
+  size_t len = frame_header(buf, MSG_LIST_PAGE, session_id, sizeof(list_page_request));
+
+  list_page_request request = {
+      .from_id = from_id, .to_id = to_id, .page_size = page_size, .min_free_seats = min_free_seats};
+  memcpy((char*)buf + len, &request, sizeof(list_page_request));
+  return len + sizeof(list_page_request);
+}
+
+void frame_set_list_cursor(void* frame, unsigned int from_id) {
+  memcpy((char*)frame + sizeof(core_request) + offsetof(list_page_request, from_id), &from_id, sizeof(unsigned int));
+}
+
+size_t frame_stats_size(size_t num_events) {
+  return sizeof(core_request) + sizeof(stats_request) + num_events * sizeof(unsigned int);
+}
+
+size_t frame_stats(void* buf, unsigned int session_id, size_t num_events, const unsigned int* event_ids) {
+  size_t len = frame_stats_size(num_events);
+  char* out = (char*)buf + frame_header(buf, MSG_STATS, session_id, len - sizeof(core_request));
+
+  stats_request request = {.num_events = (unsigned int)num_events};
+  memcpy(out, &request, sizeof(stats_request));
+  memcpy(out + sizeof(stats_request), event_ids, num_events * sizeof(unsigned int));
+
+  return len;
+}
+
+size_t frame_seats(void* buf, unsigned int session_id, unsigned int event_id, unsigned int reservation_id) {
+  size_t len = frame_header(buf, MSG_SEATS, session_id, sizeof(seats_request));
+
+  seats_request request = {.event_id = event_id, .reservation_id = reservation_id};
+  memcpy((char*)buf + len, &request, sizeof(seats_request));
+  return len + sizeof(seats_request);
+}
+
+void frame_set_session(void* frame, unsigned int session_id) {
+  memcpy((char*)frame + offsetof(core_request, session_id), &session_id, sizeof(unsigned int));
+}
+
+void frame_set_request(void* frame, unsigned int request_id) {
+  memcpy((char*)frame + offsetof(core_request, request_id), &request_id, sizeof(unsigned int));
+}
+
+unsigned int frame_event_id(const void* frame) {
+  unsigned int event_id;
+  memcpy(&event_id, (const char*)frame + sizeof(core_request), sizeof(unsigned int));
+  return event_id;
+}
@@ -0,0 +1,67 @@
+#ifndef CLIENT_FRAME_H
+#define CLIENT_FRAME_H
+
+#include <stddef.h>
+
+/// Size of a buffer able to hold any frame except RESERVE frames.
+#define FRAME_FIXED_MAX_SIZE 64
+
+/// Builds the bytes of a request exactly as they are written to the request pipe.
+/// Every builder stores the frame in buf and returns its size. Frames start with a core_request header giving the
+/// size of the payload that follows, its request id is only set when the frame is sent.
+
+/// Builds a frame that carries only an opcode (MSG_QUIT, MSG_LIST).
+size_t frame_core(void* buf, char opcode, unsigned int session_id);
+
+/// Builds a MSG_CREATE frame.
+size_t frame_create(void* buf, unsigned int session_id, unsigned int event_id, size_t num_rows, size_t num_cols);
+
+/// Size of a MSG_RESERVE frame with num_seats seats.
+size_t frame_reserve_size(size_t num_seats);
+
+/// Builds a MSG_RESERVE frame. buf must hold frame_reserve_size(num_seats) bytes.
+size_t frame_reserve(void* buf, unsigned int session_id, unsigned int event_id, size_t num_seats, size_t* xs,
+                     size_t* ys);
+
+/// Builds a MSG_CANCEL frame.
+size_t frame_cancel(void* buf, unsigned int session_id, unsigned int event_id, unsigned int reservation_id);
+
+/// Builds a MSG_SHOW frame.
+size_t frame_show(void* buf, unsigned int session_id, unsigned int event_id);
+
+/// Builds a MSG_SUBSCRIBE frame.
+size_t frame_subscribe(void* buf, unsigned int session_id, unsigned int event_id, const char* notify_fifo_name);
+
+/// Builds a MSG_UNSUBSCRIBE frame.
+size_t frame_unsubscribe(void* buf, unsigned int session_id, unsigned int event_id);
+
+/// Builds a MSG_STALENESS frame.
+size_t frame_staleness(void* buf, unsigned int session_id, unsigned int max_staleness_ms);
+
+/// Builds a MSG_LIST_PAGE frame.
+size_t frame_list_page(void* buf, unsigned int session_id, unsigned int from_id, unsigned int to_id,
+                       unsigned int page_size, unsigned int min_free_seats);
+
+/// Moves the start of the range of an already built MSG_LIST_PAGE frame, used to fetch the following page.
+void frame_set_list_cursor(void* frame, unsigned int from_id);
+
+/// Size of a MSG_STATS frame asking for num_events events.
+size_t frame_stats_size(size_t num_events);
+
+/// Builds a MSG_STATS frame. buf must hold frame_stats_size(num_events) bytes.
+size_t frame_stats(void* buf, unsigned int session_id, size_t num_events, const unsigned int* event_ids);
+
+/// Builds a MSG_SEATS frame.
+size_t frame_seats(void* buf, unsigned int session_id, unsigned int event_id, unsigned int reservation_id);
+
+/// Sets the session id of an already built frame.
+void frame_set_session(void* frame, unsigned int session_id);
+
+/// Sets the request id of an already built frame, echoed by the response to it.
+void frame_set_request(void* frame, unsigned int request_id);
+
+/// Gets the event id of an already built frame.
+/// Every frame except MSG_QUIT, MSG_LIST, MSG_LIST_PAGE and MSG_STATS starts with it.
+unsigned int frame_event_id(const void* frame);
+
+#endif  // CLIENT_FRAME_H
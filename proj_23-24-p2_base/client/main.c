@@ -1,76 +1,133 @@
+#include <dirent.h>
 #include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "api.h"
 #include "common/constants.h"
+#include "common/io.h"
+#include "compiled.h"
 #include "parser.h"
-/**
- * The main function of the client program.
- * It takes command line arguments and performs various operations based on the commands received.
- * The program communicates with a server using named pipes.
- * 
- * @param argc The number of command line arguments.
- * @param argv An array of strings containing the command line arguments.
- *             The expected arguments are:
- *               - <request pipe path>: The path to the named pipe used for sending requests to the server.
- *               - <response pipe path>: The path to the named pipe used for receiving responses from the server.
- *               - <server pipe path>: The path to the named pipe used for communicating with the server.
- *               - <.jobs file path>: The path to the input file containing commands to be executed.
- * 
- * @return 0 if the program executed successfully, 1 otherwise.
- */
-int main(int argc, char* argv[]) {
-  // Check if the required number of command line arguments is provided
-  if (argc < 5) {
-    fprintf(stderr, "Usage: %s <request pipe path> <response pipe path> <server pipe path> <.jobs file path>\n",
-            argv[0]);
-    return 1;
-  }
 
-  // Set up the Event Management System (EMS) by connecting to the server
-  if (ems_setup(argv[1], argv[2], argv[3])) {
-    fprintf(stderr, "Failed to set up EMS\n");
-    return 1;
-  }
+/// Work shared by all client threads.
+struct ClientPool {
+  const char* req_pipe_path;     /// Base path of the request pipes.
+  const char* resp_pipe_path;    /// Base path of the response pipes.
+  const char* server_pipe_path;  /// Path of the server registration pipe.
+  unsigned int thread_count;     /// Number of threads in the pool.
 
-  // Validate the provided .jobs file path
-  const char* dot = strrchr(argv[4], '.');
-  if (dot == NULL || dot == argv[4] || strlen(dot) != 5 || strcmp(dot, ".jobs") ||
-      strlen(argv[4]) > MAX_JOB_FILE_NAME_SIZE) {
-    fprintf(stderr, "The provided .jobs file path is not valid. Path: %s\n", argv[1]);
-    return 1;
-  }
+  const char* replica_pipe_paths[MAX_CLIENT_REPLICAS];  /// Registration pipes of the read replicas.
+  unsigned int replica_count;                           /// Number of read replicas, 0 to read from the server.
+  unsigned int max_staleness_ms;                        /// Staleness bound of the replica sessions.
 
-  // Generate the output file path by replacing the extension of the input file with ".out"
-  char out_path[MAX_JOB_FILE_NAME_SIZE];
-  strcpy(out_path, argv[4]);
-  strcpy(strrchr(out_path, '.'), ".out");
+  const char* jobs_path;       /// Single .jobs file split by thread id, NULL in directory mode.
+  pthread_barrier_t barrier;   /// Barrier used by BARRIER commands when splitting a single file.
 
-  // Open the input file for reading
-  int in_fd = open(argv[4], O_RDONLY);
-  if (in_fd == -1) {
-    fprintf(stderr, "Failed to open input file. Path: %s\n", argv[4]);
-    return 1;
+  char** files;               /// .jobs files of the directory, in directory mode.
+  size_t file_count;          /// Number of entries in files.
+  size_t next_file;           /// Next file to be picked by an idle thread.
+  pthread_mutex_t file_mutex; /// Protects next_file.
+};
+
+/// Arguments of a client thread.
+struct ClientThread {
+  struct ClientPool* pool;  /// Pool the thread belongs to.
+  unsigned int thread_id;   /// Id of the thread, from 0 to thread_count - 1.
+  pthread_t tid;            /// Thread handle.
+  int result;               /// 0 if every job ran, 1 otherwise.
+};
+
+/// Checks that a path names a .jobs file.
+/// @param path Path to check.
+/// @return 1 if the path is a valid .jobs path, 0 otherwise.
+static int is_jobs_path(const char* path) {
+  const char* dot = strrchr(path, '.');
+  return dot != NULL && dot != path && strlen(dot) == 5 && strcmp(dot, ".jobs") == 0 &&
+         strlen(path) < MAX_JOB_FILE_NAME_SIZE;
+}
+
+/// Checks that a path names a compiled jobs file.
+/// @param path Path to check.
+/// @return 1 if the path is a valid compiled jobs path, 0 otherwise.
+static int is_compiled_path(const char* path) {
+  const char* dot = strrchr(path, '.');
+  return dot != NULL && dot != path && strcmp(dot, COMPILED_EXTENSION) == 0 && strlen(path) < MAX_JOB_FILE_NAME_SIZE;
+}
+
+/// Builds the output path of a .jobs file, with an optional thread suffix.
+/// @param jobs_path Path of the .jobs file.
+/// @param thread_id Thread suffix to add, or -1 for none.
+/// @param out_path Buffer of MAX_JOB_FILE_NAME_SIZE + 16 bytes to store the result in.
+static void build_out_path(const char* jobs_path, int thread_id, char* out_path) {
+  strcpy(out_path, jobs_path);
+  char* dot = strrchr(out_path, '.');
+  if (thread_id < 0) {
+    strcpy(dot, ".out");
+  } else {
+    sprintf(dot, "-%d.out", thread_id);
   }
+}
 
-  // Open the output file for writing
-  int out_fd = open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
-  if (out_fd == -1) {
-    fprintf(stderr, "Failed to open output file. Path: %s\n", out_path);
-    return 1;
+/// Sleeps for the given number of milliseconds.
+static void sleep_ms(unsigned int delay) {
+  struct timespec ts = {delay / 1000, (long)(delay % 1000) * 1000000};
+  nanosleep(&ts, NULL);
+}
+
+/// Prints a seat change received from the server.
+/// @param arg Pointer to the file descriptor to print to.
+static void print_update(const struct ems_update* update, void* arg) {
+  char buff[128];
+  if (update->resync) {
+    snprintf(buff, sizeof(buff), "Updates dropped, resync\n");
+  } else {
+    snprintf(buff, sizeof(buff), "Event %u: seat (%zu,%zu) -> %u\n", update->event_id, update->row, update->col,
+             update->reservation_id);
   }
+  print_str(*(int*)arg, buff);
+}
+
+/// Runs the commands of a .jobs file over the calling thread's session.
+/// Commands are split round-robin between thread_count threads; WAIT and BARRIER are seen by all of them.
+/// @param in_fd File descriptor of the .jobs file.
+/// @param out_fd File descriptor to write SHOW and LIST output to.
+/// @param thread_id Id of the calling thread.
+/// @param thread_count Number of threads running the same file.
+/// @param barrier Barrier shared by those threads, NULL if thread_count is 1.
+static void run_jobs(int in_fd, int out_fd, unsigned int thread_id, unsigned int thread_count,
+                     pthread_barrier_t* barrier) {
+  size_t command_index = 0;
+  size_t* xs = NULL;
+  size_t* ys = NULL;
+  size_t coords_capacity = 0;
 
   // Process commands from the input file until the end of file is reached
   while (1) {
-    unsigned int event_id;
-    size_t num_rows, num_columns, num_coords;
-    unsigned int delay = 0;
-    size_t xs[MAX_RESERVATION_SIZE], ys[MAX_RESERVATION_SIZE];
+    unsigned int event_id, reservation_id;
+    size_t num_rows, num_columns, num_coords, num_events;
+    unsigned int delay = 0, wait_thread = 0;
+    unsigned int from_id, to_id, min_free_seats;
+    unsigned int event_ids[STATS_MAX_EVENTS];
+    int mine, has_thread;
 
     // Get the next command from the input file
-    switch (get_next(in_fd)) {
+    enum Command cmd = get_next(in_fd);
+
+    // Commands are numbered in file order, each thread runs its share of them
+    if (cmd == CMD_CREATE || cmd == CMD_RESERVE || cmd == CMD_CANCEL || cmd == CMD_SHOW || cmd == CMD_LIST_EVENTS ||
+        cmd == CMD_LIST_RANGE || cmd == CMD_STATS || cmd == CMD_SEATS) {
+      mine = command_index++ % thread_count == thread_id;
+    } else {
+      mine = 1;
+    }
+
+    switch (cmd) {
       case CMD_CREATE:
         // Parse the CREATE command and execute it
         if (parse_create(in_fd, &event_id, &num_rows, &num_columns) != 0) {
@@ -78,19 +135,29 @@ int main(int argc, char* argv[]) {
           continue;
         }
 
-        if (ems_create(event_id, num_rows, num_columns)) fprintf(stderr, "Failed to create event\n");
+        if (mine && ems_create(event_id, num_rows, num_columns)) fprintf(stderr, "Failed to create event\n");
         break;
 
       case CMD_RESERVE:
         // Parse the RESERVE command and execute it
-        num_coords = parse_reserve(in_fd, MAX_RESERVATION_SIZE, &event_id, xs, ys);
+        num_coords = parse_reserve(in_fd, &event_id, &xs, &ys, &coords_capacity);
 
         if (num_coords == 0) {
           fprintf(stderr, "Invalid command. See HELP for usage\n");
           continue;
         }
 
-        if (ems_reserve(event_id, num_coords, xs, ys)) fprintf(stderr, "Failed to reserve seats\n");
+        if (mine && ems_reserve(event_id, num_coords, xs, ys)) fprintf(stderr, "Failed to reserve seats\n");
+        break;
+
+      case CMD_CANCEL:
+        // Parse the CANCEL command and execute it
+        if (parse_cancel(in_fd, &event_id, &reservation_id) != 0) {
+          fprintf(stderr, "Invalid command. See HELP for usage\n");
+          continue;
+        }
+
+        if (mine && ems_cancel(event_id, reservation_id)) fprintf(stderr, "Failed to cancel reservation\n");
         break;
 
       case CMD_SHOW:
@@ -100,27 +167,89 @@ int main(int argc, char* argv[]) {
           continue;
         }
 
-        if (ems_show(out_fd, event_id)) fprintf(stderr, "Failed to show event\n");
+        if (mine && ems_show(out_fd, event_id)) fprintf(stderr, "Failed to show event\n");
         break;
 
       case CMD_LIST_EVENTS:
         // Execute the LIST command
-        if (ems_list_events(out_fd)) fprintf(stderr, "Failed to list events\n");
+        if (mine && ems_list_events(out_fd)) fprintf(stderr, "Failed to list events\n");
+        break;
+
+      case CMD_LIST_RANGE:
+        // Parse the ranged LIST command and execute it
+        if (parse_list_range(in_fd, &from_id, &to_id, &min_free_seats) != 0) {
+          fprintf(stderr, "Invalid command. See HELP for usage\n");
+          continue;
+        }
+
+        if (mine && ems_list_range(out_fd, from_id, to_id, min_free_seats)) fprintf(stderr, "Failed to list events\n");
+        break;
+
+      case CMD_STATS:
+        // Parse the STATS command and execute it
+        num_events = parse_stats(in_fd, STATS_MAX_EVENTS, event_ids);
+        if (num_events == 0) {
+          fprintf(stderr, "Invalid command. See HELP for usage\n");
+          continue;
+        }
+
+        if (mine && ems_stats(out_fd, num_events, event_ids)) fprintf(stderr, "Failed to get event stats\n");
+        break;
+
+      case CMD_SEATS:
+        // Parse the SEATS command and execute it
+        if (parse_cancel(in_fd, &event_id, &reservation_id) != 0) {
+          fprintf(stderr, "Invalid command. See HELP for usage\n");
+          continue;
+        }
+
+        if (mine && ems_seats(out_fd, event_id, reservation_id)) fprintf(stderr, "Failed to get reservation seats\n");
         break;
 
       case CMD_WAIT:
-        // Parse the WAIT command and execute it
-        if (parse_wait(in_fd, &delay, NULL) == -1) {
-            fprintf(stderr, "Invalid command. See HELP for usage\n");
-            continue;
+        // Parse the WAIT command and execute it, either on every thread or only on the given one
+        has_thread = parse_wait(in_fd, &delay, &wait_thread);
+        if (has_thread == -1) {
+          fprintf(stderr, "Invalid command. See HELP for usage\n");
+          continue;
         }
 
-        if (delay > 0) {
-            printf("Waiting...\n");
-            sleep(delay);
+        if (delay > 0 && (!has_thread || wait_thread == thread_id)) {
+          printf("Waiting...\n");
+          sleep_ms(delay);
         }
         break;
 
+      case CMD_BARRIER:
+        // Wait for every thread running this file to reach the barrier
+        if (barrier != NULL) pthread_barrier_wait(barrier);
+        break;
+
+      case CMD_SUBSCRIBE:
+        // Parse the SUBSCRIBE command and execute it, on every thread's session
+        if (parse_show(in_fd, &event_id) != 0) {
+          fprintf(stderr, "Invalid command. See HELP for usage\n");
+          continue;
+        }
+
+        if (ems_subscribe(event_id)) fprintf(stderr, "Failed to subscribe to event\n");
+        break;
+
+      case CMD_UNSUBSCRIBE:
+        // Parse the UNSUBSCRIBE command and execute it, on every thread's session
+        if (parse_show(in_fd, &event_id) != 0) {
+          fprintf(stderr, "Invalid command. See HELP for usage\n");
+          continue;
+        }
+
+        if (ems_unsubscribe(event_id)) fprintf(stderr, "Failed to unsubscribe from event\n");
+        break;
+
+      case CMD_UPDATES:
+        // Print the seat changes received so far
+        if (ems_poll_updates(print_update, &out_fd) == -1) fprintf(stderr, "Failed to read updates\n");
+        break;
+
       case CMD_INVALID:
         fprintf(stderr, "Invalid command. See HELP for usage\n");
         break;
@@ -131,9 +260,16 @@ int main(int argc, char* argv[]) {
             "Available commands:\n"
             "  CREATE <event_id> <num_rows> <num_columns>\n"
             "  RESERVE <event_id> [(<x1>,<y1>) (<x2>,<y2>) ...]\n"
+            "  CANCEL <event_id> <reservation_id>\n"
             "  SHOW <event_id>\n"
-            "  LIST\n"
-            "  WAIT <delay_ms>\n"
+            "  STATS <event_id> [<event_id> ...]\n"
+            "  SEATS <event_id> <reservation_id>\n"
+            "  LIST [<from_id> <to_id> [min_free_seats]]\n"
+            "  WAIT <delay_ms> [thread_id]\n"
+            "  BARRIER\n"
+            "  SUBSCRIBE <event_id>\n"
+            "  UNSUBSCRIBE <event_id>\n"
+            "  UPDATES\n"
             "  HELP\n");
 
         break;
@@ -142,11 +278,349 @@ int main(int argc, char* argv[]) {
         break;
 
       case EOC:
-        // Close the input and output files, and quit the EMS
-        close(in_fd);
-        close(out_fd);
-        ems_quit();
-        return 0;
+        free(xs);
+        free(ys);
+        return;
+    }
+  }
+}
+
+/// Runs a .jobs file, writing its output next to it.
+/// @param jobs_path Path of the .jobs file.
+/// @param thread_id Id of the calling thread.
+/// @param thread_count Number of threads splitting the file, 1 if the file is run whole.
+/// @param barrier Barrier shared by the splitting threads, NULL if thread_count is 1.
+/// @return 0 if the file was run, 1 otherwise.
+static int run_jobs_file(const char* jobs_path, unsigned int thread_id, unsigned int thread_count,
+                         pthread_barrier_t* barrier) {
+  // Generate the output file path by replacing the extension of the input file with ".out"
+  char out_path[MAX_JOB_FILE_NAME_SIZE + 16];
+  build_out_path(jobs_path, thread_count > 1 ? (int)thread_id : -1, out_path);
+
+  // Open the output file for writing
+  int out_fd = open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (out_fd == -1) {
+    fprintf(stderr, "Failed to open output file. Path: %s\n", out_path);
+    return 1;
+  }
+
+  // Compiled files are replayed from memory, without parsing
+  if (is_compiled_path(jobs_path)) {
+    int ret = replay_compiled(jobs_path, out_fd, thread_id, thread_count, barrier);
+    close(out_fd);
+    return ret;
+  }
+
+  // Open the input file for reading
+  int in_fd = open(jobs_path, O_RDONLY);
+  if (in_fd == -1) {
+    fprintf(stderr, "Failed to open input file. Path: %s\n", jobs_path);
+    close(out_fd);
+    return 1;
+  }
+
+  run_jobs(in_fd, out_fd, thread_id, thread_count, barrier);
+
+  // Close the input and output files
+  close(in_fd);
+  close(out_fd);
+  return 0;
+}
+
+/// Main function of a client thread: opens a session and runs its share of the jobs over it.
+static void* client_thread_main(void* arg) {
+  struct ClientThread* self = (struct ClientThread*)arg;
+  struct ClientPool* pool = self->pool;
+
+  // Each thread gets its own pair of pipes, suffixed by its id when there are several
+  char req_path[PATH_MAX], resp_path[PATH_MAX];
+  if (pool->thread_count > 1) {
+    snprintf(req_path, PATH_MAX, "%s.%u", pool->req_pipe_path, self->thread_id);
+    snprintf(resp_path, PATH_MAX, "%s.%u", pool->resp_pipe_path, self->thread_id);
+  } else {
+    snprintf(req_path, PATH_MAX, "%s", pool->req_pipe_path);
+    snprintf(resp_path, PATH_MAX, "%s", pool->resp_pipe_path);
+  }
+
+  // Set up the Event Management System (EMS) by connecting to the server
+  if (ems_setup(req_path, resp_path, pool->server_pipe_path)) {
+    fprintf(stderr, "Failed to set up EMS\n");
+    self->result = 1;
+    // Do not leave the other threads stuck on a BARRIER
+    if (pool->jobs_path != NULL && pool->thread_count > 1) {
+      fprintf(stderr, "Thread %u could not connect, aborting\n", self->thread_id);
+      exit(1);
+    }
+    return NULL;
+  }
+
+  // Threads are spread over the replicas, reading from the server if theirs is unavailable
+  if (pool->replica_count > 0) {
+    char replica_req_path[PATH_MAX + 2], replica_resp_path[PATH_MAX + 2];
+    snprintf(replica_req_path, sizeof(replica_req_path), "%s.r", req_path);
+    snprintf(replica_resp_path, sizeof(replica_resp_path), "%s.r", resp_path);
+    const char* replica_path = pool->replica_pipe_paths[self->thread_id % pool->replica_count];
+    if (ems_setup_replica(replica_req_path, replica_resp_path, replica_path, pool->max_staleness_ms)) {
+      fprintf(stderr, "Failed to connect to replica %s, reading from the server\n", replica_path);
+    }
+  }
+
+  self->result = 0;
+  if (pool->jobs_path != NULL) {
+    // Single file split between all threads
+    self->result = run_jobs_file(pool->jobs_path, self->thread_id, pool->thread_count,
+                                 pool->thread_count > 1 ? &pool->barrier : NULL);
+  } else {
+    // Directory: every idle thread picks the next file and runs it whole
+    while (1) {
+      pthread_mutex_lock(&pool->file_mutex);
+      size_t next = pool->next_file++;
+      pthread_mutex_unlock(&pool->file_mutex);
+
+      if (next >= pool->file_count) break;
+      if (run_jobs_file(pool->files[next], 0, 1, NULL)) self->result = 1;
+    }
+  }
+
+  ems_quit();
+  return NULL;
+}
+
+/// Compiles a .jobs file into a .bjobs file next to it.
+/// @param jobs_path Path of the .jobs file.
+/// @return 0 if the file was compiled, 1 otherwise.
+static int compile_main(const char* jobs_path) {
+  if (!is_jobs_path(jobs_path)) {
+    fprintf(stderr, "The provided .jobs file path is not valid. Path: %s\n", jobs_path);
+    return 1;
+  }
+
+  // Same name, compiled extension
+  char out_path[MAX_JOB_FILE_NAME_SIZE + 16];
+  strcpy(out_path, jobs_path);
+  strcpy(strrchr(out_path, '.'), COMPILED_EXTENSION);
+
+  int in_fd = open(jobs_path, O_RDONLY);
+  if (in_fd == -1) {
+    fprintf(stderr, "Failed to open input file. Path: %s\n", jobs_path);
+    return 1;
+  }
+
+  int out_fd = open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (out_fd == -1) {
+    fprintf(stderr, "Failed to open output file. Path: %s\n", out_path);
+    close(in_fd);
+    return 1;
+  }
+
+  int ret = compile_jobs(in_fd, out_fd);
+  close(in_fd);
+  close(out_fd);
+  return ret;
+}
+
+/// Orders jobs paths by name without the extension, so a .jobs file and its .bjobs end up next to each other.
+static int compare_stems(const void* a, const void* b) {
+  const char* path_a = *(char* const*)a;
+  const char* path_b = *(char* const*)b;
+  size_t len_a = (size_t)(strrchr(path_a, '.') - path_a);
+  size_t len_b = (size_t)(strrchr(path_b, '.') - path_b);
+
+  int cmp = strncmp(path_a, path_b, len_a < len_b ? len_a : len_b);
+  if (cmp != 0) return cmp;
+  return len_a < len_b ? -1 : len_a > len_b;
+}
+
+/// Picks which of a .jobs file and its .bjobs to run: the compiled one, unless the source changed after it.
+/// @return Path to run, the other one is skipped.
+static char* pick_jobs_file(char* path_a, char* path_b) {
+  char* compiled = is_compiled_path(path_a) ? path_a : path_b;
+  char* source = compiled == path_a ? path_b : path_a;
+
+  struct stat compiled_st, source_st;
+  if (stat(compiled, &compiled_st) != 0 || stat(source, &source_st) != 0) return source;
+  if (source_st.st_mtim.tv_sec != compiled_st.st_mtim.tv_sec) {
+    return source_st.st_mtim.tv_sec > compiled_st.st_mtim.tv_sec ? source : compiled;
+  }
+  return source_st.st_mtim.tv_nsec > compiled_st.st_mtim.tv_nsec ? source : compiled;
+}
+
+/// Collects the .jobs files of a directory into the pool.
+/// A .jobs file and its .bjobs write the same output file, so only one of them is kept, see pick_jobs_file.
+/// @return 0 if the directory was read, 1 otherwise.
+static int load_jobs_dir(struct ClientPool* pool, const char* dir_path) {
+  DIR* dir = opendir(dir_path);
+  if (dir == NULL) {
+    fprintf(stderr, "Failed to open jobs directory. Path: %s\n", dir_path);
+    return 1;
+  }
+
+  size_t capacity = 0;
+  struct dirent* entry;
+  while ((entry = readdir(dir)) != NULL) {
+    char path[PATH_MAX];
+    snprintf(path, PATH_MAX, "%s/%s", dir_path, entry->d_name);
+    if (!is_jobs_path(path) && !is_compiled_path(path)) continue;
+
+    if (pool->file_count == capacity) {
+      capacity = capacity ? capacity * 2 : 16;
+      char** files = realloc(pool->files, capacity * sizeof(char*));
+      if (files == NULL) {
+        closedir(dir);
+        return 1;
+      }
+      pool->files = files;
     }
+
+    pool->files[pool->file_count] = strdup(path);
+    if (pool->files[pool->file_count] == NULL) {
+      closedir(dir);
+      return 1;
+    }
+    pool->file_count++;
+  }
+  closedir(dir);
+
+  //Both files of a stem are adjacent once sorted
+  if (pool->file_count > 0) qsort(pool->files, pool->file_count, sizeof(char*), compare_stems);
+  size_t kept = 0;
+  for (size_t i = 0; i < pool->file_count; i++) {
+    if (kept > 0 && compare_stems(&pool->files[kept - 1], &pool->files[i]) == 0) {
+      char* run = pick_jobs_file(pool->files[kept - 1], pool->files[i]);
+      free(run == pool->files[i] ? pool->files[kept - 1] : pool->files[i]);
+      pool->files[kept - 1] = run;
+      continue;
+    }
+    pool->files[kept++] = pool->files[i];
   }
+  pool->file_count = kept;
+
+  return 0;
+}
+
+/**
+ * The main function of the client program.
+ * It takes command line arguments and performs various operations based on the commands received.
+ * The program communicates with a server using named pipes, over one session per thread.
+ *
+ * @param argc The number of command line arguments.
+ * @param argv An array of strings containing the command line arguments.
+ *             The expected arguments are:
+ *               - [-r replica pipe path]: Registration pipe of a read replica answering SHOW and LIST, may be
+ *                 given several times to spread the threads over several replicas.
+ *               - [-s max staleness ms]: How far behind the server replicas may be when answering.
+ *               - <request pipe path>: The path to the named pipe used for sending requests to the server.
+ *               - <response pipe path>: The path to the named pipe used for receiving responses from the server.
+ *               - <server pipe path>: The path to the named pipe used for communicating with the server, or
+ *                 the comma separated pipes of a cluster partitioned by event id, in partition order.
+ *               - <.jobs file path | directory>: The input file containing commands to be executed, or a
+ *                 directory whose .jobs files are all executed.
+ *               - [threads]: Number of threads (and sessions). A single file is split between them by
+ *                 command, a directory is spread between them by file. Defaults to 1, at most MAX_SESSION_COUNT.
+ *             Alternatively, "compile <.jobs file path>" compiles the file into a .bjobs file next to it,
+ *             which can then be given in place of any .jobs file.
+ *
+ * @return 0 if the program executed successfully, 1 otherwise.
+ */
+int main(int argc, char* argv[]) {
+  if (argc == 3 && strcmp(argv[1], "compile") == 0) {
+    return compile_main(argv[2]);
+  }
+
+  struct ClientPool pool = {.thread_count = 1,
+                            .replica_count = 0,
+                            .max_staleness_ms = REPLICA_MAX_STALENESS_MS,
+                            .jobs_path = NULL,
+                            .files = NULL,
+                            .file_count = 0,
+                            .next_file = 0};
+
+  // Parse the replica options
+  int opt;
+  while ((opt = getopt(argc, argv, "r:s:")) != -1) {
+    if (opt == 'r') {
+      if (pool.replica_count == MAX_CLIENT_REPLICAS) {
+        fprintf(stderr, "At most %d replicas can be given\n", MAX_CLIENT_REPLICAS);
+        return 1;
+      }
+      pool.replica_pipe_paths[pool.replica_count++] = optarg;
+    } else if (opt == 's') {
+      char* endptr;
+      unsigned long staleness = strtoul(optarg, &endptr, 10);
+      if (*endptr != '\0' || staleness > UINT_MAX) {
+        fprintf(stderr, "Invalid staleness bound: %s\n", optarg);
+        return 1;
+      }
+      pool.max_staleness_ms = (unsigned int)staleness;
+    } else {
+      return 1;
+    }
+  }
+  // Positional arguments keep their indices, after the program name
+  const char* program = argv[0];
+  argc -= optind - 1;
+  argv += optind - 1;
+
+  // Check if the required number of command line arguments is provided
+  if (argc < 5 || argc > 6) {
+    fprintf(stderr,
+            "Usage: %s [-r replica pipe path]... [-s max staleness ms] <request pipe path> <response pipe path> "
+            "<server pipe path[,...]> <.jobs file path | directory> [threads]\n"
+            "       %s compile <.jobs file path>\n",
+            program, program);
+    return 1;
+  }
+
+  pool.req_pipe_path = argv[1];
+  pool.resp_pipe_path = argv[2];
+  pool.server_pipe_path = argv[3];
+
+  // Parse the thread count. A server serves MAX_SESSION_COUNT sessions at once and a thread keeps its session until
+  // it is done, so threads past that would only be turned away while the others wait for them at a BARRIER
+  if (argc == 6) {
+    char* endptr;
+    unsigned long threads = strtoul(argv[5], &endptr, 10);
+    if (*endptr != '\0' || threads == 0 || threads > MAX_SESSION_COUNT) {
+      fprintf(stderr, "Thread count must be between 1 and %d\n", MAX_SESSION_COUNT);
+      return 1;
+    }
+    pool.thread_count = (unsigned int)threads;
+  }
+
+  // Validate the provided .jobs file path or collect the files of the directory
+  struct stat st;
+  if (stat(argv[4], &st) == 0 && S_ISDIR(st.st_mode)) {
+    if (load_jobs_dir(&pool, argv[4])) return 1;
+    if (pool.thread_count > pool.file_count && pool.file_count > 0) pool.thread_count = (unsigned int)pool.file_count;
+  } else if (is_jobs_path(argv[4]) || is_compiled_path(argv[4])) {
+    pool.jobs_path = argv[4];
+  } else {
+    fprintf(stderr, "The provided .jobs file path is not valid. Path: %s\n", argv[4]);
+    return 1;
+  }
+
+  pthread_barrier_init(&pool.barrier, NULL, pool.thread_count);
+  pthread_mutex_init(&pool.file_mutex, NULL);
+
+  // Launch one thread per session and wait for all of them
+  struct ClientThread threads[MAX_SESSION_COUNT];
+  for (unsigned int i = 0; i < pool.thread_count; i++) {
+    threads[i] = (struct ClientThread){.pool = &pool, .thread_id = i, .result = 1};
+    if (pthread_create(&threads[i].tid, NULL, client_thread_main, &threads[i]) != 0) {
+      fprintf(stderr, "Failed to create client thread\n");
+      return 1;
+    }
+  }
+
+  int result = 0;
+  for (unsigned int i = 0; i < pool.thread_count; i++) {
+    pthread_join(threads[i].tid, NULL);
+    result |= threads[i].result;
+  }
+
+  pthread_barrier_destroy(&pool.barrier);
+  pthread_mutex_destroy(&pool.file_mutex);
+  for (size_t i = 0; i < pool.file_count; i++) free(pool.files[i]);
+  free(pool.files);
+  return result;
 }
@@ -3,11 +3,14 @@
 #include <limits.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/types.h>
 #include <unistd.h>
 
 #include "common/constants.h"
 #include "common/io.h"
 
+#define LINE_PADDING 16  // Zeros after a line read in memory, so vector scans may read past its end
+
 static void cleanup(int fd) {
   char ch;
   while (read(fd, &ch, 1) == 1 && ch != '\n')
@@ -22,12 +25,21 @@ enum Command get_next(int fd) {
 
   switch (buf[0]) {
     case 'C':
-      if (read(fd, buf + 1, 6) != 6 || strncmp(buf, "CREATE ", 7) != 0) {
+      if (read(fd, buf + 1, 6) != 6) {
         cleanup(fd);
         return CMD_INVALID;
       }
 
-      return CMD_CREATE;
+      if (strncmp(buf, "CREATE ", 7) == 0) {
+        return CMD_CREATE;
+      }
+
+      if (strncmp(buf, "CANCEL ", 7) == 0) {
+        return CMD_CANCEL;
+      }
+
+      cleanup(fd);
+      return CMD_INVALID;
 
     case 'R':
       if (read(fd, buf + 1, 7) != 7 || strncmp(buf, "RESERVE ", 8) != 0) {
@@ -38,12 +50,61 @@ enum Command get_next(int fd) {
       return CMD_RESERVE;
 
     case 'S':
-      if (read(fd, buf + 1, 4) != 4 || strncmp(buf, "SHOW ", 5) != 0) {
+      if (read(fd, buf + 1, 4) != 4) {
         cleanup(fd);
         return CMD_INVALID;
       }
 
-      return CMD_SHOW;
+      if (strncmp(buf, "SHOW ", 5) == 0) {
+        return CMD_SHOW;
+      }
+
+      if (strncmp(buf, "STATS", 5) == 0) {
+        if (read(fd, buf + 5, 1) != 1 || buf[5] != ' ') {
+          cleanup(fd);
+          return CMD_INVALID;
+        }
+
+        return CMD_STATS;
+      }
+
+      if (strncmp(buf, "SEATS", 5) == 0) {
+        if (read(fd, buf + 5, 1) != 1 || buf[5] != ' ') {
+          cleanup(fd);
+          return CMD_INVALID;
+        }
+
+        return CMD_SEATS;
+      }
+
+      if (read(fd, buf + 5, 5) != 5 || strncmp(buf, "SUBSCRIBE ", 10) != 0) {
+        cleanup(fd);
+        return CMD_INVALID;
+      }
+
+      return CMD_SUBSCRIBE;
+
+    case 'U':
+      if (read(fd, buf + 1, 6) != 6) {
+        cleanup(fd);
+        return CMD_INVALID;
+      }
+
+      if (strncmp(buf, "UPDATES", 7) == 0) {
+        if (read(fd, buf + 7, 1) == 1 && buf[7] != '\n') {
+          cleanup(fd);
+          return CMD_INVALID;
+        }
+
+        return CMD_UPDATES;
+      }
+
+      if (read(fd, buf + 7, 5) != 5 || strncmp(buf, "UNSUBSCRIBE ", 12) != 0) {
+        cleanup(fd);
+        return CMD_INVALID;
+      }
+
+      return CMD_UNSUBSCRIBE;
 
     case 'L':
       if (read(fd, buf + 1, 3) != 3 || strncmp(buf, "LIST", 4) != 0) {
@@ -51,7 +112,11 @@ enum Command get_next(int fd) {
         return CMD_INVALID;
       }
 
-      if (read(fd, buf + 4, 1) != 0 && buf[4] != '\n') {
+      if (read(fd, buf + 4, 1) == 1 && buf[4] != '\n') {
+        if (buf[4] == ' ') {
+          return CMD_LIST_RANGE;
+        }
+
         cleanup(fd);
         return CMD_INVALID;
       }
@@ -66,13 +131,26 @@ enum Command get_next(int fd) {
 
       return CMD_WAIT;
 
+    case 'B':
+      if (read(fd, buf + 1, 6) != 6 || strncmp(buf, "BARRIER", 7) != 0) {
+        cleanup(fd);
+        return CMD_INVALID;
+      }
+
+      if (read(fd, buf + 7, 1) == 1 && buf[7] != '\n') {
+        cleanup(fd);
+        return CMD_INVALID;
+      }
+
+      return CMD_BARRIER;
+
     case 'H':
       if (read(fd, buf + 1, 3) != 3 || strncmp(buf, "HELP", 4) != 0) {
         cleanup(fd);
         return CMD_INVALID;
       }
 
-      if (read(fd, buf + 4, 1) != 0 && buf[4] != '\n') {
+      if (read(fd, buf + 4, 1) == 1 && buf[4] != '\n') {
         cleanup(fd);
         return CMD_INVALID;
       }
@@ -117,65 +195,141 @@ int parse_create(int fd, unsigned int *event_id, size_t *num_rows, size_t *num_c
   return 0;
 }
 
-size_t parse_reserve(int fd, size_t max, unsigned int *event_id, size_t *xs, size_t *ys) {
-  char ch;
+/// Reads the rest of a line in blocks of RESERVE_READ_BLOCK bytes, giving back whatever was read past it.
+/// Files that cannot seek, like pipes, are read a byte at a time instead, so nothing past the line is consumed.
+/// @param fd File descriptor to read from.
+/// @param line Buffer of *capacity bytes, replaced with a larger one from malloc if the line does not fit.
+/// @param capacity Pointer to the size of the buffer.
+/// @param len Pointer to the variable to store the length of the line in, without its newline.
+/// @param stack The buffer *line starts as, never freed.
+/// @return 0 if the line was read, 1 otherwise. The line is followed by LINE_PADDING zeros.
+static int read_line(int fd, char **line, size_t *capacity, size_t *len, const char *stack) {
+  int seekable = lseek(fd, 0, SEEK_CUR) != -1;
+  size_t used = 0;
+
+  while (1) {
+    size_t block = seekable ? RESERVE_READ_BLOCK : 1;
+    if (*capacity - used < block + LINE_PADDING) {
+      size_t grown = *capacity * 2;
+      char *bigger = *line == stack ? malloc(grown) : realloc(*line, grown);
+      if (bigger == NULL) return 1;
+
+      if (*line == stack) memcpy(bigger, stack, used);
+      *line = bigger;
+      *capacity = grown;
+    }
 
-  if (parse_uint(fd, event_id, &ch) != 0 || ch != ' ') {
-    cleanup(fd);
-    return 0;
+    //Fill whatever room there is, the newline is usually found in the first block
+    ssize_t read_bytes = read(fd, *line + used, seekable ? *capacity - used - LINE_PADDING : 1);
+    if (read_bytes == -1) return 1;
+    if (read_bytes == 0) break;
+
+    char *newline = memchr(*line + used, '\n', (size_t)read_bytes);
+    if (newline != NULL) {
+      size_t past = used + (size_t)read_bytes - (size_t)(newline - *line) - 1;
+      if (past > 0 && lseek(fd, -(off_t)past, SEEK_CUR) == -1) return 1;
+
+      used = (size_t)(newline - *line);
+      break;
+    }
+    used += (size_t)read_bytes;
   }
 
-  if (read(fd, &ch, 1) != 1 || ch != '[') {
-    cleanup(fd);
-    return 0;
+  *len = used;
+  memset(*line + used, 0, LINE_PADDING);
+  return 0;
+}
+
+/// Parses the coordinates of a RESERVE line, "[(x,y) (x,y) ...]", read into memory.
+/// @return Number of coordinates parsed. 0 on failure.
+static size_t parse_coords(const char *pos, const char *end, size_t **xs, size_t **ys, size_t *capacity) {
+  if (pos == end || *pos++ != '[') return 0;
+
+  //Every coordinate opens a parenthesis, count them to size the arrays once
+  size_t max = count_byte(pos, (size_t)(end - pos), '(');
+  if (max == 0) return 0;
+
+  if (max > *capacity) {
+    size_t *grown_xs = realloc(*xs, max * sizeof(size_t));
+    if (grown_xs == NULL) return 0;
+    *xs = grown_xs;
+
+    size_t *grown_ys = realloc(*ys, max * sizeof(size_t));
+    if (grown_ys == NULL) return 0;
+    *ys = grown_ys;
+    *capacity = max;
   }
 
+  //The padding after the line keeps 16 bytes readable for the vector scans, and stops them
   size_t num_coords = 0;
   while (num_coords < max) {
-    if (read(fd, &ch, 1) != 1 || ch != '(') {
-      cleanup(fd);
-      return 0;
-    }
+    unsigned int x, y;
+    size_t digits;
 
-    unsigned int x;
-    if (parse_uint(fd, &x, &ch) != 0 || ch != ',') {
-      cleanup(fd);
-      return 0;
-    }
-    xs[num_coords] = (size_t)x;
+    if (*pos++ != '(') return 0;
+    if ((digits = scan_uint(pos, (size_t)(end - pos) + LINE_PADDING, &x)) == 0) return 0;
+    pos += digits;
 
-    unsigned int y;
-    if (parse_uint(fd, &y, &ch) != 0 || ch != ')') {
-      cleanup(fd);
-      return 0;
-    }
-    ys[num_coords] = (size_t)y;
+    if (*pos++ != ',') return 0;
+    if ((digits = scan_uint(pos, (size_t)(end - pos) + LINE_PADDING, &y)) == 0) return 0;
+    pos += digits;
 
+    if (*pos++ != ')') return 0;
+    (*xs)[num_coords] = (size_t)x;
+    (*ys)[num_coords] = (size_t)y;
     num_coords++;
 
-    if (read(fd, &ch, 1) != 1 || (ch != ' ' && ch != ']')) {
-      cleanup(fd);
-      return 0;
-    }
-
-    if (ch == ']') {
-      break;
-    }
+    if (*pos == ']') break;
+    if (*pos++ != ' ') return 0;
   }
 
-  if (num_coords == max) {
+  //Nothing may follow the closing bracket
+  if (pos >= end || *pos != ']' || pos + 1 != end) return 0;
+
+  return num_coords;
+}
+
+size_t parse_reserve(int fd, unsigned int *event_id, size_t **xs, size_t **ys, size_t *capacity) {
+  char ch;
+
+  if (parse_uint(fd, event_id, &ch) != 0 || ch != ' ') {
     cleanup(fd);
     return 0;
   }
 
-  if (read(fd, &ch, 1) != 1 || (ch != '\n' && ch != '\0')) {
+  //Most lines fit on the stack, only large bookings take the heap
+  char stack[RESERVE_READ_BLOCK + LINE_PADDING];
+  char *line = stack;
+  size_t line_capacity = sizeof(stack);
+  size_t len;
+  if (read_line(fd, &line, &line_capacity, &len, stack) != 0) {
+    if (line != stack) free(line);
     cleanup(fd);
     return 0;
   }
 
+  size_t num_coords = parse_coords(line, line + len, xs, ys, capacity);
+  if (line != stack) free(line);
+
   return num_coords;
 }
 
+int parse_cancel(int fd, unsigned int *event_id, unsigned int *reservation_id) {
+  char ch;
+
+  if (parse_uint(fd, event_id, &ch) != 0 || ch != ' ') {
+    cleanup(fd);
+    return 1;
+  }
+
+  if (parse_uint(fd, reservation_id, &ch) != 0 || (ch != '\n' && ch != '\0')) {
+    cleanup(fd);
+    return 1;
+  }
+
+  return 0;
+}
+
 int parse_show(int fd, unsigned int *event_id) {
   char ch;
 
@@ -187,6 +341,54 @@ int parse_show(int fd, unsigned int *event_id) {
   return 0;
 }
 
+int parse_list_range(int fd, unsigned int *from_id, unsigned int *to_id, unsigned int *min_free_seats) {
+  char ch;
+
+  if (parse_uint(fd, from_id, &ch) != 0 || ch != ' ') {
+    cleanup(fd);
+    return 1;
+  }
+
+  if (parse_uint(fd, to_id, &ch) != 0) {
+    cleanup(fd);
+    return 1;
+  }
+
+  *min_free_seats = 0;
+  if (ch == ' ' && parse_uint(fd, min_free_seats, &ch) != 0) {
+    cleanup(fd);
+    return 1;
+  }
+
+  if (ch != '\n' && ch != '\0') {
+    cleanup(fd);
+    return 1;
+  }
+
+  return 0;
+}
+
+size_t parse_stats(int fd, size_t max, unsigned int *event_ids) {
+  char ch = ' ';
+
+  size_t num_ids = 0;
+  while (ch == ' ') {
+    if (num_ids == max || parse_uint(fd, &event_ids[num_ids], &ch) != 0) {
+      cleanup(fd);
+      return 0;
+    }
+
+    num_ids++;
+  }
+
+  if (ch != '\n' && ch != '\0') {
+    cleanup(fd);
+    return 0;
+  }
+
+  return num_ids;
+}
+
 int parse_wait(int fd, unsigned int *delay, unsigned int *thread_id) {
   char ch;
 
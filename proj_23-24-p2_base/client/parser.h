@@ -6,9 +6,17 @@
 enum Command {
   CMD_CREATE,
   CMD_RESERVE,
+  CMD_CANCEL,
   CMD_SHOW,
   CMD_LIST_EVENTS,
+  CMD_LIST_RANGE,
+  CMD_STATS,
+  CMD_SEATS,
+  CMD_SUBSCRIBE,
+  CMD_UNSUBSCRIBE,
+  CMD_UPDATES,
   CMD_WAIT,
+  CMD_BARRIER,
   CMD_HELP,
   CMD_EMPTY,
   CMD_INVALID,
@@ -28,21 +36,44 @@ enum Command get_next(int fd);
 /// @return 0 if the command was parsed successfully, 1 otherwise.
 int parse_create(int fd, unsigned int *event_id, size_t *num_rows, size_t *num_cols);
 
-/// Parses a RESERVE command.
+/// Parses a RESERVE command, of any number of coordinates.
+/// The coordinates are read as a whole line, in blocks, and scanned in memory.
 /// @param fd File descriptor to read from.
-/// @param max Maximum number of coordinates to read.
 /// @param event_id Pointer to the variable to store the event ID in.
-/// @param xs Pointer to the array to store the X coordinates in.
-/// @param ys Pointer to the array to store the Y coordinates in.
+/// @param xs Pointer to the array to store the X coordinates in, grown with realloc when too small. May be NULL.
+/// @param ys Pointer to the array to store the Y coordinates in, grown along with xs. May be NULL.
+/// @param capacity Pointer to the number of coordinates both arrays have room for, updated when they grow.
 /// @return Number of coordinates read. 0 on failure.
-size_t parse_reserve(int fd, size_t max, unsigned int *event_id, size_t *xs, size_t *ys);
+size_t parse_reserve(int fd, unsigned int *event_id, size_t **xs, size_t **ys, size_t *capacity);
 
-/// Parses a SHOW command.
+/// Parses a CANCEL or SEATS command.
+/// @param fd File descriptor to read from.
+/// @param event_id Pointer to the variable to store the event ID in.
+/// @param reservation_id Pointer to the variable to store the reservation ID in.
+/// @return 0 if the command was parsed successfully, 1 otherwise.
+int parse_cancel(int fd, unsigned int *event_id, unsigned int *reservation_id);
+
+/// Parses a SHOW, SUBSCRIBE or UNSUBSCRIBE command.
 /// @param fd File descriptor to read from.
 /// @param event_id Pointer to the variable to store the event ID in.
 /// @return 0 if the command was parsed successfully, 1 otherwise.
 int parse_show(int fd, unsigned int *event_id);
 
+/// Parses the arguments of a ranged LIST command, "LIST <from_id> <to_id> [min_free_seats]".
+/// @param fd File descriptor to read from.
+/// @param from_id Pointer to the variable to store the first event ID of the range in.
+/// @param to_id Pointer to the variable to store the last event ID of the range in.
+/// @param min_free_seats Pointer to the variable to store the free seat filter in, 0 if not given.
+/// @return 0 if the command was parsed successfully, 1 otherwise.
+int parse_list_range(int fd, unsigned int *from_id, unsigned int *to_id, unsigned int *min_free_seats);
+
+/// Parses a STATS command, "STATS <event_id> [<event_id> ...]".
+/// @param fd File descriptor to read from.
+/// @param max Maximum number of event IDs to read.
+/// @param event_ids Pointer to the array to store the event IDs in.
+/// @return Number of event IDs read. 0 on failure.
+size_t parse_stats(int fd, size_t max, unsigned int *event_ids);
+
 /// Parses a WAIT command.
 /// @param fd File descriptor to read from.
 /// @param delay Pointer to the variable to store the wait delay in.
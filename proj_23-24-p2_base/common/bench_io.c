@@ -0,0 +1,152 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "common/io.h"
+
+#define BENCH_VALUES (1 << 20)  // Values formatted and scanned per round
+#define BENCH_ROUNDS 20         // Rounds timed for each routine
+
+/// Formats an unsigned integer one digit at a time, as print_uint used to.
+static size_t format_uint_digits(char *out, unsigned int value) {
+  char buffer[UINT_TEXT_MAX];
+  size_t i = UINT_TEXT_MAX;
+
+  for (; value > 0; value /= 10) {
+    buffer[--i] = (char)('0' + value % 10);
+  }
+
+  if (i == UINT_TEXT_MAX) {
+    buffer[--i] = '0';
+  }
+
+  memcpy(out, buffer + i, UINT_TEXT_MAX - i);
+  return UINT_TEXT_MAX - i;
+}
+
+static size_t format_uint_snprintf(char *out, unsigned int value) {
+  char buffer[UINT_TEXT_MAX + 1];
+  int len = snprintf(buffer, sizeof(buffer), "%u", value);
+  memcpy(out, buffer, (size_t)len);
+  return (size_t)len;
+}
+
+/// Gets the time elapsed since start, in nanoseconds.
+static double elapsed_ns(const struct timespec *start) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double)(now.tv_sec - start->tv_sec) * 1e9 + (double)(now.tv_nsec - start->tv_nsec);
+}
+
+/// Times a formatting routine over values, writing them space separated into text.
+static void bench_format(const char *name, size_t (*format)(char *, unsigned int), const unsigned int *values,
+                         char *text) {
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  size_t len = 0;
+  for (int round = 0; round < BENCH_ROUNDS; round++) {
+    len = 0;
+    for (size_t i = 0; i < BENCH_VALUES; i++) {
+      len += format(text + len, values[i]);
+      text[len++] = ' ';
+    }
+  }
+
+  printf("  %-16s %6.2f ns/value\n", name, elapsed_ns(&start) / BENCH_ROUNDS / BENCH_VALUES);
+}
+
+/// Times scanning back the values of a space separated text.
+static void bench_scan(const char *name, int use_strtoul, const char *text, size_t text_len) {
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  unsigned long sum = 0;
+  for (int round = 0; round < BENCH_ROUNDS; round++) {
+    const char *pos = text;
+    const char *end = text + text_len;
+    while (pos < end) {
+      unsigned int value;
+      if (use_strtoul) {
+        char *next;
+        value = (unsigned int)strtoul(pos, &next, 10);
+        pos = next + 1;
+      } else {
+        pos += scan_uint(pos, (size_t)(end - pos), &value) + 1;
+      }
+      sum += value;
+    }
+  }
+
+  printf("  %-16s %6.2f ns/value (sum %lu)\n", name, elapsed_ns(&start) / BENCH_ROUNDS / BENCH_VALUES, sum);
+}
+
+/// Checks format_uint and scan_uint against snprintf and strtoul.
+/// @return Number of mismatches.
+static int check(unsigned int value) {
+  char expected[UINT_TEXT_MAX + 1];
+  char text[UINT_TEXT_MAX + 16];
+  int expected_len = snprintf(expected, sizeof(expected), "%u", value);
+
+  //Pad past the number, so the vector scan runs
+  memset(text, ' ', sizeof(text));
+  size_t len = format_uint(text, value);
+  unsigned int scanned;
+  if (len != (size_t)expected_len || memcmp(text, expected, len) != 0 ||
+      scan_uint(text, sizeof(text), &scanned) != len || scanned != value) {
+    fprintf(stderr, "Mismatch for %u\n", value);
+    return 1;
+  }
+
+  return 0;
+}
+
+int main(void) {
+  //Every number up to 10^6, every power of ten boundary and random ones
+  int errors = 0;
+  for (unsigned int value = 0; value <= 1000000; value++) errors += check(value);
+  for (unsigned int power = 10; power <= 1000000000; power *= 10) errors += check(power - 1) + check(power);
+  errors += check(UINT32_MAX) + check(UINT32_MAX - 1);
+  srand(1);
+  for (int i = 0; i < 1000000; i++) errors += check((unsigned int)rand() ^ ((unsigned int)rand() << 16));
+
+  //Rejects what does not fit
+  unsigned int value;
+  const char *too_big = "4294967296                ";
+  if (scan_uint(too_big, strlen(too_big), &value) != 0) errors++;
+  if (errors) return 1;
+  printf("format_uint and scan_uint match snprintf and strtoul\n");
+
+  unsigned int *values = malloc(BENCH_VALUES * sizeof(unsigned int));
+  char *text = malloc(BENCH_VALUES * (UINT_TEXT_MAX + 1) + 16);
+  if (values == NULL || text == NULL) return 1;
+
+  //Seat sized ids, then full width ones
+  const unsigned int limits[] = {1000, UINT32_MAX};
+  for (int set = 0; set < 2; set++) {
+    for (size_t i = 0; i < BENCH_VALUES; i++) {
+      unsigned int random = (unsigned int)rand() ^ ((unsigned int)rand() << 16);
+      values[i] = limits[set] == UINT32_MAX ? random : random % limits[set];
+    }
+    printf(set == 0 ? "values below 1000:\n" : "values up to 2^32:\n");
+
+    bench_format("snprintf", format_uint_snprintf, values, text);
+    bench_format("digit loop", format_uint_digits, values, text);
+    bench_format("format_uint", format_uint, values, text);
+
+    size_t text_len = 0;
+    for (size_t i = 0; i < BENCH_VALUES; i++) {
+      text_len += format_uint(text + text_len, values[i]);
+      text[text_len++] = ' ';
+    }
+    text[text_len] = '\0';
+    bench_scan("strtoul", 1, text, text_len);
+    bench_scan("scan_uint", 0, text, text_len);
+  }
+
+  free(values);
+  free(text);
+  return 0;
+}
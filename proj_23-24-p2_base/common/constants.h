@@ -1,5 +1,21 @@
-#define MAX_RESERVATION_SIZE 256
 #define STATE_ACCESS_DELAY_US 500000  // 500ms
 #define MAX_JOB_FILE_NAME_SIZE 256
 #define MAX_SESSION_COUNT 8
 #define FIFO_PERMS 0666
+#define ADMISSION_QUEUE_SIZE 3        // Setup requests allowed to wait for a free worker
+#define ADMISSION_MAX_WAIT_MS 0        // Estimated wait above which clients are turned away, 0 disables it
+#define ADMISSION_MIN_RETRY_MS 50      // Smallest retry delay suggested to a rejected client
+#define ADMISSION_FULL_WAIT_MS 2       // How long a setup request waits for a slot of a full queue before rejection
+#define REJECT_QUEUE_SIZE 16           // Rejected clients waiting to be told to retry, the acceptor waits for room
+#define SESSION_RATE_LIMIT 0           // Commands per second allowed for each session, 0 disables it
+#define SESSION_RATE_BURST 16          // Commands a session may issue back to back before being throttled
+#define SETUP_MAX_ATTEMPTS 8           // Setup attempts made by a client before giving up
+#define LIST_PAGE_SIZE 256             // Events a client asks for in each page of a ranged LIST
+#define LIST_PAGE_MAX 4096             // Most events a server puts in one page of a ranged LIST
+#define LIST_PAGE_SCAN_MAX 16384       // Events a server filters for one page before letting the client continue
+#define STATS_MAX_EVENTS 64            // Events a single STATS command may ask for
+#define RESPONSE_BUFFER_SIZE 65536     // Bytes of responses a client reads ahead in each session
+#define RESERVE_READ_BLOCK 4096        // Bytes of a jobs file the client reads at once for a RESERVE line
+#define MAX_CLUSTER_SIZE 16            // Servers an event id partitioned cluster may have
+#define MAX_CLIENT_REPLICAS 8          // Read replicas a client spreads its threads over
+#define REPLICA_MAX_STALENESS_MS 100   // How far behind the primary replicas may answer, unless the client says otherwise
@@ -1,14 +1,178 @@
 #include "io.h"
 
 #include <limits.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define IO_SIMD 1
+#else
+#define IO_SIMD 0
+#endif
+
+//Two digit strings of every number below 100
+static const char digit_pairs[201] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839404142434445464748495051525354555657"
+    "585960616263646566676869707172737475767778798081828384858687888990919293949596979899";
+
+/// Formats an unsigned integer two digits at a time, the portable path.
+static size_t format_uint_scalar(char *out, unsigned int value) {
+  char buffer[UINT_TEXT_MAX];
+  size_t i = UINT_TEXT_MAX;
+
+  while (value >= 100) {
+    unsigned int pair = value % 100;
+    value /= 100;
+    i -= 2;
+    memcpy(buffer + i, digit_pairs + 2 * pair, 2);
+  }
+
+  if (value >= 10) {
+    i -= 2;
+    memcpy(buffer + i, digit_pairs + 2 * value, 2);
+  } else {
+    buffer[--i] = (char)('0' + value);
+  }
+
+  memcpy(out, buffer + i, UINT_TEXT_MAX - i);
+  return UINT_TEXT_MAX - i;
+}
+
+/// Scans the digits at the start of a text one at a time, the portable path.
+static size_t scan_uint_scalar(const char *text, size_t len, unsigned int *value) {
+  uint64_t result = 0;
+  size_t i = 0;
+  for (; i < len && text[i] >= '0' && text[i] <= '9'; i++) {
+    result = result * 10 + (uint64_t)(text[i] - '0');
+    if (result > UINT_MAX) return 0;
+  }
+
+  *value = (unsigned int)result;
+  return i;
+}
+
+#if IO_SIMD
+/// Splits a number below 10^8 into its 8 decimal digits, one per 16 bit lane, most significant first.
+/// Both halves of 4 digits are divided by 1000, 100, 10 and 1 at once through fixed point reciprocals.
+static __m128i digits8_sse2(unsigned int value) {
+  const __m128i abcdefgh = _mm_cvtsi32_si128((int)value);
+  const __m128i abcd = _mm_srli_epi64(_mm_mul_epu32(abcdefgh, _mm_set1_epi32((int)0xd1b71759)), 45);
+  const __m128i efgh = _mm_sub_epi32(abcdefgh, _mm_mul_epu32(abcd, _mm_set1_epi32(10000)));
+
+  //[abcd, efgh] spread to [abcd * 4 x4, efgh * 4 x4]
+  const __m128i halves = _mm_slli_epi64(_mm_unpacklo_epi16(abcd, efgh), 2);
+  const __m128i pairs = _mm_unpacklo_epi16(halves, halves);
+  const __m128i spread = _mm_unpacklo_epi32(pairs, pairs);
+
+  //[a, ab, abc, abcd, e, ef, efg, efgh]
+  const __m128i powers = _mm_setr_epi16(8389, 5243, 13108, (short)32768, 8389, 5243, 13108, (short)32768);
+  const __m128i shifts = _mm_setr_epi16(1 << 7, 1 << 11, 1 << 13, (short)(1 << 15), 1 << 7, 1 << 11, 1 << 13,
+                                        (short)(1 << 15));
+  const __m128i prefixes = _mm_mulhi_epu16(_mm_mulhi_epu16(spread, powers), shifts);
+
+  //Subtract ten times the previous prefix to keep the last digit: [a, b, c, d, e, f, g, h]
+  const __m128i tens = _mm_slli_epi64(_mm_mullo_epi16(prefixes, _mm_set1_epi16(10)), 16);
+  return _mm_sub_epi16(prefixes, tens);
+}
+
+/// Writes the 8 digits of a number below 10^8 as text, zero padded.
+static void text8_sse2(char *out, unsigned int value) {
+  __m128i text = _mm_add_epi8(_mm_packus_epi16(digits8_sse2(value), _mm_setzero_si128()), _mm_set1_epi8('0'));
+  _mm_storel_epi64((__m128i *)out, text);
+}
+
+/// Formats an unsigned integer, 8 digits at a time. Short numbers gain nothing from it and use the pairs table.
+static size_t format_uint_sse2(char *out, unsigned int value) {
+  if (value < 10000) return format_uint_scalar(out, value);
+
+  if (value < 100000000) {
+    char text[8];
+    text8_sse2(text, value);
+
+    //Skip the zero padding, there are at least 5 digits
+    size_t skip = 0;
+    while (text[skip] == '0') skip++;
+    memcpy(out, text + skip, 8 - skip);
+    return 8 - skip;
+  }
+
+  //Up to 2 leading digits, then 8 more
+  size_t len = format_uint_scalar(out, value / 100000000);
+  text8_sse2(out + len, value % 100000000);
+  return len + 8;
+}
+
+/// Scans the digits at the start of 16 bytes of text at once.
+/// @return Number of digits scanned, 0 if there are none or more than 10, for the portable path to settle.
+__attribute__((target("sse4.1"))) static size_t scan_uint_sse41(const char *text, unsigned int *value) {
+  //Find the first byte that is not a digit, digits are the bytes below 10 once '0' is subtracted
+  const __m128i bytes = _mm_sub_epi8(_mm_loadu_si128((const __m128i *)text), _mm_set1_epi8('0'));
+  const __m128i digits = _mm_cmpeq_epi8(_mm_min_epu8(bytes, _mm_set1_epi8(9)), bytes);
+  unsigned int mask = (unsigned int)_mm_movemask_epi8(digits);
+  size_t len = (size_t)__builtin_ctz(~mask);
+  if (len == 0 || len > UINT_TEXT_MAX) return 0;
+
+  //Move the digits to the end of the register, zeros shifted in front of them
+  static const int8_t align[32] = {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                   0,  1,  2,  3,  4,  5,  6,  7,  8,  9,  10, 11, 12, 13, 14, 15};
+  const __m128i aligned = _mm_shuffle_epi8(bytes, _mm_loadu_si128((const __m128i *)(align + len)));
+
+  //Merge neighbours into 2, 4 and 8 digit numbers
+  const __m128i two = _mm_maddubs_epi16(aligned, _mm_setr_epi8(10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1));
+  const __m128i four = _mm_madd_epi16(two, _mm_setr_epi16(100, 1, 100, 1, 100, 1, 100, 1));
+  const __m128i eight = _mm_madd_epi16(_mm_packus_epi32(four, four), _mm_setr_epi16(10000, 1, 10000, 1, 0, 0, 0, 0));
+
+  uint64_t result = (uint64_t)(uint32_t)_mm_cvtsi128_si32(eight) * 100000000 +
+                    (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(eight, 4));
+  if (result > UINT_MAX) return 0;
+
+  *value = (unsigned int)result;
+  return len;
+}
+#endif
+
+size_t format_uint(char *out, unsigned int value) {
+#if IO_SIMD
+  return format_uint_sse2(out, value);
+#else
+  return format_uint_scalar(out, value);
+#endif
+}
+
+size_t scan_uint(const char *text, size_t len, unsigned int *value) {
+#if IO_SIMD
+  //The vector path reads 16 bytes, shorter texts and unusual numbers take the portable one
+  if (len >= 16 && __builtin_cpu_supports("sse4.1")) {
+    size_t scanned = scan_uint_sse41(text, value);
+    if (scanned != 0) return scanned;
+  }
+#endif
+  return scan_uint_scalar(text, len, value);
+}
+
+size_t count_byte(const char *text, size_t len, char byte) {
+  size_t count = 0;
+  size_t i = 0;
+#if IO_SIMD
+  //Compare 16 bytes at a time and count the matching lanes
+  const __m128i wanted = _mm_set1_epi8(byte);
+  for (; i + 16 <= len; i += 16) {
+    const __m128i bytes = _mm_loadu_si128((const __m128i *)(text + i));
+    count += (size_t)__builtin_popcount((unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, wanted)));
+  }
+#endif
+  for (; i < len; i++) count += text[i] == byte;
+
+  return count;
+}
+
 int parse_uint(int fd, unsigned int *value, char *next) {
   char buf[16];
 
-  int i = 0;
+  size_t i = 0;
   while (1) {
     ssize_t read_bytes = read(fd, buf + i, 1);
     if (read_bytes == -1) {
@@ -21,38 +185,31 @@ int parse_uint(int fd, unsigned int *value, char *next) {
     *next = buf[i];
 
     if (buf[i] > '9' || buf[i] < '0') {
-      buf[i] = '\0';
       break;
     }
 
-    i++;
+    //Longer numbers cannot fit anyway
+    if (++i == sizeof(buf)) {
+      return 1;
+    }
   }
 
-  unsigned long ul = strtoul(buf, NULL, 10);
-
-  if (ul > UINT_MAX) {
+  //An empty number reads as 0, as it always did
+  if (i > 0 && scan_uint(buf, i, value) != i) {
     return 1;
   }
-
-  *value = (unsigned int)ul;
+  if (i == 0) *value = 0;
 
   return 0;
 }
 
 int print_uint(int fd, unsigned int value) {
-  char buffer[16];
-  size_t i = 16;
-
-  for (; value > 0; value /= 10) {
-    buffer[--i] = '0' + (char)(value % 10);
-  }
-
-  if (i == 16) {
-    buffer[--i] = '0';
-  }
+  char buffer[UINT_TEXT_MAX];
+  size_t len = format_uint(buffer, value);
 
-  while (i < 16) {
-    ssize_t written = write(fd, buffer + i, 16 - i);
+  size_t i = 0;
+  while (i < len) {
+    ssize_t written = write(fd, buffer + i, len - i);
     if (written == -1) {
       return 1;
     }
@@ -1,6 +1,33 @@
 #ifndef COMMON_IO_H
 #define COMMON_IO_H
 
+#include <stddef.h>
+
+#define UINT_TEXT_MAX 10  // Digits of the largest unsigned integer
+
+/// Formats an unsigned integer in decimal, without a terminator.
+/// Uses SSE2 on x86-64 and a portable two digits at a time path elsewhere.
+/// @param out Buffer of at least UINT_TEXT_MAX bytes.
+/// @param value The value to format.
+/// @return Number of characters written.
+size_t format_uint(char *out, unsigned int value);
+
+/// Scans a decimal unsigned integer from the start of a text.
+/// Uses SSE4.1 when the CPU has it and at least 16 bytes are readable, a portable path otherwise.
+/// @param text The text to scan, not necessarily terminated.
+/// @param len Number of readable bytes of text.
+/// @param value Pointer to the variable to store the value in.
+/// @return Number of digits scanned, 0 if the text does not start with a digit or the integer does not fit.
+size_t scan_uint(const char *text, size_t len, unsigned int *value);
+
+/// Counts the occurrences of a byte in a text.
+/// Uses SSE2 on x86-64, 16 bytes at a time, and a portable path elsewhere.
+/// @param text The text to search.
+/// @param len Length of the text.
+/// @param byte The byte to count.
+/// @return Number of occurrences.
+size_t count_byte(const char *text, size_t len, char byte);
+
 /// Parses an unsigned integer from the given file descriptor.
 /// @param fd The file descriptor to read from.
 /// @param value Pointer to the variable to store the value in.
@@ -11,15 +11,30 @@ enum MSG_OPCODE
 	MSG_CREATE  = 3,  // Opcode for create message
 	MSG_RESERVE = 4,  // Opcode for reserve message
 	MSG_SHOW = 5,     // Opcode for show message
-	MSG_LIST = 6      // Opcode for list message
+	MSG_LIST = 6,     // Opcode for list message
+	MSG_CANCEL = 7,   // Opcode for cancel message
+	MSG_SUBSCRIBE = 8,   // Opcode for subscribe message
+	MSG_UNSUBSCRIBE = 9,  // Opcode for unsubscribe message
+	MSG_STALENESS = 10,   // Opcode for staleness bound message
+	MSG_LIST_PAGE = 11,   // Opcode for ranged, paginated list message
+	MSG_STATS = 12,       // Opcode for occupancy statistics message
+	MSG_SEATS = 13        // Opcode for reservation seats message
 };
 
-// Structure for core request message
+// Structure for core request message, the header of every request frame, followed by payload_len bytes
 typedef struct {
-	char opcode;             // Opcode of the request
-	unsigned int session_id; // Session ID
+	char opcode;               // Opcode of the request
+	unsigned int session_id;   // Session ID
+	unsigned int request_id;   // Echoed by the response, so it can be matched with its request
+	unsigned int payload_len;  // Size of the request message following the header
 } __attribute__((packed)) core_request;
 
+// Structure for the header of every response frame but the setup response, followed by payload_len bytes
+typedef struct {
+	unsigned int request_id;   // Request ID of the request answered
+	unsigned int payload_len;  // Size of the response message following the header
+} __attribute__((packed)) response_header;
+
 // Structure for setup request message
 typedef struct {
 	char request_fifo_name[40];   // Name of the request FIFO
@@ -28,9 +43,14 @@ typedef struct {
 
 // Structure for setup response message
 typedef struct {
-	unsigned int session_id;  // Session ID
+	unsigned int session_id;      // Session ID
+	int return_code;              // Return code, SETUP_BUSY if the server is overloaded
+	unsigned int retry_after_ms;  // Suggested delay before retrying when busy
 } __attribute__((packed)) setup_response;
 
+// Return code of a setup response turned away by admission control
+#define SETUP_BUSY 2
+
 // Structure for create request message
 typedef struct {
 	unsigned int event_id;  // Event ID
@@ -72,4 +92,118 @@ typedef struct {
 	size_t num_events;  // Number of events
 } __attribute__((packed)) list_response;
 
+// Structure for cancel request message
+typedef struct {
+	unsigned int event_id;        // Event ID
+	unsigned int reservation_id;  // Reservation ID
+} __attribute__((packed)) cancel_request;
+
+// Structure for cancel response message
+typedef struct {
+	int return_code;  // Return code
+} __attribute__((packed)) cancel_response;
+
+// Structure for subscribe request message
+typedef struct {
+	unsigned int event_id;       // Event ID
+	char notify_fifo_name[40];  // Name of the FIFO seat changes are pushed to, opened for reading beforehand
+} __attribute__((packed)) subscribe_request;
+
+// Structure for subscribe response message
+typedef struct {
+	int return_code;  // Return code
+} __attribute__((packed)) subscribe_response;
+
+// Structure for unsubscribe request message
+typedef struct {
+	unsigned int event_id;  // Event ID
+} __attribute__((packed)) unsubscribe_request;
+
+// Structure for unsubscribe response message
+typedef struct {
+	int return_code;  // Return code
+} __attribute__((packed)) unsubscribe_response;
+
+// Structure for staleness bound request message, only acted upon by read replicas
+typedef struct {
+	unsigned int max_staleness_ms;  // How far behind the primary the session accepts SHOW and LIST answers to be
+} __attribute__((packed)) staleness_request;
+
+// Structure for staleness bound response message
+typedef struct {
+	int return_code;  // Return code
+} __attribute__((packed)) staleness_response;
+
+// Structure for list page request message, listing the events of an id range a page at a time
+typedef struct {
+	unsigned int from_id;         // First event id of the page, next_id of the previous page to continue
+	unsigned int to_id;           // Last event id of the range
+	unsigned int page_size;       // Most events in the page, capped at LIST_PAGE_MAX by the server
+	unsigned int min_free_seats;  // Only list events with at least this many free seats, 0 to list all
+} __attribute__((packed)) list_page_request;
+
+// Structure for list page response message, followed by num_events event ids in increasing order
+typedef struct {
+	int return_code;          // Return code
+	unsigned int num_events;  // Number of event ids in the page
+	unsigned int next_id;     // Where the next page starts, only set if more is 1
+	char more;                // 1 if the range has events past this page
+} __attribute__((packed)) list_page_response;
+
+// Structure for stats request message, followed by num_events event ids
+typedef struct {
+	unsigned int num_events;  // Number of events asked for, at most STATS_MAX_EVENTS
+} __attribute__((packed)) stats_request;
+
+// Structure for stats response message, followed by num_events event_stats records in request order
+typedef struct {
+	int return_code;          // Return code
+	unsigned int num_events;  // Number of records following
+} __attribute__((packed)) stats_response;
+
+// Occupancy of one event in a stats response, followed by num_rows free seat counts (size_t), one per row
+typedef struct {
+	unsigned int event_id;      // Event ID
+	char found;                 // 0 if there is no such event, num_rows is then 0
+	size_t num_rows;            // Number of rows
+	size_t num_cols;            // Number of columns
+	size_t sold;                // Seats held by a reservation
+	unsigned int reservations;  // Reservations holding seats
+} __attribute__((packed)) event_stats;
+
+// Structure for reservation seats request message
+typedef struct {
+	unsigned int event_id;        // Event ID
+	unsigned int reservation_id;  // Reservation ID
+} __attribute__((packed)) seats_request;
+
+// Structure for reservation seats response message, followed by num_seats rows and then num_seats columns
+typedef struct {
+	int return_code;              // Return code
+	unsigned int event_id;        // Event ID, echoed from the request
+	unsigned int reservation_id;  // Reservation ID, echoed from the request
+	size_t num_seats;             // Number of seats held by the reservation, 0 if it does not exist or was cancelled
+} __attribute__((packed)) seats_response;
+
+// Return code of a SHOW or LIST a replica is too far behind the primary to answer, ask the primary instead
+#define REPLICA_STALE 2
+
+// Kinds of messages pushed through the notification FIFO
+#define NOTIFY_CHANGES 1  // Followed by count seat_change records
+#define NOTIFY_RESYNC 2   // Changes were dropped, subscribed events must be shown again
+
+// Structure for the header of a notification message
+typedef struct {
+	char kind;           // NOTIFY_CHANGES or NOTIFY_RESYNC
+	unsigned int count;  // Number of seat_change records following the header
+} __attribute__((packed)) notify_header;
+
+// Structure for a seat change pushed to subscribers
+typedef struct {
+	unsigned int event_id;        // Event ID
+	unsigned int reservation_id;  // New reservation ID of the seat, 0 if it was freed
+	size_t row;                   // Row of the seat
+	size_t col;                   // Column of the seat
+} __attribute__((packed)) seat_change;
+
 #endif
@@ -0,0 +1,9 @@
+#include "partition.h"
+
+#include <stdint.h>
+
+unsigned int partition_of(unsigned int event_id, unsigned int count) {
+  //Multiplicative hash, then scale the 32 bit hash range down to count equal ranges
+  uint32_t hash = (uint32_t)event_id * 2654435761u;
+  return (unsigned int)(((uint64_t)hash * count) >> 32);
+}
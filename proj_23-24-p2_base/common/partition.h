@@ -0,0 +1,11 @@
+#ifndef COMMON_PARTITION_H
+#define COMMON_PARTITION_H
+
+/// Finds the server of a partitioned cluster that owns an event.
+/// Event ids are hashed, and each server owns one contiguous range of hashes, so consecutive ids are spread out.
+/// @param event_id Id of the event.
+/// @param count Number of servers in the cluster.
+/// @return Index of the owning server, from 0 to count - 1.
+unsigned int partition_of(unsigned int event_id, unsigned int count);
+
+#endif  // COMMON_PARTITION_H
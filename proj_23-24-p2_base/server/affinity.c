@@ -0,0 +1,89 @@
+#define _GNU_SOURCE  // cpu_set_t, pthread_attr_setaffinity_np()
+#include "affinity.h"
+
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static int cpus[AFFINITY_MAX_CPUS];
+static size_t cpu_count = 0;
+
+/// Fills a CPU set with a single CPU.
+static void single_cpu(cpu_set_t* set, int cpu) {
+  CPU_ZERO(set);
+  CPU_SET((size_t)cpu, set);
+}
+
+int affinity_parse(const char* list) {
+  cpu_set_t allowed;
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+    fprintf(stderr, "Failed to get the CPUs available to the server\n");
+    return 1;
+  }
+
+  cpu_count = 0;
+  const char* pos = list;
+  while (*pos != '\0') {
+    //Parse a CPU or a range of CPUs
+    char* end;
+    unsigned long first = strtoul(pos, &end, 10);
+    unsigned long last = first;
+    if (end == pos) break;
+    if (*end == '-') {
+      pos = end + 1;
+      last = strtoul(pos, &end, 10);
+      if (end == pos) break;
+    }
+    if (first > last || last >= AFFINITY_MAX_CPUS) break;
+
+    for (unsigned long cpu = first; cpu <= last; cpu++) {
+      if (!CPU_ISSET(cpu, &allowed)) {
+        fprintf(stderr, "CPU %lu is not available to the server\n", cpu);
+        return 1;
+      }
+      if (cpu_count == AFFINITY_MAX_CPUS) break;
+      cpus[cpu_count++] = (int)cpu;
+    }
+
+    //Move on to the next item
+    pos = end;
+    if (*pos == ',') {
+      pos++;
+    } else if (*pos != '\0') {
+      break;
+    }
+  }
+
+  if (*pos != '\0' || cpu_count == 0) {
+    fprintf(stderr, "Invalid CPU list: %s\n", list);
+    cpu_count = 0;
+    return 1;
+  }
+  return 0;
+}
+
+int affinity_enabled(void) { return cpu_count > 0; }
+
+int affinity_pin_acceptor(void) {
+  if (cpu_count == 0) return 0;
+
+  cpu_set_t set;
+  single_cpu(&set, cpus[0]);
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0 ? 0 : 1;
+}
+
+int affinity_worker_cpu(unsigned int worker) {
+  if (cpu_count == 0) return -1;
+
+  //Workers share the acceptor CPU only when it is the only one given
+  if (cpu_count == 1) return cpus[0];
+  return cpus[1 + worker % (cpu_count - 1)];
+}
+
+int affinity_worker_attr(pthread_attr_t* attr, unsigned int worker) {
+  if (cpu_count == 0) return 0;
+
+  cpu_set_t set;
+  single_cpu(&set, affinity_worker_cpu(worker));
+  return pthread_attr_setaffinity_np(attr, sizeof(set), &set) == 0 ? 0 : 1;
+}
@@ -0,0 +1,39 @@
+#ifndef SERVER_AFFINITY_H
+#define SERVER_AFFINITY_H
+
+#include <pthread.h>
+
+/// Placement of the acceptor and worker threads on CPUs.
+///
+/// The CPU list is given as "0-3,8,10-11". Its first CPU runs the acceptor (the main thread, and the helper threads
+/// it starts), and workers are spread over the rest in list order, wrapping around when there are more workers than
+/// CPUs. List the CPUs of one NUMA node together to keep the workers of that node next to each other. A worker
+/// allocates and first touches its own buffers after it starts, so with Linux's first-touch policy they land on the
+/// node of its CPU.
+
+#define AFFINITY_MAX_CPUS 1024  // Highest CPU number accepted, plus one
+
+/// Parses a CPU list and checks that every CPU is available to the process.
+/// @param list CPU list, as described above.
+/// @return 0 if the list is valid, 1 otherwise.
+int affinity_parse(const char* list);
+
+/// Checks if a CPU list was given.
+int affinity_enabled(void);
+
+/// Pins the calling thread to the acceptor CPU. Does nothing if no CPU list was given.
+/// @return 0 on success, 1 otherwise.
+int affinity_pin_acceptor(void);
+
+/// Makes a thread created with the given attributes start pinned to the CPU of a worker.
+/// Does nothing if no CPU list was given.
+/// @param attr Initialized thread attributes.
+/// @param worker Index of the worker.
+/// @return 0 on success, 1 otherwise.
+int affinity_worker_attr(pthread_attr_t* attr, unsigned int worker);
+
+/// Gets the CPU a worker is pinned to.
+/// @return The CPU, -1 if no CPU list was given.
+int affinity_worker_cpu(unsigned int worker);
+
+#endif  // SERVER_AFFINITY_H
@@ -0,0 +1,83 @@
+#include "arena.h"
+
+#include <stdalign.h>
+#include <stdlib.h>
+
+#define ARENA_ALIGNMENT alignof(max_align_t)
+
+/// Allocates a chunk with room for at least size bytes.
+/// @return The new chunk, linked after prev, NULL on failure.
+static struct ArenaChunk* new_chunk(struct ArenaChunk* prev, size_t size) {
+  struct ArenaChunk* chunk = malloc(sizeof(struct ArenaChunk) + size);
+  if (chunk == NULL) return NULL;
+
+  chunk->prev = prev;
+  chunk->size = size;
+  chunk->used = 0;
+  return chunk;
+}
+
+void arena_init(struct Arena* arena) {
+  arena->current = NULL;
+  arena->total = 0;
+}
+
+void* arena_alloc(struct Arena* arena, size_t size) {
+  size = (size + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+
+  struct ArenaChunk* chunk = arena->current;
+  if (chunk == NULL || chunk->size - chunk->used < size) {
+    //Grow geometrically so a request needs few chunks
+    size_t chunk_size = chunk == NULL ? ARENA_INITIAL_SIZE : chunk->size * 2;
+    if (chunk_size < size) chunk_size = size;
+
+    chunk = new_chunk(chunk, chunk_size);
+    if (chunk == NULL) return NULL;
+
+    arena->current = chunk;
+    arena->total += chunk_size;
+  }
+
+  void* ptr = chunk->data + chunk->used;
+  chunk->used += size;
+  return ptr;
+}
+
+void arena_reset(struct Arena* arena) {
+  struct ArenaChunk* chunk = arena->current;
+  if (chunk == NULL) return;
+
+  if (chunk->prev == NULL && chunk->size <= ARENA_RETAIN_SIZE) {
+    chunk->used = 0;
+    return;
+  }
+
+  //Replace the chunks with one large enough for all of them up to the retained size, keeping the old ones if that
+  //fails and they are within it
+  size_t size = arena->total < ARENA_RETAIN_SIZE ? arena->total : ARENA_RETAIN_SIZE;
+  struct ArenaChunk* merged = new_chunk(NULL, size);
+  if (merged == NULL) {
+    if (arena->total > ARENA_RETAIN_SIZE) {
+      arena_destroy(arena);
+      return;
+    }
+    for (; chunk != NULL; chunk = chunk->prev) chunk->used = 0;
+    return;
+  }
+
+  arena_destroy(arena);
+  arena->current = merged;
+  arena->total = merged->size;
+}
+
+void arena_destroy(struct Arena* arena) {
+  struct ArenaChunk* chunk = arena->current;
+  while (chunk != NULL) {
+    struct ArenaChunk* prev = chunk->prev;
+    free(chunk);
+    chunk = prev;
+  }
+
+  arena->current = NULL;
+  arena->total = 0;
+}
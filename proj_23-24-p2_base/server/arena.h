@@ -0,0 +1,40 @@
+#ifndef SERVER_ARENA_H
+#define SERVER_ARENA_H
+
+#include <stddef.h>
+
+#define ARENA_INITIAL_SIZE 16384    // Bytes of the first chunk of each arena
+#define ARENA_RETAIN_SIZE (1 << 20)  // Most bytes an arena keeps across a reset
+
+/// Chunk of memory handed out by an arena.
+struct ArenaChunk {
+  struct ArenaChunk* prev;  /// Chunk filled before this one, NULL for the first.
+  size_t size;              /// Bytes of data.
+  size_t used;              /// Bytes of data already handed out.
+  char data[];              /// Memory handed out.
+};
+
+/// Bump allocator for memory that lives as long as a single request.
+/// Allocations are never freed one by one: arena_reset releases all of them at once.
+/// An arena is not thread safe, each worker owns its own.
+struct Arena {
+  struct ArenaChunk* current;  /// Chunk allocations are taken from, NULL until the first allocation.
+  size_t total;                /// Bytes of all chunks.
+};
+
+/// Sets up an empty arena.
+void arena_init(struct Arena* arena);
+
+/// Allocates size bytes, aligned for any type.
+/// @return Pointer to the memory, valid until the next reset, NULL on failure.
+void* arena_alloc(struct Arena* arena, size_t size);
+
+/// Releases every allocation at once.
+/// When the last request needed more than one chunk, they are merged so the next one fits in a single chunk. Memory
+/// past ARENA_RETAIN_SIZE is given back, so one unusually large request does not stay allocated for good.
+void arena_reset(struct Arena* arena);
+
+/// Frees all the memory of the arena.
+void arena_destroy(struct Arena* arena);
+
+#endif  // SERVER_ARENA_H
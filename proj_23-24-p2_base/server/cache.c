@@ -0,0 +1,110 @@
+#include "cache.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+
+/// Cached event.
+struct CacheEntry {
+  unsigned int event_id;  /// Id of the event.
+  struct Event* event;    /// Event, NULL if the entry is free.
+  int referenced;         /// CLOCK reference bit, set on every hit.
+};
+
+/// Set of entries events hashing to it can be cached in.
+struct CacheShard {
+  struct CacheEntry entries[EVENT_CACHE_WAYS];
+  size_t hand;            /// Next entry considered for eviction.
+  pthread_mutex_t mutex;  /// Protects the shard.
+};
+
+static struct CacheShard* shards = NULL;
+static size_t shard_count = 0;
+static atomic_ulong hits = 0;
+static atomic_ulong misses = 0;
+
+/// Picks the shard of an event.
+static struct CacheShard* shard_of(unsigned int event_id) {
+  //Spread consecutive ids, which are the common case, over different shards
+  unsigned int hash = event_id * 2654435761u;
+  return &shards[hash % shard_count];
+}
+
+int cache_init(size_t capacity) {
+  if (capacity == 0) return 0;
+
+  shard_count = (capacity + EVENT_CACHE_WAYS - 1) / EVENT_CACHE_WAYS;
+  shards = calloc(shard_count, sizeof(struct CacheShard));
+  if (shards == NULL) {
+    shard_count = 0;
+    return 1;
+  }
+
+  for (size_t i = 0; i < shard_count; i++) pthread_mutex_init(&shards[i].mutex, NULL);
+  return 0;
+}
+
+void cache_destroy(void) {
+  for (size_t i = 0; i < shard_count; i++) pthread_mutex_destroy(&shards[i].mutex);
+  free(shards);
+  shards = NULL;
+  shard_count = 0;
+}
+
+struct Event* cache_lookup(unsigned int event_id) {
+  if (shard_count == 0) {
+    atomic_fetch_add(&misses, 1);
+    return NULL;
+  }
+
+  struct CacheShard* shard = shard_of(event_id);
+  struct Event* event = NULL;
+
+  pthread_mutex_lock(&shard->mutex);
+  for (size_t i = 0; i < EVENT_CACHE_WAYS; i++) {
+    struct CacheEntry* entry = &shard->entries[i];
+    if (entry->event != NULL && entry->event_id == event_id) {
+      entry->referenced = 1;
+      event = entry->event;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&shard->mutex);
+
+  atomic_fetch_add(event != NULL ? &hits : &misses, 1);
+  return event;
+}
+
+void cache_insert(unsigned int event_id, struct Event* event) {
+  if (shard_count == 0) return;
+
+  struct CacheShard* shard = shard_of(event_id);
+  pthread_mutex_lock(&shard->mutex);
+
+  //Another thread may have missed on the same event and cached it already
+  for (size_t i = 0; i < EVENT_CACHE_WAYS; i++) {
+    if (shard->entries[i].event != NULL && shard->entries[i].event_id == event_id) {
+      pthread_mutex_unlock(&shard->mutex);
+      return;
+    }
+  }
+
+  //Advance the hand, giving referenced entries a second chance, until a free or unused entry comes up
+  struct CacheEntry* victim;
+  while (1) {
+    victim = &shard->entries[shard->hand];
+    shard->hand = (shard->hand + 1) % EVENT_CACHE_WAYS;
+    if (victim->event == NULL || !victim->referenced) break;
+    victim->referenced = 0;
+  }
+
+  victim->event_id = event_id;
+  victim->event = event;
+  victim->referenced = 0;
+  pthread_mutex_unlock(&shard->mutex);
+}
+
+void cache_stats(unsigned long* hit_count, unsigned long* miss_count) {
+  *hit_count = atomic_load(&hits);
+  *miss_count = atomic_load(&misses);
+}
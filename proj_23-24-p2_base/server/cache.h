@@ -0,0 +1,37 @@
+#ifndef SERVER_CACHE_H
+#define SERVER_CACHE_H
+
+#include <stddef.h>
+
+#define EVENT_CACHE_SIZE 256  // Default number of events kept in the cache
+#define EVENT_CACHE_WAYS 8    // Entries per shard, scanned on every lookup
+
+struct Event;
+
+/// Cache of recently used events in front of the costly state access.
+///
+/// The cache is split into shards of EVENT_CACHE_WAYS entries, each with its own mutex, and an event can only live in
+/// the shard its id hashes to. Within a shard, entries are replaced with the CLOCK algorithm: a hit sets the
+/// entry's reference bit, and the eviction hand clears bits until it finds an entry that was not used since it last
+/// passed. Events are never removed while the server runs, so cached pointers stay valid.
+
+/// Sets up the cache.
+/// @param capacity Number of events to cache, rounded up to whole shards. 0 disables the cache.
+/// @return 0 if the cache was set up, 1 otherwise.
+int cache_init(size_t capacity);
+
+/// Frees the cache.
+void cache_destroy(void);
+
+/// Looks an event up, counting a hit or a miss.
+/// @param event_id Id of the event.
+/// @return The cached event, NULL on a miss.
+struct Event* cache_lookup(unsigned int event_id);
+
+/// Adds an event fetched from the state, evicting another one of its shard if it is full.
+void cache_insert(unsigned int event_id, struct Event* event);
+
+/// Gets the hit and miss counters.
+void cache_stats(unsigned long* hit_count, unsigned long* miss_count);
+
+#endif  // SERVER_CACHE_H
@@ -3,6 +3,68 @@
 #include <pthread.h>
 #include <stdlib.h>
 
+#include "render.h"
+
+/// Allocates an index node with no successors.
+/// @return The node, NULL on failure.
+static struct IndexNode* index_node_new(unsigned int id, struct Event* event, int levels) {
+  struct IndexNode* node = malloc(sizeof(struct IndexNode) + (size_t)levels * sizeof(_Atomic(struct IndexNode*)));
+  if (!node) return NULL;
+
+  node->id = id;
+  node->event = event;
+  node->levels = levels;
+  for (int level = 0; level < levels; level++) atomic_init(&node->next[level], NULL);
+  return node;
+}
+
+/// Picks the number of levels of a new index node, each level above the first with probability 1/4.
+static int index_random_levels(struct EventList* list) {
+  //xorshift32, two bits per level
+  unsigned int x = list->index_seed;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  list->index_seed = x;
+
+  int levels = 1;
+  while (levels < INDEX_MAX_LEVEL && (x & 3) == 0) {
+    levels++;
+    x >>= 2;
+  }
+  return levels;
+}
+
+/// Adds an event to the index, after any event with the same id.
+/// @note The list rwl must be held for writing, readers may be walking the index meanwhile.
+/// @return 0 if the event was indexed, 1 otherwise.
+static int index_insert(struct EventList* list, struct Event* event) {
+  //Find the last node before the event at every level, only writers change the links so no ordering is needed
+  struct IndexNode* preds[INDEX_MAX_LEVEL];
+  struct IndexNode* node = list->index;
+  for (int level = INDEX_MAX_LEVEL - 1; level >= 0; level--) {
+    struct IndexNode* next;
+    while ((next = atomic_load_explicit(&node->next[level], memory_order_relaxed)) != NULL && next->id <= event->id) {
+      node = next;
+    }
+    preds[level] = node;
+  }
+
+  struct IndexNode* new_node = index_node_new(event->id, event, index_random_levels(list));
+  if (!new_node) return 1;
+
+  //Link the node fully before publishing it, bottom up so it is found at level 0 as soon as it is anywhere
+  for (int level = 0; level < new_node->levels; level++) {
+    struct IndexNode* next = atomic_load_explicit(&preds[level]->next[level], memory_order_relaxed);
+    atomic_store_explicit(&new_node->next[level], next, memory_order_relaxed);
+  }
+  for (int level = 0; level < new_node->levels; level++) {
+    atomic_store_explicit(&preds[level]->next[level], new_node, memory_order_release);
+  }
+
+  return 0;
+}
+
 struct EventList* create_list() {
   struct EventList* list = (struct EventList*)malloc(sizeof(struct EventList));
   list->size = 0;
@@ -13,17 +75,32 @@ struct EventList* create_list() {
   }
   list->head = NULL;
   list->tail = NULL;
+  slab_init(&list->event_slab, sizeof(struct Event));
+  slab_init(&list->node_slab, sizeof(struct ListNode));
+
+  list->index = index_node_new(0, NULL, INDEX_MAX_LEVEL);
+  list->index_seed = 2463534242u;
+  if (!list->index) {
+    pthread_rwlock_destroy(&list->rwl);
+    free(list);
+    return NULL;
+  }
   return list;
 }
 
 int append_to_list(struct EventList* list, struct Event* event) {
   if (!list) return 1;
   list->size++;
-  struct ListNode* new_node = (struct ListNode*)malloc(sizeof(struct ListNode));
+  struct ListNode* new_node = slab_alloc(&list->node_slab);
   if (!new_node) return 1;
 
   new_node->event = event;
   new_node->next = NULL;
+  if (index_insert(list, event) != 0) {
+    slab_free(&list->node_slab, new_node);
+    list->size--;
+    return 1;
+  }
 
   if (list->head == NULL) {
     list->head = new_node;
@@ -38,8 +115,11 @@ int append_to_list(struct EventList* list, struct Event* event) {
 
 static void free_event(struct Event* event) {
   if (!event) return;
-  free(event->data);
-  free(event);
+  seat_grid_destroy(&event->seats);
+  free(event->res_index);
+  free(event->res_seats);
+  free(event->row_free);
+  snapshot_release(event->snapshot);
 }
 
 void free_list(struct EventList* list) {
@@ -51,12 +131,31 @@ void free_list(struct EventList* list) {
     current = current->next;
 
     free_event(temp->event);
-    free(temp);
   }
 
+  struct IndexNode* node = list->index;
+  while (node) {
+    struct IndexNode* next = atomic_load_explicit(&node->next[0], memory_order_relaxed);
+    free(node);
+    node = next;
+  }
+
+  //Events and nodes go away with their slabs
+  slab_destroy(&list->event_slab);
+  slab_destroy(&list->node_slab);
   free(list);
 }
 
+void snapshot_release(struct Snapshot* snapshot) {
+  if (snapshot != NULL && atomic_fetch_sub(&snapshot->refs, 1) == 1) {
+    render_free(snapshot->text, snapshot->text_parts);
+    for (size_t i = 0; i < snapshot->tile_count; i++) {
+      if (snapshot->tiles[i].iov_base != seat_zero_tile()) free(snapshot->tiles[i].iov_base);
+    }
+    free(snapshot);
+  }
+}
+
 struct Event* get_event(struct EventList* list, unsigned int event_id, struct ListNode* from, struct ListNode* to) {
   if (!list || !from || !to) return NULL;
   struct ListNode* current = from;
@@ -73,3 +172,27 @@ struct Event* get_event(struct EventList* list, unsigned int event_id, struct Li
     current = current->next;
   }
 }
+
+struct IndexNode* index_seek(struct EventList* list, unsigned int event_id) {
+  if (!list) return NULL;
+
+  //Walk down the levels, stopping before the first node not below event_id
+  struct IndexNode* node = list->index;
+  for (int level = INDEX_MAX_LEVEL - 1; level >= 0; level--) {
+    struct IndexNode* next;
+    while ((next = atomic_load_explicit(&node->next[level], memory_order_acquire)) != NULL && next->id < event_id) {
+      node = next;
+    }
+  }
+
+  return atomic_load_explicit(&node->next[0], memory_order_acquire);
+}
+
+struct IndexNode* index_next(struct IndexNode* node) {
+  return atomic_load_explicit(&node->next[0], memory_order_acquire);
+}
+
+struct Event* index_find(struct EventList* list, unsigned int event_id) {
+  struct IndexNode* node = index_seek(list, event_id);
+  return node != NULL && node->id == event_id ? node->event : NULL;
+}
@@ -1,9 +1,38 @@
 #ifndef SERVER_EVENT_LIST_H
 #define SERVER_EVENT_LIST_H
 
+#include <stdatomic.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <pthread.h>
+#include <sys/uio.h>
+
+#include "memory.h"
+#include "seats.h"
+
+#define INDEX_MAX_LEVEL 16  // Levels of the event index, enough for 4^16 events
+
+/// Entry of the reservation index, describing where a reservation's seats live in the seat arena.
+struct Reservation {
+  size_t offset;  /// Offset of the first seat of the reservation in the seat arena.
+  size_t count;   /// Number of seats held by the reservation, 0 once cancelled.
+};
+
+/// Immutable copy of the seats of an event, shared by every SHOW until the event changes.
+/// It is freed by the last holder, so it can outlive both the event state it was taken from and the event.
+struct Snapshot {
+  atomic_uint refs;       /// Number of holders, including the event while the snapshot is current.
+  unsigned long version;  /// Version of the event the seats were copied from, checked before the snapshot is reused.
+  size_t rows;            /// Number of rows.
+  size_t cols;            /// Number of columns.
+  unsigned int width;     /// Cell width of the grid the seats were copied from, in bytes, bounding their values.
+  struct iovec* text;     /// Seats rendered as text in blocks of rows, built by the first text SHOW of the version,
+                          /// NULL until then.
+  size_t text_parts;      /// Number of blocks of text.
+  size_t tile_count;      /// Number of tiles.
+  struct iovec tiles[];   /// Reservations for each of the rows * cols seats, one tile of SEAT_TILE_SEATS per entry, the
+                          /// last one cut to the seats left. Tiles without reservations share seat_zero_tile.
+};
 
 struct Event {
   unsigned int id;            /// Event id
@@ -12,8 +41,23 @@ struct Event {
   size_t cols;  /// Number of columns.
   size_t rows;  /// Number of rows.
 
-  unsigned int* data;     /// Array of size rows * cols with the reservations for each seat.
+  struct SeatGrid seats;  /// Reservations for each of the rows * cols seats.
   pthread_mutex_t mutex;  // Mutex to protect the event
+
+  struct Reservation* res_index;  /// Array indexed by reservation id - 1, with res_index_cap entries.
+  size_t res_index_cap;           /// Capacity of res_index.
+  void* res_seats;                /// Arena with the seat indices of every reservation, stored contiguously.
+  unsigned int res_seat_width;    /// Bytes per entry of res_seats, see seat_index_width.
+  size_t res_seats_len;           /// Number of used entries in res_seats.
+  size_t res_seats_cap;           /// Capacity of res_seats.
+  size_t res_seats_dead;          /// Entries of res_seats belonging to cancelled reservations.
+
+  size_t* row_free;           /// Free seats of each of the rows, kept up to date by every seat change.
+  size_t sold;                /// Seats held by a reservation.
+  unsigned int active;        /// Reservations holding seats, cancelled ones excluded.
+
+  unsigned long version;      /// Incremented whenever the seats change.
+  struct Snapshot* snapshot;  /// Snapshot of the current version, NULL until shown or after the seats change.
 };
 
 struct ListNode {
@@ -21,19 +65,34 @@ struct ListNode {
   struct ListNode* next;
 };
 
+/// Node of the ordered index over event ids, a skiplist walked without locks.
+/// Nodes are only added, by writers holding the list rwl, and are published with release stores once built.
+struct IndexNode {
+  unsigned int id;                      /// Id of the event.
+  struct Event* event;                  /// Indexed event, NULL for the head of the index.
+  int levels;                           /// Number of entries of next.
+  _Atomic(struct IndexNode*) next[];    /// Next node at each level, NULL at the end.
+};
+
 // Linked list structure
 struct EventList {
   struct ListNode* head;  // Head of the list
   struct ListNode* tail;  // Tail of the list
   int size;               // Size of the list
   pthread_rwlock_t rwl;   // Mutex to protect the list
+
+  struct Slab event_slab;  // Events of the list, allocated while holding rwl for writing
+  struct Slab node_slab;   // Nodes of the list, allocated while holding rwl for writing
+
+  struct IndexNode* index;  // Head of the index over event ids, with INDEX_MAX_LEVEL levels
+  unsigned int index_seed;  // Picks the levels of new index nodes, used while holding rwl for writing
 };
 
 /// Creates a new event list.
 /// @return Newly created event list, NULL on failure
 struct EventList* create_list();
 
-/// Appends a new node to the list.
+/// Appends a new node to the list, and adds the event to the index.
 /// @param list Event list to be modified.
 /// @param data Event to be stored in the new node.
 /// @return 0 if the node was appended successfully, 1 otherwise.
@@ -44,6 +103,10 @@ int append_to_list(struct EventList* list, struct Event* data);
 /// @return 0 if the node was removed successfully, 1 otherwise.
 void free_list(struct EventList* list);
 
+/// Drops a reference to a snapshot, freeing it with the last one.
+/// @param snapshot Snapshot to release, may be NULL.
+void snapshot_release(struct Snapshot* snapshot);
+
 /// Retrieves an event in the list.
 /// @param list Event list to be searched
 /// @param event_id Event id.
@@ -52,4 +115,21 @@ void free_list(struct EventList* list);
 /// @return Pointer to the event if found, NULL otherwise.
 struct Event* get_event(struct EventList* list, unsigned int event_id, struct ListNode* from, struct ListNode* to);
 
+/// Finds the first indexed event with an id not below the given one.
+/// @note Does not need the list rwl: events are never removed, and added ones are seen once fully built.
+/// @param list Event list to be searched.
+/// @param event_id Smallest event id wanted.
+/// @return Index node of the event, NULL if every event has a smaller id.
+struct IndexNode* index_seek(struct EventList* list, unsigned int event_id);
+
+/// Gets the node following another in id order.
+/// @return Next index node, NULL at the end of the index.
+struct IndexNode* index_next(struct IndexNode* node);
+
+/// Retrieves an event through the index, in logarithmic time and without the list rwl.
+/// @param list Event list to be searched.
+/// @param event_id Event id.
+/// @return Pointer to the event if found, NULL otherwise.
+struct Event* index_find(struct EventList* list, unsigned int event_id);
+
 #endif  // SERVER_EVENT_LIST_H
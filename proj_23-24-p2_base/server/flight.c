@@ -0,0 +1,83 @@
+#include "flight.h"
+
+#include <pthread.h>
+#include <stddef.h>
+
+/// Lookup in progress.
+struct Flight {
+  unsigned int event_id;  /// Id of the event being looked up.
+  struct Event* event;    /// Result, valid once landed is set.
+  int landed;             /// Whether the leader published the result.
+  unsigned int waiting;   /// Passengers that have not read the result yet.
+  pthread_cond_t cond;    /// Signalled when the flight lands and when the last passenger leaves.
+  struct Flight* next;    /// Next flight in the air.
+};
+
+//Few flights are in the air at once, at most one per session, so a list is enough
+static struct Flight* flights = NULL;
+static pthread_mutex_t flights_mutex = PTHREAD_MUTEX_INITIALIZER;
+static unsigned long joined = 0;
+
+//Flight led by the calling thread, a thread leads at most one at a time
+static _Thread_local struct Flight own_flight;
+
+int flight_board(unsigned int event_id, struct Event** event) {
+  pthread_mutex_lock(&flights_mutex);
+
+  for (struct Flight* flight = flights; flight != NULL; flight = flight->next) {
+    if (flight->event_id != event_id) continue;
+
+    //Join the flight and wait for it to land
+    flight->waiting++;
+    joined++;
+    while (!flight->landed) pthread_cond_wait(&flight->cond, &flights_mutex);
+    *event = flight->event;
+
+    //The leader waits for the last passenger before reusing its flight
+    if (--flight->waiting == 0) pthread_cond_broadcast(&flight->cond);
+    pthread_mutex_unlock(&flights_mutex);
+    return 0;
+  }
+
+  //Nobody is looking this event up, lead the lookup
+  struct Flight* flight = &own_flight;
+  flight->event_id = event_id;
+  flight->event = NULL;
+  flight->landed = 0;
+  flight->waiting = 0;
+  pthread_cond_init(&flight->cond, NULL);
+  flight->next = flights;
+  flights = flight;
+
+  pthread_mutex_unlock(&flights_mutex);
+  return 1;
+}
+
+void flight_land(struct Event* event) {
+  struct Flight* flight = &own_flight;
+
+  pthread_mutex_lock(&flights_mutex);
+
+  //Take the flight out of the air so new lookups start their own
+  for (struct Flight** link = &flights; *link != NULL; link = &(*link)->next) {
+    if (*link == flight) {
+      *link = flight->next;
+      break;
+    }
+  }
+
+  flight->event = event;
+  flight->landed = 1;
+  pthread_cond_broadcast(&flight->cond);
+  while (flight->waiting > 0) pthread_cond_wait(&flight->cond, &flights_mutex);
+
+  pthread_mutex_unlock(&flights_mutex);
+  pthread_cond_destroy(&flight->cond);
+}
+
+unsigned long flight_stats(void) {
+  pthread_mutex_lock(&flights_mutex);
+  unsigned long count = joined;
+  pthread_mutex_unlock(&flights_mutex);
+  return count;
+}
@@ -0,0 +1,26 @@
+#ifndef SERVER_FLIGHT_H
+#define SERVER_FLIGHT_H
+
+struct Event;
+
+/// Single-flight coalescing of concurrent lookups of the same event.
+///
+/// The first session to look an event up leads the flight: it pays the costly state access and publishes the
+/// result. Sessions asking for the same id while the flight is in the air join it and wait for that result instead
+/// of starting an access of their own. Each thread owns the storage of the one flight it can lead, and waits for every
+/// passenger to leave before reusing it.
+
+/// Joins the lookup of an event, or starts one if none is in flight.
+/// @param event_id Id of the event.
+/// @param event Set to the result of the lookup when joining a flight.
+/// @return 1 if the caller leads the lookup and must end it with flight_land, 0 if *event holds the result.
+int flight_board(unsigned int event_id, struct Event** event);
+
+/// Publishes the result of the lookup led by the caller and wakes the sessions that joined it.
+/// @param event Result of the lookup, NULL if the event does not exist.
+void flight_land(struct Event* event);
+
+/// Gets the number of lookups that joined a flight instead of accessing the state.
+unsigned long flight_stats(void);
+
+#endif  // SERVER_FLIGHT_H
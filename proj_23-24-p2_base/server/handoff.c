@@ -0,0 +1,152 @@
+#define _GNU_SOURCE  // memfd_create(), accept4()
+#include "handoff.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/// Builds the address of a socket of a registration FIFO.
+/// @return 0 if the path fits, 1 otherwise.
+static int socket_address(const char* fifo_path, const char* suffix, struct sockaddr_un* addr) {
+  memset(addr, 0, sizeof(*addr));
+  addr->sun_family = AF_UNIX;
+  int len = snprintf(addr->sun_path, sizeof(addr->sun_path), "%s%s", fifo_path, suffix);
+  return len < 0 || (size_t)len >= sizeof(addr->sun_path);
+}
+
+int handoff_listen(const char* fifo_path, const char* suffix) {
+  struct sockaddr_un addr;
+  if (socket_address(fifo_path, suffix, &addr)) return -1;
+
+  int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (sock == -1) return -1;
+
+  unlink(addr.sun_path);
+  if (bind(sock, (struct sockaddr*)&addr, sizeof(addr)) == -1 || listen(sock, 1) == -1) {
+    close(sock);
+    return -1;
+  }
+  return sock;
+}
+
+int handoff_accept(int listener) {
+  int sock;
+  while ((sock = accept4(listener, NULL, NULL, SOCK_CLOEXEC)) == -1 && errno == EINTR) continue;
+  return sock;
+}
+
+void handoff_unlink(const char* fifo_path, const char* suffix) {
+  struct sockaddr_un addr;
+  if (socket_address(fifo_path, suffix, &addr) == 0) unlink(addr.sun_path);
+}
+
+int handoff_connect(const char* fifo_path, const char* suffix) {
+  struct sockaddr_un addr;
+  if (socket_address(fifo_path, suffix, &addr)) return -1;
+
+  int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (sock == -1) return -1;
+
+  if (connect(sock, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+    close(sock);
+    return -1;
+  }
+  return sock;
+}
+
+int handoff_send(int sock, const struct HandoffMessage* msg, const int* fds, int fd_count, const void* pending) {
+  //Descriptors ride along the header, the pending bytes follow as plain data
+  union {
+    char buf[CMSG_SPACE(sizeof(int) * HANDOFF_MAX_FDS)];
+    struct cmsghdr align;
+  } control;
+  memset(&control, 0, sizeof(control));
+
+  struct iovec iov = {(void*)msg, sizeof(*msg)};
+  struct msghdr hdr = {.msg_iov = &iov, .msg_iovlen = 1};
+  if (fd_count > 0) {
+    hdr.msg_control = control.buf;
+    hdr.msg_controllen = CMSG_SPACE(sizeof(int) * (size_t)fd_count);
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&hdr);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * (size_t)fd_count);
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * (size_t)fd_count);
+  }
+
+  ssize_t sent;
+  while ((sent = sendmsg(sock, &hdr, MSG_NOSIGNAL)) == -1 && errno == EINTR) continue;
+  if (sent != (ssize_t)sizeof(*msg)) return 1;
+
+  const char* data = pending;
+  size_t left = msg->pending_len;
+  while (left > 0) {
+    ssize_t ret = send(sock, data, left, MSG_NOSIGNAL);
+    if (ret == -1 && errno == EINTR) continue;
+    if (ret <= 0) return 1;
+
+    data += ret;
+    left -= (size_t)ret;
+  }
+  return 0;
+}
+
+/// Reads exactly len bytes from the socket.
+/// @return 0 if the bytes were read, 1 on error or end of file.
+static int recv_all(int sock, void* buf, size_t len) {
+  char* dst = buf;
+  while (len > 0) {
+    ssize_t ret = recv(sock, dst, len, 0);
+    if (ret == -1 && errno == EINTR) continue;
+    if (ret <= 0) return 1;
+
+    dst += ret;
+    len -= (size_t)ret;
+  }
+  return 0;
+}
+
+int handoff_recv(int sock, struct HandoffMessage* msg, int* fds, int* fd_count, char** pending) {
+  union {
+    char buf[CMSG_SPACE(sizeof(int) * HANDOFF_MAX_FDS)];
+    struct cmsghdr align;
+  } control;
+
+  struct iovec iov = {msg, sizeof(*msg)};
+  struct msghdr hdr = {.msg_iov = &iov, .msg_iovlen = 1, .msg_control = control.buf, .msg_controllen = sizeof(control)};
+
+  ssize_t ret;
+  while ((ret = recvmsg(sock, &hdr, MSG_CMSG_CLOEXEC)) == -1 && errno == EINTR) continue;
+  if (ret <= 0) return 1;
+
+  *fd_count = 0;
+  for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&hdr); cmsg != NULL; cmsg = CMSG_NXTHDR(&hdr, cmsg)) {
+    if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) continue;
+
+    size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    if (count > HANDOFF_MAX_FDS) count = HANDOFF_MAX_FDS;
+    memcpy(fds, CMSG_DATA(cmsg), sizeof(int) * count);
+    *fd_count = (int)count;
+  }
+
+  //The header itself may have been split
+  if ((size_t)ret < sizeof(*msg) && recv_all(sock, (char*)msg + ret, sizeof(*msg) - (size_t)ret) != 0) return 1;
+
+  *pending = NULL;
+  if (msg->pending_len == 0) return 0;
+
+  *pending = malloc(msg->pending_len);
+  if (*pending == NULL || recv_all(sock, *pending, msg->pending_len) != 0) {
+    free(*pending);
+    *pending = NULL;
+    return 1;
+  }
+  return 0;
+}
+
+int handoff_state_file(void) { return memfd_create("ems-state", MFD_CLOEXEC); }
@@ -0,0 +1,71 @@
+#ifndef SERVER_HANDOFF_H
+#define SERVER_HANDOFF_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// Hot restart: a new server takes over the registration FIFO and the events of a running one.
+///
+/// Every server listens on a Unix socket next to its registration FIFO. A server started in takeover mode connects
+/// to it and receives, as a HANDOFF_STATE message, the registration FIFO and a memory file holding the exported
+/// events (see ems_export). From then on the new server accepts clients. The old one stops accepting, and hands over
+/// each of its open sessions as a HANDOFF_SESSION message when the client sends its next command: the client pipes
+/// travel with the bytes already read from them, and the new server carries on from there. The old server exits
+/// once it has no sessions left, closing the socket.
+
+#define HANDOFF_SOCKET_SUFFIX ".handoff"  // Appended to the registration FIFO path to name the socket
+#define HANDOFF_MAX_FDS 2                 // File descriptors sent along a single message
+#define HANDOFF_KICK_INTERVAL_NS 1000000  // Delay before kicking an acceptor that missed the previous kick
+
+/// Kinds of handoff messages.
+enum HandoffKind {
+  HANDOFF_STATE = 1,    /// Carries the registration FIFO and the exported state, in that order.
+  HANDOFF_SESSION = 2,  /// Carries the request and response pipes of a session, in that order.
+};
+
+/// Header of a handoff message, followed by pending_len bytes.
+struct HandoffMessage {
+  char kind;             /// HandoffKind.
+  uint64_t pending_len;  /// Bytes of request already read from the session, to be handled first.
+} __attribute__((packed));
+
+/// Listens on the socket of a registration FIFO, replacing any stale one.
+/// @param fifo_path Path of the registration FIFO.
+/// @param suffix Appended to fifo_path to name the socket, HANDOFF_SOCKET_SUFFIX for hot restarts.
+/// @return Listening socket, -1 on failure.
+int handoff_listen(const char* fifo_path, const char* suffix);
+
+/// Waits for another server to connect.
+/// @param listener Socket returned by handoff_listen.
+/// @return Connected socket, -1 on failure.
+int handoff_accept(int listener);
+
+/// Removes the socket of a server shutting down without being taken over.
+/// @param fifo_path Path of the registration FIFO.
+/// @param suffix Suffix the socket was created with.
+void handoff_unlink(const char* fifo_path, const char* suffix);
+
+/// Connects to the socket of another server.
+/// @param fifo_path Path of the registration FIFO of that server.
+/// @param suffix Suffix the socket was created with.
+/// @return Connected socket, -1 on failure.
+int handoff_connect(const char* fifo_path, const char* suffix);
+
+/// Sends a message with file descriptors attached.
+/// @param fds File descriptors to pass, their count given by fd_count (up to HANDOFF_MAX_FDS).
+/// @param pending msg->pending_len bytes sent after the header.
+/// @return 0 if the message was sent, 1 otherwise.
+int handoff_send(int sock, const struct HandoffMessage* msg, const int* fds, int fd_count, const void* pending);
+
+/// Receives a message and the file descriptors attached to it.
+/// @param fds Array of HANDOFF_MAX_FDS entries, filled with the received descriptors.
+/// @param fd_count Set to the number of descriptors received.
+/// @param pending Set to a malloc'd copy of the bytes following the header, NULL if there are none.
+/// @return 0 if a message was received, 1 on error or once the peer closed the socket.
+int handoff_recv(int sock, struct HandoffMessage* msg, int* fds, int* fd_count, char** pending);
+
+/// Creates an anonymous memory file to export the state to.
+/// @return File descriptor, -1 on failure.
+int handoff_state_file(void);
+
+#endif  // SERVER_HANDOFF_H
@@ -1,55 +1,162 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <poll.h>
 #include <pthread.h>
 #include <semaphore.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/ioctl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "common/constants.h"
 #include "common/io.h"
 #include "common/messages.h"
+#include "common/partition.h"
+#include "affinity.h"
+#include "arena.h"
+#include "cache.h"
 #include "eventlist.h"
+#include "flight.h"
+#include "handoff.h"
+#include "memory.h"
+#include "notify.h"
 #include "operations.h"
-
-#define BUFFER_SIZE 4
+#include "render.h"
+#include "replication.h"
+#include "session.h"
+#include "trace.h"
 
 //===Internal function declarations===
 int parse_args(int argc, char* argv[]);
 int init_server();
 void accept_client();
-void handle_client(unsigned int session_id, int req_fd, int resp_fd);
+void reject_client(setup_request request, unsigned int retry_after_ms);
+void queue_rejection(setup_request request, unsigned int retry_after_ms);
+void* reject_thread_main(void* arg);
+void handle_client(struct Session* session, int is_new);
+int replica_too_stale();
 void close_server();
 void handle_SIGUSR1(int signum);
+void handle_SIGUSR2(int signum);
 void handle_SIGINT(int signum);
-int process_command(int req_fd, int resp_fd);
-setup_request buffer_get();
-void buffer_add(setup_request request);
+void release_shown_snapshot(struct Session* session);
+void park_shown_snapshot(struct Session* session);
+int process_command(struct Session* session);
+void rate_limit_reset(unsigned int session_id);
+void rate_limit_wait(unsigned int session_id);
+struct PendingClient buffer_get();
+int buffer_try_add(setup_request request, unsigned int* retry_after_ms);
+void buffer_add_resumed(struct PendingClient client);
+void buffer_session_done(double duration_ms);
+int take_over_server();
+void wait_handoff();
+void drain_server();
+void hand_session_over(struct Session* session, const core_request* core);
 void list_events();
 
 //===Parsed arguments===
 unsigned int state_access_delay_us;
 char* FIFO_path;
+int admission_queue_size = ADMISSION_QUEUE_SIZE;
+unsigned int admission_max_wait_ms = ADMISSION_MAX_WAIT_MS;
+double session_rate_limit = SESSION_RATE_LIMIT;
+double session_rate_burst = SESSION_RATE_BURST;
+char* trace_path = NULL;
+unsigned int notify_window_ms = NOTIFY_WINDOW_MS;
+size_t event_cache_size = EVENT_CACHE_SIZE;
+int use_io_uring = 0;
+int take_over = 0;
+int serve_replicas = 0;
+char* primary_path = NULL;
+unsigned int partition_index = 0;
+unsigned int partition_count = 1;
 
 //===Server state and flags===
 int registerFIFO;
 volatile char server_should_quit;
 volatile char show_flag = 0;
 
+//Snapshot of the last SHOW of each worker, still referenced by the response pipe until the client reads it
+_Thread_local struct Snapshot* shown_snapshot = NULL;
+
+//Snapshot of a SHOW left in the response pipe of a session that ended before its client read it
+struct DrainingSnapshot {
+  struct Snapshot* snapshot;      // Snapshot still referenced by the pipe
+  int pipe_fd;                    // Copy of the response pipe, to check whether it was read
+  struct DrainingSnapshot* next;  // Next snapshot of the worker
+};
+
+//Snapshots of each worker left in the pipes of ended sessions
+_Thread_local struct DrainingSnapshot* draining_snapshots = NULL;
+
+//Memory of the request being handled by each worker, reset after each command
+_Thread_local struct Arena request_arena;
+
+//Staleness the session of each worker accepts from a replica, unbounded until it sends MSG_STALENESS
+_Thread_local unsigned int session_max_staleness_ms = UINT_MAX;
+
 //===Producer consumer buffer===
+/// Client waiting for a worker.
+struct PendingClient {
+  setup_request setup;  // Pipe names sent by a new client
+  int req_fd;           // Request pipe of a session resumed from the previous server, -1 for new clients
+  int resp_fd;          // Response pipe of a resumed session
+  char* carried;        // Request bytes of a resumed session the previous server had already read
+  size_t carried_len;   // Size of carried
+};
+
 pthread_t worker_threads[MAX_SESSION_COUNT];
 unsigned int thread_args[MAX_SESSION_COUNT];
-setup_request buffer[BUFFER_SIZE];
+struct PendingClient* buffer;
+int buffer_size;
 int in = 0;
 int out = 0;
+int active_sessions = 0;
+double avg_session_ms = 0;
 pthread_mutex_t buffer_mutex;
 pthread_cond_t buffer_not_full;
 pthread_cond_t buffer_not_empty;
+pthread_cond_t sessions_done;
+
+//===Rejected clients, answered by their own thread so the acceptor never waits on a client===
+struct Rejection {
+  setup_request request;        // Setup request turned away
+  unsigned int retry_after_ms;  // Retry delay suggested to the client
+};
+
+pthread_t reject_thread;
+struct Rejection rejections[REJECT_QUEUE_SIZE];
+int reject_in = 0;
+int reject_out = 0;
+pthread_mutex_t reject_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t reject_cond = PTHREAD_COND_INITIALIZER;
+pthread_cond_t reject_room = PTHREAD_COND_INITIALIZER;
+
+//===Hot restart===
+pthread_t main_thread;
+pthread_t handoff_thread;
+pthread_t resume_thread;
+int handoff_listener = -1;    // Socket the next server connects to in order to take over
+int successor_socket = -1;    // Connection to the server that took over
+int predecessor_socket = -1;  // Connection to the server taken over from, until its last session is resumed
+volatile char handoff_started = 0;  // A server is taking over, the acceptor must stop
+volatile char handed_off = 0;       // The state belongs to the server that took over
+int acceptor_stopped = 0;
+pthread_mutex_t handoff_mutex = PTHREAD_MUTEX_INITIALIZER;  // Protects acceptor_stopped and successor_socket
+pthread_cond_t handoff_cond = PTHREAD_COND_INITIALIZER;
+pthread_rwlock_t handoff_gate = PTHREAD_RWLOCK_INITIALIZER;  // Held by commands for reading, by the handoff for writing
+
+//===Per-session token buckets===
+struct TokenBucket {
+  double tokens;              // Commands the session may still issue right away
+  struct timespec last_fill;  // Last time tokens were added
+} session_buckets[MAX_SESSION_COUNT];
 
 
 
@@ -61,7 +168,13 @@ int main(int argc, char* argv[]) {
   if (ret) return ret;
 
   //Main execution loop
-  while (!server_should_quit) {
+  while (!server_should_quit && !handed_off) {
+    //Stop reading the registration FIFO while a server takes over, it owns it if the handoff succeeds
+    if (handoff_started) {
+      wait_handoff();
+      continue;
+    }
+
     accept_client();
 
     //Print requested data if flag is set
@@ -73,9 +186,17 @@ int main(int argc, char* argv[]) {
       write(1, "Listing all events:\n", 20);
 
       list_events();
+
+      unsigned long hits, misses;
+      cache_stats(&hits, &misses);
+      printf("Event cache: %lu hits, %lu misses, %lu coalesced\n", hits, misses, flight_stats());
+      fflush(stdout);
     }
   }
 
+  //After a hot restart, sessions still open here move to the new server one by one
+  if (handed_off) drain_server();
+
   close_server();
 }
 
@@ -83,46 +204,264 @@ void* worker_thread_main(void* arg) {
   //Get session id (=thread id) from arg
   unsigned int session_id = *((unsigned int*)arg);
 
-  //Block SIGUSR1
+  //Block SIGUSR1 and SIGUSR2
   sigset_t sigset;
   sigemptyset(&sigset);
   sigaddset(&sigset, SIGUSR1);
+  sigaddset(&sigset, SIGUSR2);
   pthread_sigmask(SIG_BLOCK, &sigset, NULL);
 
+  //Per-worker buffers are allocated and first touched here, on the worker's own CPU (and NUMA node) when pinned
+  arena_init(&request_arena);
+
+  //Set up session I/O, falling back to plain read/write if io_uring is unavailable
+  struct Session session;
+  if (session_init(&session, session_id, use_io_uring) != 0) {
+    fprintf(stderr, "Error allocating memory for session\n");
+    exit(1);
+  }
+  if (use_io_uring && !session.use_ring && session_id == 0) {
+    fprintf(stderr, "io_uring unavailable, using plain pipe I/O\n");
+  }
+
   //Work loop
   while (1) {
     //Fetch request to processs
-    setup_request request = buffer_get();
+    struct PendingClient client = buffer_get();
     
-    //Open provided pipes
-    int req_fd, resp_fd;
-    if ((req_fd = open(request.request_fifo_name, O_RDONLY)) == -1) {
+    //Open provided pipes, resumed sessions come with theirs
+    int req_fd = client.req_fd, resp_fd = client.resp_fd;
+    int is_new = req_fd == -1;
+    if (is_new && (req_fd = open(client.setup.request_fifo_name, O_RDONLY)) == -1) {
       fprintf(stderr, "Error opening request pipe\n");
       exit(1);
     }
-    if ((resp_fd = open(request.response_fifo_name, O_WRONLY)) == -1) {
+    if (is_new && (resp_fd = open(client.setup.response_fifo_name, O_WRONLY)) == -1) {
       fprintf(stderr, "Error opening response pipe\n");
       exit(1);
     }
 
-    handle_client(session_id, req_fd, resp_fd);
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    session_attach(&session, req_fd, resp_fd);
+    if (!is_new) session_carry(&session, client.carried, client.carried_len);
+    handle_client(&session, is_new);
+
+    //Feed the session duration to admission control
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    buffer_session_done((double)(end.tv_sec - start.tv_sec) * 1e3 + (double)(end.tv_nsec - start.tv_nsec) / 1e6);
+  }
+}
+
+
+void* handoff_thread_main(void* arg) {
+  (void)arg;
+
+  //Block SIGUSR1 and SIGUSR2
+  sigset_t sigset;
+  sigemptyset(&sigset);
+  sigaddset(&sigset, SIGUSR1);
+  sigaddset(&sigset, SIGUSR2);
+  pthread_sigmask(SIG_BLOCK, &sigset, NULL);
+
+  while (1) {
+    //Wait for a server to take over
+    int sock = handoff_accept(handoff_listener);
+    if (sock == -1) {
+      fprintf(stderr, "Error accepting server taking over: %d.\n", errno);
+      return NULL;
+    }
+
+    //Stop the acceptor between two setup messages, kicking it out of its blocking read
+    pthread_mutex_lock(&handoff_mutex);
+    handoff_started = 1;
+    while (!acceptor_stopped) {
+      pthread_kill(main_thread, SIGUSR2);
+
+      struct timespec deadline;
+      clock_gettime(CLOCK_REALTIME, &deadline);
+      deadline.tv_nsec += HANDOFF_KICK_INTERVAL_NS;
+      if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+      }
+      pthread_cond_timedwait(&handoff_cond, &handoff_mutex, &deadline);
+    }
+
+    //Wait for the commands in progress, the ones after see the state is gone and hand their session over
+    pthread_rwlock_wrlock(&handoff_gate);
+
+    int state_fd = handoff_state_file();
+    int ret = state_fd == -1 || ems_export(state_fd) != 0;
+    if (ret == 0) {
+      int fds[] = {registerFIFO, state_fd};
+      struct HandoffMessage msg = {.kind = HANDOFF_STATE, .pending_len = 0};
+      ret = handoff_send(sock, &msg, fds, 2, NULL);
+    }
+    if (state_fd != -1) close(state_fd);
+
+    if (ret == 0) {
+      successor_socket = sock;
+      handed_off = 1;
+    } else {
+      fprintf(stderr, "Failed to hand the server over, resuming\n");
+      close(sock);
+    }
+
+    //Let the acceptor go back to work or drain the server
+    handoff_started = 0;
+    pthread_cond_broadcast(&handoff_cond);
+    pthread_rwlock_unlock(&handoff_gate);
+    pthread_mutex_unlock(&handoff_mutex);
+
+    if (handed_off) break;
   }
+
+  //The next server listens on the same path, leave it in place
+  close(handoff_listener);
+  handoff_listener = -1;
+  return NULL;
+}
+
+void* resume_thread_main(void* arg) {
+  (void)arg;
+
+  //Block SIGUSR1 and SIGUSR2
+  sigset_t sigset;
+  sigemptyset(&sigset);
+  sigaddset(&sigset, SIGUSR1);
+  sigaddset(&sigset, SIGUSR2);
+  pthread_sigmask(SIG_BLOCK, &sigset, NULL);
+
+  //Queue every session the previous server hands over, until it has none left
+  struct HandoffMessage msg;
+  int fds[HANDOFF_MAX_FDS];
+  int fd_count;
+  char* carried;
+  while (handoff_recv(predecessor_socket, &msg, fds, &fd_count, &carried) == 0) {
+    if (msg.kind != HANDOFF_SESSION || fd_count != 2) {
+      fprintf(stderr, "Invalid session handed over\n");
+      for (int i = 0; i < fd_count; i++) close(fds[i]);
+      free(carried);
+      continue;
+    }
+
+    struct PendingClient client = {
+        .req_fd = fds[0], .resp_fd = fds[1], .carried = carried, .carried_len = msg.pending_len};
+    buffer_add_resumed(client);
+  }
+
+  close(predecessor_socket);
+  predecessor_socket = -1;
+  return NULL;
 }
 
 
 //===Server startup===
 int parse_args(int argc, char* argv[]) {
+  char* endptr;
+  unsigned long int value;
+
+  //Parse options
+  int opt;
+  while ((opt = getopt(argc, argv, "q:w:r:b:n:c:a:t:S:p:T:uHRP")) != -1) {
+    if (opt == '?') return 1;
+
+    //Non numeric options
+    if (opt == 't') {
+      trace_path = optarg;
+      continue;
+    }
+    if (opt == 'a') {
+      if (affinity_parse(optarg)) return 1;
+      continue;
+    }
+    if (opt == 'u') {
+      use_io_uring = 1;
+      continue;
+    }
+    if (opt == 'H') {
+      grid_use_hugetlb(1);
+      continue;
+    }
+    if (opt == 'R') {
+      take_over = 1;
+      continue;
+    }
+    if (opt == 'P') {
+      serve_replicas = 1;
+      continue;
+    }
+    if (opt == 'S') {
+      primary_path = optarg;
+      continue;
+    }
+    if (opt == 'p') {
+      if (sscanf(optarg, "%u/%u", &partition_index, &partition_count) != 2 || partition_count == 0 ||
+          partition_count > MAX_CLUSTER_SIZE || partition_index >= partition_count) {
+        fprintf(stderr, "Partition must be index/count, with a count up to %d\n", MAX_CLUSTER_SIZE);
+        return 1;
+      }
+      continue;
+    }
+
+    value = strtoul(optarg, &endptr, 10);
+    if (*endptr != '\0' || value > UINT_MAX) {
+      fprintf(stderr, "Invalid value for -%c: %s\n", opt, optarg);
+      return 1;
+    }
+
+    switch (opt) {
+      case 'q':
+        if (value == 0 || value > INT_MAX - 1) {
+          fprintf(stderr, "Admission queue size must be between 1 and %d\n", INT_MAX - 1);
+          return 1;
+        }
+        admission_queue_size = (int)value;
+        break;
+      case 'w':
+        admission_max_wait_ms = (unsigned int)value;
+        break;
+      case 'r':
+        session_rate_limit = (double)value;
+        break;
+      case 'b':
+        session_rate_burst = value == 0 ? 1 : (double)value;
+        break;
+      case 'n':
+        notify_window_ms = value == 0 ? 1 : (unsigned int)value;
+        break;
+      case 'c':
+        event_cache_size = (size_t)value;
+        break;
+      case 'T':
+        render_set_parallel_min((size_t)value);
+        break;
+      default:
+        return 1;
+    }
+  }
+
   //Error if invalid arguments
-  if (argc < 2 || argc > 3) {
-    fprintf(stderr, "Usage: %s\n <pipe_path> [delay]\n", argv[0]);
+  if (argc - optind < 1 || argc - optind > 2) {
+    fprintf(stderr,
+            "Usage: %s [-q queue_size] [-w max_wait_ms] [-r rate] [-b burst] [-n notify_window_ms] [-c cache_size] "
+            "[-T parallel_show_seats] [-a cpu_list] [-t trace_file] [-u] [-H] [-R] [-P | -S primary_pipe_path] [-p index/count] <pipe_path> [delay]\n",
+            argv[0]);
+    return 1;
+  }
+
+  //Replicas only follow a primary, they do not serve replicas of their own
+  if (serve_replicas && primary_path != NULL) {
+    fprintf(stderr, "-P and -S cannot be used together\n");
     return 1;
   }
 
   //Parse access_delay
-  char* endptr;
   state_access_delay_us = STATE_ACCESS_DELAY_US;
-  if (argc == 3) {
-    unsigned long int delay = strtoul(argv[2], &endptr, 10);
+  if (argc - optind == 2) {
+    unsigned long int delay = strtoul(argv[optind + 1], &endptr, 10);
 
     if (*endptr != '\0' || delay > UINT_MAX) {
       fprintf(stderr, "Invalid delay value or value too large\n");
@@ -133,42 +472,113 @@ int parse_args(int argc, char* argv[]) {
   }
 
   //Process pipe path
-  if (argc >= 2) {
-    FIFO_path = argv[1];
-  }
+  FIFO_path = argv[optind];
 
   return 0;
 }
 
 int init_server() {
-  //[Delete and] create and open request pipe
-  unlink(FIFO_path);
-  mkfifo(FIFO_path, FIFO_PERMS);
-  registerFIFO = open(FIFO_path, O_RDWR);
+  //[Delete and] create and open request pipe, unless it comes from the server taken over
+  main_thread = pthread_self();
+  if (!take_over) {
+    unlink(FIFO_path);
+    mkfifo(FIFO_path, FIFO_PERMS);
+    registerFIFO = open(FIFO_path, O_RDWR);
+  }
+
+  //Allocate producer-consumer buffer (one slot is always left empty)
+  buffer_size = admission_queue_size + 1;
+  buffer = malloc(sizeof(struct PendingClient) * (size_t)buffer_size);
+  if (buffer == NULL) {
+    fprintf(stderr, "Failed to allocate admission queue\n");
+    return 1;
+  }
 
   //Initialize synchronization methods for producer-consumer buffer
   pthread_mutex_init(&buffer_mutex, NULL);
   pthread_cond_init(&buffer_not_full, NULL);
   pthread_cond_init(&buffer_not_empty, NULL);
+  pthread_cond_init(&sessions_done, NULL);
+
+  //Pin the acceptor first, the helper threads started below inherit its CPU
+  if (affinity_pin_acceptor()) {
+    fprintf(stderr, "Failed to pin the acceptor thread\n");
+    return 1;
+  }
+
+  //Start request recording before any worker can receive requests
+  if (trace_path != NULL && trace_start(trace_path, MAX_SESSION_COUNT)) {
+    fprintf(stderr, "Failed to start request trace\n");
+    return 1;
+  }
+
+  //Start pushing seat changes to subscribers
+  if (notify_start(MAX_SESSION_COUNT, notify_window_ms)) {
+    fprintf(stderr, "Failed to start notifications\n");
+    return 1;
+  }
 
-  //Launch worker threads
+  //Rejected clients are answered off the acceptor, which only queues them
+  if (pthread_create(&reject_thread, NULL, reject_thread_main, NULL) != 0) {
+    fprintf(stderr, "Failed to start the reject thread\n");
+    return 1;
+  }
+  pthread_detach(reject_thread);
+
+  //Launch worker threads, already on their CPUs so nothing they allocate is touched elsewhere first
   for (int i = 0; i < MAX_SESSION_COUNT; i++) {
     thread_args[i] = (unsigned int)i;
-    pthread_create(&worker_threads[i], NULL, worker_thread_main, &thread_args[i]);
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    if (affinity_worker_attr(&attr, (unsigned int)i)) {
+      fprintf(stderr, "Failed to pin worker %d to CPU %d\n", i, affinity_worker_cpu((unsigned int)i));
+      return 1;
+    }
+    pthread_create(&worker_threads[i], &attr, worker_thread_main, &thread_args[i]);
+    pthread_attr_destroy(&attr);
   }
 
   //Initialize EMS
-  if (ems_init(state_access_delay_us)) {
+  if (ems_init(state_access_delay_us, event_cache_size)) {
     fprintf(stderr, "Failed to initialize EMS\n");
     return 1;
   }
 
-  //Register signal handlers
+  //Receive the registration FIFO and the events of the running server
+  if (take_over && take_over_server()) {
+    fprintf(stderr, "Failed to take over the running server\n");
+    return 1;
+  }
+
+  //Load the events of the primary, or start streaming ours to replicas
+  if (primary_path != NULL && repl_replica_start(primary_path)) {
+    fprintf(stderr, "Failed to start replica\n");
+    return 1;
+  }
+  if (serve_replicas && repl_primary_start(FIFO_path)) {
+    fprintf(stderr, "Failed to accept replicas\n");
+    return 1;
+  }
+
+  //Set main loop condition, before SIGINT may set it
+  server_should_quit = 0;
+
+  //Register signal handlers before the handoff thread may signal this one
   signal(SIGUSR1, handle_SIGUSR1);
   signal(SIGINT, handle_SIGINT);
 
-  //Set main loop condition
-  server_should_quit = 0;
+  //SIGUSR2 kicks the acceptor out of its read when a server takes over, it must not restart the read
+  struct sigaction kick = {.sa_handler = handle_SIGUSR2};
+  sigemptyset(&kick.sa_mask);
+  sigaction(SIGUSR2, &kick, NULL);
+
+  //Wait for the next server to take over, the server keeps working without hot restart if the socket is unavailable
+  handoff_listener = handoff_listen(FIFO_path, HANDOFF_SOCKET_SUFFIX);
+  if (handoff_listener == -1) {
+    fprintf(stderr, "Hot restart unavailable\n");
+  } else {
+    pthread_create(&handoff_thread, NULL, handoff_thread_main, NULL);
+  }
 
   return 0;
 }
@@ -191,177 +601,533 @@ void accept_client() {
     exit(1);
   }
 
-  //Read setup data (pipe names)
+  //Read setup data (pipe names), finishing the message even if a server taking over interrupts the read
   setup_request request;
-  if (read(registerFIFO, &request, sizeof(setup_request)) == -1) {
+  ssize_t ret;
+  while ((ret = read(registerFIFO, &request, sizeof(setup_request))) == -1 && errno == EINTR) continue;
+  if (ret == -1) {
     fprintf(stderr, "Error reading from pipe while accepting client paths: %d.\n", errno);
     exit(1);
   }
 
-  //Add to producer-consumer buffer for worker threads to handle
-  buffer_add(request);
+  //Add to producer-consumer buffer for worker threads to handle, turning the client away if overloaded
+  unsigned int retry_after_ms;
+  if (buffer_try_add(request, &retry_after_ms) != 0) {
+    queue_rejection(request, retry_after_ms);
+  }
 }
 
-void handle_client(unsigned int session_id, int req_fd, int resp_fd) {
-  //Build initial response
-  setup_response resp = {.session_id = session_id};
+/// Hands a rejected client to the reject thread, dropping it if too many are already waiting.
+void queue_rejection(setup_request request, unsigned int retry_after_ms) {
+  //A dropped client would block in its open for good, hold the acceptor back instead, each client queued ahead takes
+  //at most the bounded open of reject_client
+  pthread_mutex_lock(&reject_mutex);
+  while ((reject_in + 1) % REJECT_QUEUE_SIZE == reject_out) pthread_cond_wait(&reject_room, &reject_mutex);
+
+  rejections[reject_in] = (struct Rejection){.request = request, .retry_after_ms = retry_after_ms};
+  reject_in = (reject_in + 1) % REJECT_QUEUE_SIZE;
+  pthread_cond_signal(&reject_cond);
+  pthread_mutex_unlock(&reject_mutex);
+}
 
-  //Send initial response
+void* reject_thread_main(void* arg) {
+  (void)arg;
+
+  //Block SIGUSR1 and SIGUSR2
+  sigset_t sigset;
+  sigemptyset(&sigset);
+  sigaddset(&sigset, SIGUSR1);
+  sigaddset(&sigset, SIGUSR2);
+  pthread_sigmask(SIG_BLOCK, &sigset, NULL);
+
+  //Clients are answered in order, each waiting at most the bounded open of reject_client
+  while (1) {
+    pthread_mutex_lock(&reject_mutex);
+    while (reject_in == reject_out) pthread_cond_wait(&reject_cond, &reject_mutex);
+    struct Rejection rejection = rejections[reject_out];
+    reject_out = (reject_out + 1) % REJECT_QUEUE_SIZE;
+    pthread_cond_signal(&reject_room);
+    pthread_mutex_unlock(&reject_mutex);
+
+    reject_client(rejection.request, rejection.retry_after_ms);
+  }
+}
+
+void reject_client(setup_request request, unsigned int retry_after_ms) {
+  //Open request pipe without blocking, only so the client gets past its own open
+  int req_fd = open(request.request_fifo_name, O_RDONLY | O_NONBLOCK);
+  if (req_fd == -1) {
+    fprintf(stderr, "Error opening request pipe of rejected client\n");
+    return;
+  }
+
+  //The client opens its response pipe right after, give it a bounded amount of time to do so
+  int resp_fd = -1;
+  struct timespec delay = {0, 1000000};
+  for (int attempt = 0; attempt < 100 && resp_fd == -1; attempt++) {
+    resp_fd = open(request.response_fifo_name, O_WRONLY | O_NONBLOCK);
+    if (resp_fd == -1 && errno != ENXIO) break;
+    if (resp_fd == -1) nanosleep(&delay, NULL);
+  }
+
+  if (resp_fd == -1) {
+    fprintf(stderr, "Error opening response pipe of rejected client\n");
+    close(req_fd);
+    return;
+  }
+
+  //Send busy response
+  setup_response resp = {.session_id = 0, .return_code = SETUP_BUSY, .retry_after_ms = retry_after_ms};
   if (write(resp_fd, &resp, sizeof(setup_response)) == -1) {
     fprintf(stderr, "Error writing to pipe\n");
+  }
+
+  close(req_fd);
+  close(resp_fd);
+}
+
+void handle_client(struct Session* session, int is_new) {
+  //Build initial response
+  setup_response resp = {.session_id = session->id, .return_code = 0, .retry_after_ms = 0};
+
+  //Send initial response, resumed sessions got theirs from the previous server
+  if (is_new && session_write(session, &resp, sizeof(setup_response)) != 0) {
+    fprintf(stderr, "Error writing to pipe\n");
     exit(1);
   }
 
   //Set thread work loop condition and enter
+  rate_limit_reset(session->id);
+  session_max_staleness_ms = UINT_MAX;
   int should_work = 1;
   while (should_work) {
-    should_work = process_command(req_fd, resp_fd);
+    should_work = process_command(session);
+    arena_reset(&request_arena);
   }
 
-  //Close client pipes
-  if (close(req_fd) == -1) {
-    fprintf(stderr, "Error closing client pipe\n");
-    exit(1);
-  }
-  if (close(resp_fd) == -1) {
+  //Flush and close client pipes, the pipe may still hold the last SHOW if the client pipelined its QUIT
+  park_shown_snapshot(session);
+  if (session_detach(session) != 0) {
     fprintf(stderr, "Error closing client pipe\n");
     exit(1);
   }
+  notify_session_end(session->id);
 
   //Return to "sleep" state
 }
 
 
 //===Command processing and handling===
-void handle_create(int req_fd, int resp_fd) {
+void handle_create(struct Session* session) {
   //Read request data
   create_request req;
-  if (read(req_fd, &req, sizeof(create_request)) == -1) {
+  if (session_read(session, &req, sizeof(create_request)) != 0) {
     fprintf(stderr, "Error reading from pipe\n");
     exit(1);
   }
 
-  //Perform requested action
-  int ret = ems_create(req.event_id, req.num_rows, req.num_cols);
+  struct iovec parts[] = {{&req, sizeof(req)}};
+  trace_commit(parts, 1);
+
+  //Perform requested action, events of other partitions are created on their own server
+  int ret = 1;
+  if (partition_of(req.event_id, partition_count) != partition_index) {
+    fprintf(stderr, "Event belongs to another partition\n");
+  } else if (!repl_is_replica()) {
+    ret = ems_create(req.event_id, req.num_rows, req.num_cols);
+  }
 
   //Build and send response
   create_response resp = {.return_code = ret};
-  if (write(resp_fd, &resp, sizeof(create_response)) == -1) {
+  struct iovec reply[] = {{&resp, sizeof(create_response)}};
+  if (session_respond(session, reply, 1) != 0) {
     fprintf(stderr, "Error writing to pipe\n");
     exit(1);
   }
 }
 
-void handle_reserve(int req_fd, int resp_fd) {
-  //Read request data
+/// Answers a RESERVE request.
+static void respond_reserve(struct Session* session, int return_code) {
+  reserve_response resp = {.return_code = return_code};
+  struct iovec reply[] = {{&resp, sizeof(reserve_response)}};
+  if (session_respond(session, reply, 1) != 0) fprintf(stderr, "Error writing to pipe\n");
+}
+
+void handle_reserve(struct Session* session) {
+  //Read request data, a broken pipe ends the session on the next read
   reserve_request req;
-  if (read(req_fd, &req, sizeof(reserve_request)) == -1) {
+  if (session_read(session, &req, sizeof(reserve_request)) != 0) {
     fprintf(stderr, "Error reading from pipe\n");
-    exit(1);
+    return;
+  }
+
+  //The count comes from the client and is the only bound on the reservation, it must match the payload exactly
+  //before anything is allocated for it, the coordinates are skipped with the payload otherwise
+  if (req.num_seats > session->payload_left / (2 * sizeof(size_t)) ||
+      2 * req.num_seats * sizeof(size_t) != session->payload_left) {
+    respond_reserve(session, 1);
+    return;
   }
 
-  //Read provided arrays
-  size_t* xs = malloc(req.num_seats * sizeof(size_t));
-  size_t* ys = malloc(req.num_seats * sizeof(size_t));
-  if (read(req_fd, xs, req.num_seats * sizeof(size_t)) == -1) {
+  //Read provided arrays, freed with the arena once the command is done
+  size_t* xs = arena_alloc(&request_arena, req.num_seats * sizeof(size_t));
+  size_t* ys = arena_alloc(&request_arena, req.num_seats * sizeof(size_t));
+  if ((xs == NULL || ys == NULL) && req.num_seats > 0) {
+    fprintf(stderr, "Error allocating memory for reservation\n");
+    respond_reserve(session, 1);
+    return;
+  }
+  if (session_read(session, xs, req.num_seats * sizeof(size_t)) != 0 ||
+      session_read(session, ys, req.num_seats * sizeof(size_t)) != 0) {
     fprintf(stderr, "Error reading from pipe\n");
-    free(xs);  // If this fails, we need to free xs and ys before exiting
-    free(ys);
-    exit(1);
+    return;
   }
-  if (read(req_fd, ys, req.num_seats * sizeof(size_t)) == -1) {
+
+  struct iovec parts[] = {{&req, sizeof(req)}, {xs, req.num_seats * sizeof(size_t)}, {ys, req.num_seats * sizeof(size_t)}};
+  trace_commit(parts, 3);
+
+  //Perform requested action, replicas are read-only
+  int ret = repl_is_replica() ? 1 : ems_reserve(req.event_id, req.num_seats, xs, ys);
+  respond_reserve(session, ret);
+}
+
+void handle_show(struct Session* session) {
+  //Read request data
+  show_request req;
+  if (session_read(session, &req, sizeof(show_request)) != 0) {
     fprintf(stderr, "Error reading from pipe\n");
-    free(xs);
-    free(ys);
     exit(1);
   }
 
-  //Perform requested action
-  int ret = ems_reserve(req.event_id, req.num_seats, xs, ys);
+  struct iovec parts[] = {{&req, sizeof(req)}};
+  trace_commit(parts, 1);
 
-  //Memory cleanup
-  free(xs);
-  free(ys);
+  //Perform requested action, unless this replica is further behind than the client accepts
+  int stale = replica_too_stale();
+  struct Snapshot* snapshot = stale ? NULL : ems_show_snapshot(req.event_id);
 
   //Build and send response
-  reserve_response resp = {.return_code = ret};
-  if (write(resp_fd, &resp, sizeof(reserve_response)) == -1) {
+  show_response resp;
+  resp.num_cols = snapshot == NULL ? 0 : snapshot->cols;
+  resp.num_rows = snapshot == NULL ? 0 : snapshot->rows;
+  resp.return_code = stale ? REPLICA_STALE : snapshot == NULL ? 1 : 0;
+  if (snapshot == NULL) {
+    struct iovec reply[] = {{&resp, sizeof(show_response)}};
+    if (session_respond(session, reply, 1) != 0) {
+      fprintf(stderr, "Error writing to pipe\n");
+      exit(1);
+    }
+    return;
+  }
+
+  //Send returned data after the response, tile by tile, mapped into the pipe rather than copied unless the pipe still
+  //holds the seats of the previous SHOW, only one snapshot is kept for the pipe
+  if (session_respond_pages(session, &resp, sizeof(show_response), snapshot->tiles, snapshot->tile_count,
+                            shown_snapshot == NULL) != 0) {
     fprintf(stderr, "Error writing to pipe\n");
+    snapshot_release(snapshot);
     exit(1);
   }
+
+  //The pipe may still reference the seats, keep them until the client has read them
+  if (shown_snapshot == NULL) {
+    shown_snapshot = snapshot;
+  } else {
+    snapshot_release(snapshot);
+  }
 }
 
-void handle_show(int req_fd, int resp_fd) {
+void handle_list(struct Session* session) {
+  // No need to read request, has no extra data
+
+  //Perform requested action, unless this replica is further behind than the client accepts
+  int stale = replica_too_stale();
+  size_t event_count = 0;
+  unsigned int* data = stale ? NULL : ems_list_events_to_client(&event_count, &request_arena);
+
+  //Build and send response
+  list_response resp;
+  resp.num_events = event_count;
+  resp.return_code = stale ? REPLICA_STALE : data == NULL ? 1 : 0;
+  //Send returned data with it
+  struct iovec reply[] = {{&resp, sizeof(list_response)}, {data, event_count * sizeof(unsigned int)}};
+  if (session_respond(session, reply, 2) != 0) {
+    fprintf(stderr, "Error writing to pipe\n");
+    exit(1);
+  }
+}
+
+void handle_list_page(struct Session* session) {
   //Read request data
-  show_request req;
-  if (read(req_fd, &req, sizeof(show_request)) == -1) {
+  list_page_request req;
+  if (session_read(session, &req, sizeof(list_page_request)) != 0) {
     fprintf(stderr, "Error reading from pipe\n");
     exit(1);
   }
 
-  //Perform requested action
-  size_t rows = 0, cols = 0;
-  unsigned int* data = ems_show_to_client(req.event_id, &rows, &cols);
+  struct iovec parts[] = {{&req, sizeof(req)}};
+  trace_commit(parts, 1);
+
+  //Perform requested action, unless this replica is further behind than the client accepts
+  int stale = replica_too_stale();
+  size_t page_size = req.page_size == 0 || req.page_size > LIST_PAGE_MAX ? LIST_PAGE_MAX : req.page_size;
+  unsigned int* ids = arena_alloc(&request_arena, page_size * sizeof(unsigned int));
+  size_t count = 0;
+  unsigned int next_id = 0;
+  int more = 0;
+  int ret = stale || ids == NULL ||
+            ems_list_page(req.from_id, req.to_id, req.min_free_seats, page_size, ids, &count, &next_id, &more) != 0;
 
   //Build and send response
-  show_response resp;
-  resp.num_cols = cols;
-  resp.num_rows = rows;
-  resp.return_code = data == NULL ? 1 : 0;
-  if (write(resp_fd, &resp, sizeof(show_response)) == -1) {
+  list_page_response resp = {.return_code = stale ? REPLICA_STALE : ret,
+                             .num_events = ret ? 0 : (unsigned int)count,
+                             .next_id = next_id,
+                             .more = (char)more};
+  //Send returned data with it
+  struct iovec reply[] = {{&resp, sizeof(list_page_response)}, {ids, resp.num_events * sizeof(unsigned int)}};
+  if (session_respond(session, reply, 2) != 0) {
     fprintf(stderr, "Error writing to pipe\n");
-    free(data);
+    exit(1);
+  }
+}
+
+/// Answers a STATS request with an error and no records.
+static void respond_stats_error(struct Session* session, int return_code) {
+  stats_response resp = {.return_code = return_code, .num_events = 0};
+  struct iovec reply[] = {{&resp, sizeof(stats_response)}};
+  if (session_respond(session, reply, 1) != 0) fprintf(stderr, "Error writing to pipe\n");
+}
+
+void handle_stats(struct Session* session) {
+  //Read request data, a broken pipe ends the session on the next read
+  stats_request req;
+  if (session_read(session, &req, sizeof(stats_request)) != 0) {
+    fprintf(stderr, "Error reading from pipe\n");
+    return;
+  }
+
+  //The count comes from the client, check it before allocating for it, the ids are skipped with the payload
+  if (req.num_events > STATS_MAX_EVENTS || req.num_events * sizeof(unsigned int) > session->payload_left) {
+    respond_stats_error(session, 1);
+    return;
+  }
+
+  //Read the event ids, freed with the arena once the command is done
+  unsigned int* ids = arena_alloc(&request_arena, req.num_events * sizeof(unsigned int));
+  if (ids == NULL && req.num_events > 0) {
+    fprintf(stderr, "Error allocating memory for stats\n");
+    respond_stats_error(session, 1);
+    return;
+  }
+  if (session_read(session, ids, req.num_events * sizeof(unsigned int)) != 0) {
+    fprintf(stderr, "Error reading from pipe\n");
+    return;
+  }
+
+  struct iovec parts[] = {{&req, sizeof(req)}, {ids, req.num_events * sizeof(unsigned int)}};
+  trace_commit(parts, 2);
+
+  //Perform requested action, unless this replica is further behind than the client accepts
+  if (replica_too_stale()) {
+    respond_stats_error(session, REPLICA_STALE);
+    return;
+  }
+
+  size_t count = req.num_events;
+  struct EventStats* stats = arena_alloc(&request_arena, count * sizeof(struct EventStats));
+  char* found = arena_alloc(&request_arena, count);
+  size_t len = sizeof(stats_response);
+  for (size_t i = 0; i < count && stats != NULL && found != NULL; i++) {
+    found[i] = ems_stats(ids[i], &stats[i], &request_arena) == 0;
+    len += sizeof(event_stats) + (found[i] ? stats[i].rows * sizeof(size_t) : 0);
+  }
+
+  //Build the whole response, it is sent with a single write
+  char* response = arena_alloc(&request_arena, len);
+  if (response == NULL || (count > 0 && (stats == NULL || found == NULL))) {
+    fprintf(stderr, "Error allocating memory for stats\n");
+    respond_stats_error(session, 1);
+    return;
+  }
+
+  stats_response resp = {.return_code = 0, .num_events = (unsigned int)count};
+  char* data = response;
+  memcpy(data, &resp, sizeof(stats_response));
+  data += sizeof(stats_response);
+  for (size_t i = 0; i < count; i++) {
+    event_stats record = {.event_id = ids[i],
+                          .found = found[i],
+                          .num_rows = found[i] ? stats[i].rows : 0,
+                          .num_cols = found[i] ? stats[i].cols : 0,
+                          .sold = found[i] ? stats[i].sold : 0,
+                          .reservations = found[i] ? stats[i].reservations : 0};
+    memcpy(data, &record, sizeof(event_stats));
+    data += sizeof(event_stats);
+
+    memcpy(data, stats[i].row_free, record.num_rows * sizeof(size_t));
+    data += record.num_rows * sizeof(size_t);
+  }
+
+  struct iovec reply[] = {{response, len}};
+  if (session_respond(session, reply, 1) != 0) fprintf(stderr, "Error writing to pipe\n");
+}
+
+void handle_seats(struct Session* session) {
+  //Read request data
+  seats_request req;
+  if (session_read(session, &req, sizeof(seats_request)) != 0) {
+    fprintf(stderr, "Error reading from pipe\n");
     exit(1);
   }
 
-  //Send returned data
-  if (write(resp_fd, data, sizeof(unsigned int) * rows * cols) == -1) {
+  struct iovec parts[] = {{&req, sizeof(req)}};
+  trace_commit(parts, 1);
+
+  //Perform requested action, unless this replica is further behind than the client accepts
+  int stale = replica_too_stale();
+  size_t num_seats = 0;
+  size_t *xs = NULL, *ys = NULL;
+  int ret = stale ||
+            ems_reservation_seats(req.event_id, req.reservation_id, &num_seats, &xs, &ys, &request_arena) != 0;
+
+  //Build and send response, the coordinates follow it like those of a reserve request
+  seats_response resp = {.return_code = stale ? REPLICA_STALE : ret,
+                         .event_id = req.event_id,
+                         .reservation_id = req.reservation_id,
+                         .num_seats = ret ? 0 : num_seats};
+  struct iovec reply[] = {{&resp, sizeof(seats_response)},
+                          {xs, resp.num_seats * sizeof(size_t)},
+                          {ys, resp.num_seats * sizeof(size_t)}};
+  if (session_respond(session, reply, 3) != 0) {
     fprintf(stderr, "Error writing to pipe\n");
-    free(data);
     exit(1);
   }
+}
+
+void handle_cancel(struct Session* session) {
+  //Read request data
+  cancel_request req;
+  if (session_read(session, &req, sizeof(cancel_request)) != 0) {
+    fprintf(stderr, "Error reading from pipe\n");
+    exit(1);
+  }
+
+  struct iovec parts[] = {{&req, sizeof(req)}};
+  trace_commit(parts, 1);
+
+  //Perform requested action
+  int ret = repl_is_replica() ? 1 : ems_cancel(req.event_id, req.reservation_id);
 
-  //Memory cleanup
-  free(data);
+  //Build and send response
+  cancel_response resp = {.return_code = ret};
+  struct iovec reply[] = {{&resp, sizeof(cancel_response)}};
+  if (session_respond(session, reply, 1) != 0) {
+    fprintf(stderr, "Error writing to pipe\n");
+    exit(1);
+  }
 }
 
-void handle_list(int req_fd, int resp_fd) {
-  // No need to read request, has no extra data
-  (void)req_fd;
+void handle_subscribe(struct Session* session) {
+  //Read request data
+  subscribe_request req;
+  if (session_read(session, &req, sizeof(subscribe_request)) != 0) {
+    fprintf(stderr, "Error reading from pipe\n");
+    exit(1);
+  }
+
+  struct iovec parts[] = {{&req, sizeof(req)}};
+  trace_commit(parts, 1);
 
   //Perform requested action
-  size_t event_count = 0;
-  unsigned int* data = ems_list_events_to_client(&event_count);
+  char fifo_name[sizeof(req.notify_fifo_name) + 1];
+  memcpy(fifo_name, req.notify_fifo_name, sizeof(req.notify_fifo_name));
+  fifo_name[sizeof(req.notify_fifo_name)] = '\0';
+  int ret = notify_subscribe(session->id, fifo_name, req.event_id);
 
   //Build and send response
-  list_response resp;
-  resp.num_events = event_count;
-  resp.return_code = data == NULL ? 1 : 0;
-  if (write(resp_fd, &resp, sizeof(list_response)) == -1) {
+  subscribe_response resp = {.return_code = ret};
+  struct iovec reply[] = {{&resp, sizeof(subscribe_response)}};
+  if (session_respond(session, reply, 1) != 0) {
     fprintf(stderr, "Error writing to pipe\n");
-    free(data);
     exit(1);
   }
+}
+
+void handle_unsubscribe(struct Session* session) {
+  //Read request data
+  unsubscribe_request req;
+  if (session_read(session, &req, sizeof(unsubscribe_request)) != 0) {
+    fprintf(stderr, "Error reading from pipe\n");
+    exit(1);
+  }
+
+  struct iovec parts[] = {{&req, sizeof(req)}};
+  trace_commit(parts, 1);
+
+  //Perform requested action
+  int ret = notify_unsubscribe(session->id, req.event_id);
 
-  //Send returned data
-  if (write(resp_fd, data, event_count * sizeof(unsigned int)) == -1) {
+  //Build and send response
+  unsubscribe_response resp = {.return_code = ret};
+  struct iovec reply[] = {{&resp, sizeof(unsubscribe_response)}};
+  if (session_respond(session, reply, 1) != 0) {
     fprintf(stderr, "Error writing to pipe\n");
-    free(data);
     exit(1);
   }
+}
 
-  //Memory cleanup
-  free(data);
+void handle_staleness(struct Session* session) {
+  //Read request data
+  staleness_request req;
+  if (session_read(session, &req, sizeof(staleness_request)) != 0) {
+    fprintf(stderr, "Error reading from pipe\n");
+    exit(1);
+  }
+
+  struct iovec parts[] = {{&req, sizeof(req)}};
+  trace_commit(parts, 1);
+
+  //Perform requested action, ignored by primaries which are never stale
+  session_max_staleness_ms = req.max_staleness_ms;
+
+  //Build and send response
+  staleness_response resp = {.return_code = 0};
+  struct iovec reply[] = {{&resp, sizeof(staleness_response)}};
+  if (session_respond(session, reply, 1) != 0) {
+    fprintf(stderr, "Error writing to pipe\n");
+    exit(1);
+  }
 }
 
+/// Checks if this server is a replica too far behind its primary for the session of the calling worker.
+int replica_too_stale() { return repl_is_replica() && repl_staleness_ms() > session_max_staleness_ms; }
+
 /// @return 1 if command was processed successfully, 1 if error or client handling complete (MSG_QUIT)
-int process_command(int req_fd, int resp_fd) {
-  //Read core request
+int process_command(struct Session* session) {
+  //Read the header of the next request frame, the session ends if the client went away
   core_request core;
-  if (read(req_fd, &core, sizeof(core_request)) == -1) {
+  if (session_next_request(session, &core) != 0) {
     fprintf(stderr, "Error reading from pipe while reading core: %d.\n", errno);
-    exit(1);
+    return 0;
   }
+  unsigned int session_id = session->id;
+
+  //The last SHOW may still be in the pipe when the client pipelines requests
+  release_shown_snapshot(session);
+
+  //Once a new server owns the state, it handles this command and the rest of the session
+  pthread_rwlock_rdlock(&handoff_gate);
+  if (handed_off) {
+    pthread_rwlock_unlock(&handoff_gate);
+    if (core.opcode != MSG_QUIT) hand_session_over(session, &core);
+    return 0;
+  }
+
+  //Throttle sessions issuing commands faster than their share
+  rate_limit_wait(session_id);
+
+  //Note arrival for the request trace, recorded by the handler once decoded
+  trace_begin(session_id, core.opcode);
 
   //Could check session_id, not required
   //session_id could be associated to the client pipes
@@ -369,33 +1135,96 @@ int process_command(int req_fd, int resp_fd) {
   //this is unnecessary
 
   //Take action depending on provided opcode
+  int ret = 1;
   switch (core.opcode) {
     case MSG_QUIT:
-      return 0;
+      trace_commit(NULL, 0);
+      ret = 0;
+      break;
 
     case MSG_CREATE:
-      handle_create(req_fd, resp_fd);
+      handle_create(session);
       break;
 
     case MSG_RESERVE:
-      handle_reserve(req_fd, resp_fd);
+      handle_reserve(session);
       break;
 
     case MSG_SHOW:
-      handle_show(req_fd, resp_fd);
+      handle_show(session);
       break;
 
     case MSG_LIST:
+      trace_commit(NULL, 0);
+      handle_list(session);
+      break;
+
+    case MSG_LIST_PAGE:
+      handle_list_page(session);
+      break;
+
+    case MSG_STATS:
+      handle_stats(session);
+      break;
+
+    case MSG_SEATS:
+      handle_seats(session);
+      break;
+
+    case MSG_CANCEL:
+      handle_cancel(session);
+      break;
+
+    case MSG_SUBSCRIBE:
+      handle_subscribe(session);
+      break;
+
+    case MSG_UNSUBSCRIBE:
+      handle_unsubscribe(session);
+      break;
+
+    case MSG_STALENESS:
+      handle_staleness(session);
       break;
 
     //Error on invalid msg or invalid situation
     case MSG_SETUP:
     default:
       fprintf(stderr, "Invalid opcode\n");
-      return 0;
+      ret = 0;
+      break;
+  }
+
+  pthread_rwlock_unlock(&handoff_gate);
+  return ret;
+}
+
+/// Hands a session over to the server that took over, with the command just read and anything read after it.
+void hand_session_over(struct Session* session, const core_request* core) {
+  size_t unread_len;
+  char* unread = session_unread(session, &unread_len);
+  size_t carried_len = sizeof(core_request) + unread_len;
+  char* carried = malloc(carried_len);
+  if (carried == NULL || (unread == NULL && unread_len > 0)) {
+    fprintf(stderr, "Error allocating memory for session handoff\n");
+    free(unread);
+    free(carried);
+    return;
+  }
+  memcpy(carried, core, sizeof(core_request));
+  if (unread_len > 0) memcpy(carried + sizeof(core_request), unread, unread_len);
+  free(unread);
+
+  //Responses held back go out before the new server starts answering
+  int fds[] = {session->req_fd, session->resp_fd};
+  struct HandoffMessage msg = {.kind = HANDOFF_SESSION, .pending_len = carried_len};
+  pthread_mutex_lock(&handoff_mutex);
+  if (session_flush(session) != 0 || handoff_send(successor_socket, &msg, fds, 2, carried) != 0) {
+    fprintf(stderr, "Error handing session over\n");
   }
+  pthread_mutex_unlock(&handoff_mutex);
 
-  return 1;
+  free(carried);
 }
 
 
@@ -413,16 +1242,22 @@ void close_server() {
     fprintf(stderr, "Error closing register FIFO\n");
     exit(1);
   }
-  //Delete server pipe
-  if (unlink(FIFO_path) == -1) {
+  //Delete server pipe and hot restart socket, unless they were handed over to a new server
+  if (!handed_off && unlink(FIFO_path) == -1) {
     fprintf(stderr, "Error deleting register FIFO\n");
     exit(1);
   }
+  if (handoff_listener != -1) handoff_unlink(FIFO_path, HANDOFF_SOCKET_SUFFIX);
+  repl_primary_stop();
   //Close threads and destroy producer-consumer buffer thread safety objects
   close_server_threads();
+  trace_stop();
+  notify_stop();
   pthread_mutex_destroy(&buffer_mutex);
   pthread_cond_destroy(&buffer_not_full);
   pthread_cond_destroy(&buffer_not_empty);
+  pthread_cond_destroy(&sessions_done);
+  free(buffer);
 
   //Cleanup EMS and exit
   ems_terminate();
@@ -441,6 +1276,11 @@ void handle_SIGUSR1(int signum) {
   signal(SIGUSR1, handle_SIGUSR1);
 }
 
+void handle_SIGUSR2(int signum) {
+  //Nothing to do, the signal only interrupts the acceptor's read
+  (void)signum;
+}
+
 void handle_SIGINT(int signum)
 {
   (void)signum;
@@ -454,15 +1294,16 @@ void handle_SIGINT(int signum)
 
 
 //===Buffer operations===
-setup_request buffer_get()
+struct PendingClient buffer_get()
 {
   //Lock buffer
   pthread_mutex_lock(&buffer_mutex);
   //Wait for required condition
   while (in == out) pthread_cond_wait(&buffer_not_empty, &buffer_mutex);
   //Fetch from buffer and increment tail
-  setup_request ret = buffer[out];
-  out = (out + 1) % BUFFER_SIZE;
+  struct PendingClient ret = buffer[out];
+  out = (out + 1) % buffer_size;
+  active_sessions++;
   //Signal that buffer is not full
   pthread_cond_signal(&buffer_not_full);
   //Unlock buffer
@@ -471,19 +1312,173 @@ setup_request buffer_get()
   return ret;
 }
 
-void buffer_add(setup_request request)
+/// Adds a setup request to the buffer unless admission control turns it away.
+/// @param request Setup request to add.
+/// @param retry_after_ms Set to the suggested retry delay when the request is rejected.
+/// @return 0 if the request was queued, 1 if the client should be told to retry later.
+int buffer_try_add(setup_request request, unsigned int* retry_after_ms)
 {
   //Lock buffer
   pthread_mutex_lock(&buffer_mutex);
-  //Wait for buffer to not be full
-  while ((in + 1) % BUFFER_SIZE == out) pthread_cond_wait(&buffer_not_full, &buffer_mutex);
+
+  //A full queue often frees a slot as soon as a worker picks up the next client, wait briefly for it
+  if ((in + 1) % buffer_size == out) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += ADMISSION_FULL_WAIT_MS * 1000000L;
+    if (deadline.tv_nsec >= 1000000000) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000;
+    }
+    while ((in + 1) % buffer_size == out &&
+           pthread_cond_timedwait(&buffer_not_full, &buffer_mutex, &deadline) == 0) continue;
+  }
+
+  //Estimate how long the request would wait for a worker, from the average session length
+  int queued = (in - out + buffer_size) % buffer_size;
+  int ahead = active_sessions + queued - MAX_SESSION_COUNT + 1;
+  double wait_ms = ahead > 0 ? avg_session_ms * ahead / MAX_SESSION_COUNT : 0;
+
+  //Reject if queue is still full or the wait is too long
+  if ((in + 1) % buffer_size == out || (admission_max_wait_ms > 0 && wait_ms > admission_max_wait_ms)) {
+    *retry_after_ms = wait_ms > ADMISSION_MIN_RETRY_MS ? (unsigned int)wait_ms : ADMISSION_MIN_RETRY_MS;
+    pthread_mutex_unlock(&buffer_mutex);
+    return 1;
+  }
+
   //Add request to buffer
-  buffer[in] = request;
-  in = (in + 1) % BUFFER_SIZE;
+  buffer[in] = (struct PendingClient){.setup = request, .req_fd = -1, .resp_fd = -1, .carried = NULL};
+  in = (in + 1) % buffer_size;
   //Signal that buffer is not empty
   pthread_cond_signal(&buffer_not_empty);
   //Unlock buffer
   pthread_mutex_unlock(&buffer_mutex);
+  return 0;
+}
+
+/// Adds a session resumed from the previous server to the buffer, waiting for room.
+/// Admission control does not apply, the client was already admitted.
+/// @param client Session to add.
+void buffer_add_resumed(struct PendingClient client)
+{
+  pthread_mutex_lock(&buffer_mutex);
+  while ((in + 1) % buffer_size == out) pthread_cond_wait(&buffer_not_full, &buffer_mutex);
+  buffer[in] = client;
+  in = (in + 1) % buffer_size;
+  pthread_cond_signal(&buffer_not_empty);
+  pthread_mutex_unlock(&buffer_mutex);
+}
+
+/// Records the end of a session for admission control.
+/// @param duration_ms How long the session lasted.
+void buffer_session_done(double duration_ms)
+{
+  pthread_mutex_lock(&buffer_mutex);
+  active_sessions--;
+  //Exponentially weighted average, first session seeds it
+  avg_session_ms = avg_session_ms <= 0 ? duration_ms : 0.8 * avg_session_ms + 0.2 * duration_ms;
+  pthread_cond_broadcast(&sessions_done);
+  pthread_mutex_unlock(&buffer_mutex);
+}
+
+
+//===Hot restart===
+/// Receives the registration FIFO and the events of the running server, and starts resuming its sessions.
+/// @return 0 if the server was taken over, 1 otherwise.
+int take_over_server()
+{
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  predecessor_socket = handoff_connect(FIFO_path, HANDOFF_SOCKET_SUFFIX);
+  if (predecessor_socket == -1) {
+    fprintf(stderr, "No server to take over at %s\n", FIFO_path);
+    return 1;
+  }
+
+  struct HandoffMessage msg;
+  int fds[HANDOFF_MAX_FDS];
+  int fd_count;
+  char* pending;
+  if (handoff_recv(predecessor_socket, &msg, fds, &fd_count, &pending) != 0 || msg.kind != HANDOFF_STATE ||
+      fd_count != 2) {
+    fprintf(stderr, "Error receiving the state of the running server\n");
+    return 1;
+  }
+  free(pending);
+
+  registerFIFO = fds[0];
+  int ret = ems_import(fds[1]);
+  close(fds[1]);
+  if (ret) return 1;
+
+  pthread_create(&resume_thread, NULL, resume_thread_main, NULL);
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  fprintf(stderr, "Took over the running server in %.2f ms\n",
+          (double)(end.tv_sec - start.tv_sec) * 1e3 + (double)(end.tv_nsec - start.tv_nsec) / 1e6);
+  return 0;
+}
+
+/// Parks the acceptor while a server takes over, until the handoff either succeeds or fails.
+void wait_handoff()
+{
+  pthread_mutex_lock(&handoff_mutex);
+  acceptor_stopped = 1;
+  pthread_cond_broadcast(&handoff_cond);
+  while (handoff_started) pthread_cond_wait(&handoff_cond, &handoff_mutex);
+  acceptor_stopped = 0;
+  pthread_mutex_unlock(&handoff_mutex);
+}
+
+/// Waits until every session of the server was handed over or ended, then tells the new server it got them all.
+void drain_server()
+{
+  pthread_mutex_lock(&buffer_mutex);
+  while (active_sessions > 0 || in != out) pthread_cond_wait(&sessions_done, &buffer_mutex);
+  pthread_mutex_unlock(&buffer_mutex);
+
+  pthread_mutex_lock(&handoff_mutex);
+  close(successor_socket);
+  successor_socket = -1;
+  pthread_mutex_unlock(&handoff_mutex);
+}
+
+
+//===Rate limiting===
+void rate_limit_reset(unsigned int session_id)
+{
+  //Sessions start with a full bucket
+  session_buckets[session_id].tokens = session_rate_burst;
+  clock_gettime(CLOCK_MONOTONIC, &session_buckets[session_id].last_fill);
+}
+
+void rate_limit_wait(unsigned int session_id)
+{
+  if (session_rate_limit <= 0) return;
+
+  //Buckets are only touched by the worker owning the session, no locking needed
+  struct TokenBucket* bucket = &session_buckets[session_id];
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  //Refill according to elapsed time
+  double elapsed = (double)(now.tv_sec - bucket->last_fill.tv_sec) +
+                   (double)(now.tv_nsec - bucket->last_fill.tv_nsec) / 1e9;
+  bucket->tokens += elapsed * session_rate_limit;
+  if (bucket->tokens > session_rate_burst) bucket->tokens = session_rate_burst;
+  bucket->last_fill = now;
+
+  //Sleep until one token is available
+  if (bucket->tokens < 1) {
+    double wait_s = (1 - bucket->tokens) / session_rate_limit;
+    struct timespec delay = {(time_t)wait_s, (long)((wait_s - (double)(time_t)wait_s) * 1e9)};
+    nanosleep(&delay, NULL);
+    bucket->tokens = 1;
+    clock_gettime(CLOCK_MONOTONIC, &bucket->last_fill);
+  }
+
+  bucket->tokens -= 1;
 }
 
 
@@ -491,11 +1486,16 @@ void buffer_add(setup_request request)
 void list_events()
 {
   //Get list of all events
+  struct Arena arena;
+  arena_init(&arena);
   size_t count;
-  unsigned int* data = ems_list_events_to_client(&count);
+  unsigned int* data = ems_list_events_to_client(&count, &arena);
 
   //Ignore if error
-  if (data == NULL) return;
+  if (data == NULL) {
+    arena_destroy(&arena);
+    return;
+  }
 
   //Actually do the printing
   for (size_t i = 0; i < count; i++) {
@@ -504,4 +1504,65 @@ void list_events()
     write(1, buff, strlen(buff));
     ems_show(1, data[i]);
   }
+
+  arena_destroy(&arena);
+}
+
+/// Drops the snapshots left in the pipes of ended sessions once their clients read them or close their pipe.
+static void sweep_draining_snapshots(void) {
+  struct DrainingSnapshot** link = &draining_snapshots;
+  while (*link != NULL) {
+    struct DrainingSnapshot* node = *link;
+
+    //The write end of a pipe without readers polls as an error
+    struct pollfd pfd = {.fd = node->pipe_fd, .events = POLLOUT};
+    int unread = 0;
+    if (!(poll(&pfd, 1, 0) == 1 && (pfd.revents & POLLERR)) && ioctl(node->pipe_fd, FIONREAD, &unread) == 0 &&
+        unread > 0) {
+      link = &node->next;
+      continue;
+    }
+
+    *link = node->next;
+    close(node->pipe_fd);
+    snapshot_release(node->snapshot);
+    free(node);
+  }
+}
+
+/// Drops the snapshot of the last SHOW once the client has read it out of the response pipe, along with those of
+/// ended sessions.
+/// @param session Session whose response pipe is checked.
+void release_shown_snapshot(struct Session* session) {
+  sweep_draining_snapshots();
+
+  int unread = 0;
+  if (shown_snapshot != NULL && ioctl(session->resp_fd, FIONREAD, &unread) == 0 && unread > 0) return;
+
+  snapshot_release(shown_snapshot);
+  shown_snapshot = NULL;
+}
+
+/// Keeps the snapshot of the last SHOW of an ending session until its client reads it, with a copy of the response
+/// pipe to check it on.
+/// @note Called before the response pipe is closed.
+void park_shown_snapshot(struct Session* session) {
+  release_shown_snapshot(session);
+  if (shown_snapshot == NULL) return;
+
+  struct DrainingSnapshot* node = malloc(sizeof(struct DrainingSnapshot));
+  int fd = node == NULL ? -1 : dup(session->resp_fd);
+  if (fd == -1) {
+    //Freeing the seats could change what the client reads, keep them for good instead
+    fprintf(stderr, "Error keeping a snapshot until it is read\n");
+    free(node);
+    shown_snapshot = NULL;
+    return;
+  }
+
+  node->snapshot = shown_snapshot;
+  node->pipe_fd = fd;
+  node->next = draining_snapshots;
+  draining_snapshots = node;
+  shown_snapshot = NULL;
 }
@@ -0,0 +1,93 @@
+#define _GNU_SOURCE  // MAP_ANONYMOUS, MAP_HUGETLB, MADV_HUGEPAGE
+
+#include "memory.h"
+
+#include <stdalign.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+static int use_hugetlb = 0;
+
+void slab_init(struct Slab* slab, size_t object_size) {
+  size_t align = alignof(max_align_t);
+  if (object_size < sizeof(void*)) object_size = sizeof(void*);
+
+  slab->object_size = (object_size + align - 1) & ~(align - 1);
+  slab->free_list = NULL;
+  slab->next_unused = SLAB_OBJECTS_PER_BLOCK;
+  slab->blocks = NULL;
+}
+
+void* slab_alloc(struct Slab* slab) {
+  //Reuse freed objects first
+  if (slab->free_list != NULL) {
+    void* ptr = slab->free_list;
+    memcpy(&slab->free_list, ptr, sizeof(void*));
+    return ptr;
+  }
+
+  if (slab->next_unused == SLAB_OBJECTS_PER_BLOCK) {
+    struct SlabBlock* block = malloc(sizeof(struct SlabBlock) + slab->object_size * SLAB_OBJECTS_PER_BLOCK);
+    if (block == NULL) return NULL;
+
+    block->next = slab->blocks;
+    slab->blocks = block;
+    slab->next_unused = 0;
+  }
+
+  return slab->blocks->objects + slab->object_size * slab->next_unused++;
+}
+
+void slab_free(struct Slab* slab, void* ptr) {
+  if (ptr == NULL) return;
+
+  memcpy(ptr, &slab->free_list, sizeof(void*));
+  slab->free_list = ptr;
+}
+
+void slab_destroy(struct Slab* slab) {
+  struct SlabBlock* block = slab->blocks;
+  while (block != NULL) {
+    struct SlabBlock* next = block->next;
+    free(block);
+    block = next;
+  }
+
+  slab->blocks = NULL;
+  slab->free_list = NULL;
+  slab->next_unused = SLAB_OBJECTS_PER_BLOCK;
+}
+
+void grid_use_hugetlb(int enable) { use_hugetlb = enable; }
+
+/// Rounds a grid size up to whole huge pages.
+static size_t mapped_size(size_t size) { return (size + GRID_HUGE_PAGE_SIZE - 1) & ~((size_t)GRID_HUGE_PAGE_SIZE - 1); }
+
+void* grid_alloc(size_t size) {
+  if (size < GRID_HUGE_PAGE_MIN) return calloc(1, size);
+
+  size_t length = mapped_size(size);
+
+  //Explicit huge pages, if enabled and reserved
+  if (use_hugetlb) {
+    void* ptr = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (ptr != MAP_FAILED) return ptr;
+  }
+
+  //Otherwise regular pages the kernel may back with transparent huge pages
+  void* ptr = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (ptr == MAP_FAILED) return NULL;
+  madvise(ptr, length, MADV_HUGEPAGE);
+  return ptr;
+}
+
+void grid_free(void* ptr, size_t size) {
+  if (ptr == NULL) return;
+
+  if (size < GRID_HUGE_PAGE_MIN) {
+    free(ptr);
+  } else {
+    munmap(ptr, mapped_size(size));
+  }
+}
@@ -0,0 +1,58 @@
+#ifndef SERVER_MEMORY_H
+#define SERVER_MEMORY_H
+
+#include <stdalign.h>
+#include <stddef.h>
+
+#define SLAB_OBJECTS_PER_BLOCK 64         // Objects carved out of each slab block
+#define GRID_HUGE_PAGE_SIZE (2 << 20)     // Size of a huge page
+#define GRID_HUGE_PAGE_MIN (2 << 20)      // Smallest seat grid backed by huge pages
+
+/// Block of objects owned by a slab.
+struct SlabBlock {
+  struct SlabBlock* next;  /// Next block of the slab.
+  alignas(max_align_t) char objects[];  /// SLAB_OBJECTS_PER_BLOCK objects.
+};
+
+/// Pool of fixed-size objects, carved out of contiguous blocks so they share cache lines and pages.
+/// Freed objects are kept for reuse, blocks are only returned to the system by slab_destroy.
+/// @note A slab is not thread safe, callers must serialize allocations and frees.
+struct Slab {
+  size_t object_size;       /// Size of each object, rounded up for alignment.
+  void* free_list;          /// Free objects, each storing a pointer to the next one.
+  size_t next_unused;       /// Objects of the newest block never handed out start at this index.
+  struct SlabBlock* blocks; /// Blocks of the slab, newest first.
+};
+
+/// Sets up an empty slab.
+/// @param slab Slab to set up.
+/// @param object_size Size of the objects it hands out.
+void slab_init(struct Slab* slab, size_t object_size);
+
+/// Allocates one object.
+/// @return Pointer to the object, NULL on failure.
+void* slab_alloc(struct Slab* slab);
+
+/// Returns an object to the slab.
+/// @param ptr Object to return, may be NULL.
+void slab_free(struct Slab* slab, void* ptr);
+
+/// Frees every block of the slab, including objects still in use.
+void slab_destroy(struct Slab* slab);
+
+/// Makes large seat grids use explicit huge pages (MAP_HUGETLB), which must be reserved by the administrator.
+/// Without it, or when none are available, large grids ask for transparent huge pages instead.
+void grid_use_hugetlb(int enable);
+
+/// Allocates a zeroed seat grid.
+/// Grids of at least GRID_HUGE_PAGE_MIN bytes are mapped directly, backed by huge pages when possible.
+/// @param size Bytes of the grid.
+/// @return Pointer to the grid, NULL on failure.
+void* grid_alloc(size_t size);
+
+/// Frees a seat grid allocated with grid_alloc.
+/// @param ptr Grid to free, may be NULL.
+/// @param size Bytes of the grid, as given to grid_alloc.
+void grid_free(void* ptr, size_t size);
+
+#endif  // SERVER_MEMORY_H
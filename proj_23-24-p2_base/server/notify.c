@@ -0,0 +1,298 @@
+#include "notify.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "common/messages.h"
+#include "seats.h"
+
+//Records fitting in one atomic write
+#define CHANGES_PER_MESSAGE ((PIPE_BUF - sizeof(notify_header)) / sizeof(seat_change))
+
+/// Queued seat change, with its arrival order for coalescing.
+struct PendingChange {
+  seat_change change;
+  size_t seq;
+};
+
+/// Notification state of a session.
+struct Subscriber {
+  int fd;                                  /// Notification FIFO, -1 while the session has no subscriptions.
+  unsigned int events[NOTIFY_MAX_EVENTS];  /// Events subscribed to.
+  size_t event_count;                      /// Number of entries of events.
+  struct PendingChange* pending;           /// Changes not yet written, NOTIFY_QUEUE_SIZE entries.
+  size_t pending_len;                      /// Number of queued changes.
+  int resync;                              /// 1 if changes were dropped and the resync marker is not yet written.
+  pthread_mutex_t mutex;                   /// Protects the subscriber against the flusher.
+};
+
+static struct Subscriber* subscribers = NULL;
+static unsigned int subscriber_count = 0;
+static atomic_uint subscription_count = 0;
+static unsigned int window = NOTIFY_WINDOW_MS;
+static pthread_t flusher;
+static int flusher_running = 0;
+static pthread_mutex_t flusher_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t flusher_stop = PTHREAD_COND_INITIALIZER;
+
+/// Checks whether a subscriber follows an event.
+/// @note The subscriber mutex must be held.
+static int is_subscribed(const struct Subscriber* sub, unsigned int event_id) {
+  for (size_t i = 0; i < sub->event_count; i++) {
+    if (sub->events[i] == event_id) return 1;
+  }
+  return 0;
+}
+
+/// Drops every subscription of a subscriber and closes its FIFO.
+/// @note The subscriber mutex must be held.
+static void reset_subscriber(struct Subscriber* sub) {
+  if (sub->fd != -1) close(sub->fd);
+  atomic_fetch_sub(&subscription_count, (unsigned int)sub->event_count);
+  sub->fd = -1;
+  sub->event_count = 0;
+  sub->pending_len = 0;
+  sub->resync = 0;
+}
+
+static int compare_changes(const void* a, const void* b) {
+  const struct PendingChange *x = a, *y = b;
+  if (x->change.event_id != y->change.event_id) return x->change.event_id < y->change.event_id ? -1 : 1;
+  if (x->change.row != y->change.row) return x->change.row < y->change.row ? -1 : 1;
+  if (x->change.col != y->change.col) return x->change.col < y->change.col ? -1 : 1;
+  return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
+
+/// Keeps only the last change of each seat.
+/// @return Number of changes left at the start of the queue.
+static size_t coalesce(struct PendingChange* pending, size_t len) {
+  qsort(pending, len, sizeof(struct PendingChange), compare_changes);
+
+  size_t kept = 0;
+  for (size_t i = 0; i < len; i++) {
+    if (i + 1 < len && pending[i + 1].change.event_id == pending[i].change.event_id &&
+        pending[i + 1].change.row == pending[i].change.row && pending[i + 1].change.col == pending[i].change.col) {
+      continue;
+    }
+    pending[kept++] = pending[i];
+  }
+
+  return kept;
+}
+
+/// Writes one message without blocking.
+/// @return 0 if it was written, EAGAIN if the FIFO is full, another errno value if the client is gone.
+static int write_message(int fd, char kind, const struct PendingChange* changes, size_t count) {
+  char message[PIPE_BUF];
+  notify_header header = {.kind = kind, .count = (unsigned int)count};
+  memcpy(message, &header, sizeof(header));
+  for (size_t i = 0; i < count; i++) {
+    memcpy(message + sizeof(header) + i * sizeof(seat_change), &changes[i].change, sizeof(seat_change));
+  }
+
+  //Messages fit in PIPE_BUF, so the write is all or nothing
+  size_t len = sizeof(header) + count * sizeof(seat_change);
+  return write(fd, message, len) == (ssize_t)len ? 0 : errno;
+}
+
+/// Writes the queued changes of a subscriber.
+static void flush_subscriber(struct Subscriber* sub) {
+  pthread_mutex_lock(&sub->mutex);
+  if (sub->fd == -1 || (!sub->resync && sub->pending_len == 0)) {
+    pthread_mutex_unlock(&sub->mutex);
+    return;
+  }
+
+  int ret = 0;
+  if (sub->resync) {
+    ret = write_message(sub->fd, NOTIFY_RESYNC, NULL, 0);
+    if (ret == 0) sub->resync = 0;
+  } else {
+    size_t len = coalesce(sub->pending, sub->pending_len);
+    for (size_t i = 0; i < len && ret == 0; i += CHANGES_PER_MESSAGE) {
+      size_t count = len - i < CHANGES_PER_MESSAGE ? len - i : CHANGES_PER_MESSAGE;
+      ret = write_message(sub->fd, NOTIFY_CHANGES, sub->pending + i, count);
+    }
+    sub->pending_len = 0;
+
+    //Slow subscriber, drop what did not fit instead of buffering it
+    if (ret == EAGAIN) sub->resync = 1;
+  }
+
+  if (ret != 0 && ret != EAGAIN) reset_subscriber(sub);
+  pthread_mutex_unlock(&sub->mutex);
+}
+
+/// Background thread writing out the queued changes once per window.
+static void* flusher_main(void* arg) {
+  (void)arg;
+
+  //Clients may go away at any time, let writes fail with EPIPE instead
+  sigset_t sigset;
+  sigemptyset(&sigset);
+  sigaddset(&sigset, SIGPIPE);
+  pthread_sigmask(SIG_BLOCK, &sigset, NULL);
+
+  pthread_mutex_lock(&flusher_mutex);
+  while (flusher_running) {
+    //Wait out the window, waking up early if notifications are being stopped
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += window / 1000;
+    deadline.tv_nsec += (long)(window % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000L;
+    }
+    pthread_cond_timedwait(&flusher_stop, &flusher_mutex, &deadline);
+    pthread_mutex_unlock(&flusher_mutex);
+
+    for (unsigned int i = 0; i < subscriber_count; i++) flush_subscriber(&subscribers[i]);
+    pthread_mutex_lock(&flusher_mutex);
+  }
+  pthread_mutex_unlock(&flusher_mutex);
+
+  return NULL;
+}
+
+int notify_start(unsigned int session_count, unsigned int window_ms) {
+  subscribers = calloc(session_count, sizeof(struct Subscriber));
+  if (subscribers == NULL) return 1;
+
+  for (unsigned int i = 0; i < session_count; i++) {
+    subscribers[i].fd = -1;
+    subscribers[i].pending = malloc(NOTIFY_QUEUE_SIZE * sizeof(struct PendingChange));
+    if (subscribers[i].pending == NULL) {
+      fprintf(stderr, "Error allocating notification queues\n");
+      return 1;
+    }
+    pthread_mutex_init(&subscribers[i].mutex, NULL);
+  }
+  subscriber_count = session_count;
+  if (window_ms > 0) window = window_ms;
+
+  flusher_running = 1;
+  if (pthread_create(&flusher, NULL, flusher_main, NULL) != 0) {
+    flusher_running = 0;
+    return 1;
+  }
+
+  return 0;
+}
+
+void notify_stop(void) {
+  if (subscribers == NULL) return;
+
+  pthread_mutex_lock(&flusher_mutex);
+  int running = flusher_running;
+  flusher_running = 0;
+  pthread_cond_signal(&flusher_stop);
+  pthread_mutex_unlock(&flusher_mutex);
+  if (running) pthread_join(flusher, NULL);
+
+  for (unsigned int i = 0; i < subscriber_count; i++) {
+    reset_subscriber(&subscribers[i]);
+    free(subscribers[i].pending);
+    pthread_mutex_destroy(&subscribers[i].mutex);
+  }
+  free(subscribers);
+  subscribers = NULL;
+  subscriber_count = 0;
+}
+
+int notify_subscribe(unsigned int session_id, const char* fifo_name, unsigned int event_id) {
+  if (session_id >= subscriber_count) return 1;
+  struct Subscriber* sub = &subscribers[session_id];
+
+  pthread_mutex_lock(&sub->mutex);
+  if (is_subscribed(sub, event_id)) {
+    pthread_mutex_unlock(&sub->mutex);
+    return 0;
+  }
+  if (sub->event_count == NOTIFY_MAX_EVENTS) {
+    fprintf(stderr, "Too many subscriptions\n");
+    pthread_mutex_unlock(&sub->mutex);
+    return 1;
+  }
+
+  //The client opens its end for reading before subscribing, so this does not block
+  if (sub->fd == -1 && (sub->fd = open(fifo_name, O_WRONLY | O_NONBLOCK)) == -1) {
+    fprintf(stderr, "Error opening notification pipe\n");
+    pthread_mutex_unlock(&sub->mutex);
+    return 1;
+  }
+
+  sub->events[sub->event_count++] = event_id;
+  atomic_fetch_add(&subscription_count, 1);
+  pthread_mutex_unlock(&sub->mutex);
+  return 0;
+}
+
+int notify_unsubscribe(unsigned int session_id, unsigned int event_id) {
+  if (session_id >= subscriber_count) return 1;
+  struct Subscriber* sub = &subscribers[session_id];
+
+  pthread_mutex_lock(&sub->mutex);
+  for (size_t i = 0; i < sub->event_count; i++) {
+    if (sub->events[i] != event_id) continue;
+
+    sub->events[i] = sub->events[--sub->event_count];
+    atomic_fetch_sub(&subscription_count, 1);
+    pthread_mutex_unlock(&sub->mutex);
+    return 0;
+  }
+
+  pthread_mutex_unlock(&sub->mutex);
+  return 1;
+}
+
+void notify_session_end(unsigned int session_id) {
+  if (session_id >= subscriber_count) return;
+
+  pthread_mutex_lock(&subscribers[session_id].mutex);
+  reset_subscriber(&subscribers[session_id]);
+  pthread_mutex_unlock(&subscribers[session_id].mutex);
+}
+
+void notify_seats(unsigned int event_id, size_t cols, const void* seats, unsigned int width, size_t count,
+                  unsigned int reservation_id) {
+  //Nobody listening, the common case
+  if (atomic_load(&subscription_count) == 0 || count == 0) return;
+
+  for (unsigned int i = 0; i < subscriber_count; i++) {
+    struct Subscriber* sub = &subscribers[i];
+    pthread_mutex_lock(&sub->mutex);
+    if (!is_subscribed(sub, event_id) || sub->resync) {
+      pthread_mutex_unlock(&sub->mutex);
+      continue;
+    }
+
+    //Too far behind, the resync marker replaces the queue
+    if (sub->pending_len + count > NOTIFY_QUEUE_SIZE) {
+      sub->pending_len = 0;
+      sub->resync = 1;
+      pthread_mutex_unlock(&sub->mutex);
+      continue;
+    }
+
+    for (size_t j = 0; j < count; j++) {
+      struct PendingChange* pending = &sub->pending[sub->pending_len];
+      pending->change.event_id = event_id;
+      pending->change.reservation_id = reservation_id;
+      size_t index = seat_index_get(seats, width, j);
+      pending->change.row = index / cols + 1;
+      pending->change.col = index % cols + 1;
+      pending->seq = sub->pending_len++;
+    }
+    pthread_mutex_unlock(&sub->mutex);
+  }
+}
@@ -0,0 +1,52 @@
+#ifndef SERVER_NOTIFY_H
+#define SERVER_NOTIFY_H
+
+#include <stddef.h>
+
+/// Seat changes are pushed to subscribed sessions through a notification FIFO of their own, so they never
+/// interleave with responses.
+///
+/// Changes are queued per session and written by a background thread once per window, coalescing repeated changes
+/// of the same seat. Each message is a notify_header followed by its seat_change records, and fits in PIPE_BUF
+/// bytes so it is written atomically. A session that does not keep up has its queue dropped and gets a
+/// NOTIFY_RESYNC message instead, after which it must SHOW its events again.
+
+#define NOTIFY_WINDOW_MS 20      // Period of the background flush, changes within it are coalesced
+#define NOTIFY_QUEUE_SIZE 1024   // Seat changes queued per session before it is sent a resync
+#define NOTIFY_MAX_EVENTS 16     // Events a session may subscribe to
+
+/// Starts the background thread pushing notifications.
+/// @param session_count Number of sessions that may subscribe.
+/// @param window_ms Coalescing window, 0 for the default.
+/// @return 0 if notifications were started, 1 otherwise.
+int notify_start(unsigned int session_count, unsigned int window_ms);
+
+/// Stops the background thread and closes every notification FIFO.
+void notify_stop(void);
+
+/// Subscribes a session to the seat changes of an event.
+/// @param session_id Session subscribing.
+/// @param fifo_name Notification FIFO of the client, opened on the first subscription of the session.
+/// @param event_id Event to subscribe to.
+/// @return 0 if the session was subscribed, 1 otherwise.
+int notify_subscribe(unsigned int session_id, const char* fifo_name, unsigned int event_id);
+
+/// Unsubscribes a session from an event.
+/// @return 0 if the session was unsubscribed, 1 if it was not subscribed.
+int notify_unsubscribe(unsigned int session_id, unsigned int event_id);
+
+/// Drops the subscriptions of a session and closes its notification FIFO.
+void notify_session_end(unsigned int session_id);
+
+/// Queues seat changes of an event for its subscribers.
+/// @note Called with the event mutex held, so changes of an event are queued in order.
+/// @param event_id Event whose seats changed.
+/// @param cols Number of columns of the event, to turn seat indices into coordinates.
+/// @param seats Row-major indices of the seats that changed.
+/// @param width Bytes per entry of seats, see seat_index_width.
+/// @param count Number of seats.
+/// @param reservation_id New reservation id of the seats, 0 if they were freed.
+void notify_seats(unsigned int event_id, size_t cols, const void* seats, unsigned int width, size_t count,
+                  unsigned int reservation_id);
+
+#endif  // SERVER_NOTIFY_H
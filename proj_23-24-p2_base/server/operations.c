@@ -1,26 +1,66 @@
+#include <errno.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
 #include <time.h>
 #include <unistd.h>
 
+#include "common/constants.h"
 #include "common/io.h"
+#include "arena.h"
+#include "cache.h"
 #include "eventlist.h"
+#include "flight.h"
+#include "notify.h"
+#include "operations.h"
+#include "render.h"
+#include "replication.h"
+
+#define STATE_MAGIC "EMSS"
+#define STATE_VERSION 1
+
+/// Header of an exported state, followed by event_count events.
+struct StateHeader {
+  char magic[4];         /// STATE_MAGIC.
+  uint32_t version;      /// STATE_VERSION.
+  uint64_t event_count;  /// Number of events.
+} __attribute__((packed));
+
+/// Exported event, followed by its reservations in id order: each is a uint64_t seat count and that many uint64_t
+/// seat indices, a count of 0 marking a cancelled reservation.
+struct StateEvent {
+  uint32_t id;            /// Event id.
+  uint32_t reservations;  /// Number of reservations ever made.
+  uint64_t rows;          /// Number of rows.
+  uint64_t cols;          /// Number of columns.
+} __attribute__((packed));
 
 static struct EventList* event_list = NULL;
 static unsigned int state_access_delay_us = 0;
 
 /// Gets the event with the given ID from the state.
-/// @note Will wait to simulate a real system accessing a costly memory resource.
+/// @note Will wait to simulate a real system accessing a costly memory resource, unless the event is cached.
 /// @param event_id The ID of the event to get.
-/// @param from First node to be searched.
-/// @param to Last node to be searched.
 /// @return Pointer to the event if found, NULL otherwise.
-static struct Event* get_event_with_delay(unsigned int event_id, struct ListNode* from, struct ListNode* to) {
+static struct Event* get_event_with_delay(unsigned int event_id) {
+  //Recently used events skip the costly access
+  struct Event* event = cache_lookup(event_id);
+  if (event != NULL) return event;
+
+  //Concurrent lookups of the same event share a single access
+  if (!flight_board(event_id, &event)) return event;
+
   struct timespec delay = {0, state_access_delay_us * 1000};
   nanosleep(&delay, NULL);  // Should not be removed
 
-  return get_event(event_list, event_id, from, to);
+  event = index_find(event_list, event_id);
+  if (event != NULL) cache_insert(event_id, event);
+  flight_land(event);
+  return event;
 }
 
 /**
@@ -41,12 +81,247 @@ struct EventList* get_event_list(){
 /// @return Index of the seat.
 static size_t seat_index(struct Event* event, size_t row, size_t col) { return (row - 1) * event->cols + col - 1; }
 
-int ems_init(unsigned int delay_us) {
+/// Gets the seat indices of a reservation, in the seat arena of its event.
+/// @return Array of res->count indices of event->res_seat_width bytes.
+static void* reservation_seats(struct Event* event, const struct Reservation* res) {
+  return (char*)event->res_seats + res->offset * event->res_seat_width;
+}
+
+/// Drops the seats of cancelled reservations from the seat arena of an event.
+/// @note Reservations are stored in id order, so a single forward pass keeps the arena contiguous.
+/// @param event Event whose arena is compacted.
+static void compact_reservation_seats(struct Event* event) {
+  size_t len = 0;
+  for (size_t i = 0; i < event->reservations; i++) {
+    struct Reservation* res = &event->res_index[i];
+    if (res->count == 0) continue;
+
+    memmove((char*)event->res_seats + len * event->res_seat_width, reservation_seats(event, res),
+            res->count * event->res_seat_width);
+    res->offset = len;
+    len += res->count;
+  }
+
+  event->res_seats_len = len;
+  event->res_seats_dead = 0;
+}
+
+/// Makes room in the reservation index of an event for one more reservation of num_seats seats.
+/// @param event Event whose index is grown.
+/// @param num_seats Number of seats of the new reservation.
+/// @return 0 if the index has enough room, 1 otherwise.
+static int reserve_index_room(struct Event* event, size_t num_seats) {
+  if (event->reservations >= event->res_index_cap) {
+    size_t cap = event->res_index_cap ? event->res_index_cap * 2 : 16;
+    struct Reservation* index = realloc(event->res_index, cap * sizeof(struct Reservation));
+    if (index == NULL) return 1;
+
+    event->res_index = index;
+    event->res_index_cap = cap;
+  }
+
+  if (event->res_seats_dead > event->res_seats_len / 2) {
+    compact_reservation_seats(event);
+  }
+
+  if (event->res_seats_len + num_seats > event->res_seats_cap) {
+    size_t cap = event->res_seats_cap ? event->res_seats_cap * 2 : 64;
+    while (cap < event->res_seats_len + num_seats) cap *= 2;
+
+    void* seats = realloc(event->res_seats, cap * event->res_seat_width);
+    if (seats == NULL) return 1;
+
+    event->res_seats = seats;
+    event->res_seats_cap = cap;
+  }
+
+  return 0;
+}
+
+/// Keeps the occupancy counters of an event in step with the seats of a reservation being taken or released.
+/// @note The event mutex must be held.
+/// @param taken 1 if the seats were just taken, 0 if they were just released.
+static void count_seats(struct Event* event, const void* seats, size_t count, int taken) {
+  if (count == 0) return;
+
+  for (size_t i = 0; i < count; i++) {
+    size_t row = seat_index_get(seats, event->res_seat_width, i) / event->cols;
+    event->row_free[row] = taken ? event->row_free[row] - 1 : event->row_free[row] + 1;
+  }
+
+  event->sold = taken ? event->sold + count : event->sold - count;
+  event->active = taken ? event->active + 1 : event->active - 1;
+}
+
+/// Moves an event to a new version after its seats changed, dropping its snapshot. The next SHOW takes a new one.
+/// @note The event mutex must be held.
+static void invalidate_snapshot(struct Event* event) {
+  event->version++;
+  snapshot_release(event->snapshot);
+  event->snapshot = NULL;
+}
+
+/// Gets a reference to the snapshot of the current version of an event, copying the seats only if they changed
+/// since the last SHOW. Only tiles holding reservations are copied, so memory follows the reserved seats.
+/// @note The event mutex must be held.
+/// @return Snapshot to be released with snapshot_release, NULL on failure.
+static struct Snapshot* acquire_snapshot(struct Event* event) {
+  //The cached seats and text are only handed out for the version they were taken from
+  if (event->snapshot != NULL && event->snapshot->version != event->version) {
+    snapshot_release(event->snapshot);
+    event->snapshot = NULL;
+  }
+
+  if (event->snapshot == NULL) {
+    size_t count = event->rows * event->cols;
+    size_t tile_count = event->seats.tile_count;
+    struct Snapshot* snapshot = malloc(sizeof(struct Snapshot) + sizeof(struct iovec) * tile_count);
+    if (snapshot == NULL) {
+      fprintf(stderr, "Error allocating memory for snapshot\n");
+      return NULL;
+    }
+
+    atomic_init(&snapshot->refs, 1);
+    snapshot->version = event->version;
+    snapshot->rows = event->rows;
+    snapshot->cols = event->cols;
+    snapshot->width = event->seats.width;
+    snapshot->text = NULL;
+    snapshot->text_parts = 0;
+    for (size_t i = 0; i < tile_count; i++) {
+      const unsigned int* tile = seat_tile_copy(&event->seats, i);
+      if (tile == NULL) {
+        fprintf(stderr, "Error allocating memory for snapshot\n");
+        snapshot->tile_count = i;
+        snapshot_release(snapshot);
+        return NULL;
+      }
+
+      size_t seats = count - i * SEAT_TILE_SEATS < SEAT_TILE_SEATS ? count - i * SEAT_TILE_SEATS : SEAT_TILE_SEATS;
+      snapshot->tiles[i].iov_base = (void*)tile;
+      snapshot->tiles[i].iov_len = seats * sizeof(unsigned int);
+    }
+    snapshot->tile_count = tile_count;
+    event->snapshot = snapshot;
+  }
+
+  //Hand out a reference, the event keeps its own
+  atomic_fetch_add(&event->snapshot->refs, 1);
+  return event->snapshot;
+}
+
+/// Writes the text blocks of a snapshot in order, resuming after partial writes.
+/// @param count Number of blocks, up to RENDER_MAX_BLOCKS.
+/// @return 0 if every block was written, 1 otherwise.
+static int write_parts(int out_fd, const struct iovec* parts, size_t count) {
+  size_t first = 0;
+  size_t offset = 0;
+  while (first < count) {
+    //Resume from the unwritten part of the first pending block
+    struct iovec pending[RENDER_MAX_BLOCKS];
+    int pending_count = 0;
+    for (size_t i = first; i < count; i++) pending[pending_count++] = parts[i];
+    pending[0].iov_base = (char*)pending[0].iov_base + offset;
+    pending[0].iov_len -= offset;
+
+    ssize_t written = writev(out_fd, pending, pending_count);
+    if (written < 0) {
+      if (errno == EINTR) continue;
+      return 1;
+    }
+
+    size_t left = (size_t)written;
+    while (first < count && left >= parts[first].iov_len - offset) {
+      left -= parts[first].iov_len - offset;
+      offset = 0;
+      first++;
+    }
+    offset += left;
+  }
+
+  return 0;
+}
+
+/// Renders the seats of a snapshot as text, one row per line, unless a previous SHOW already did.
+/// @note The mutex of the event the snapshot is current for must be held.
+/// @return 0 if the text is available, 1 otherwise.
+static int render_snapshot_text(struct Snapshot* snapshot) {
+  if (snapshot->text != NULL) return 0;
+
+  //Large snapshots are rendered in parallel, in blocks of rows
+  return render_seats(snapshot->tiles, snapshot->rows, snapshot->cols, snapshot->width, &snapshot->text,
+                      &snapshot->text_parts);
+}
+
+/// Allocates an event and appends it to the list, without checking that its id is new.
+/// @note The list rwl must be held for writing.
+/// @return The new event, NULL on failure.
+static struct Event* add_event(unsigned int event_id, size_t num_rows, size_t num_cols) {
+  struct Event* event = slab_alloc(&event_list->event_slab);
+  if (event == NULL) {
+    fprintf(stderr, "Error allocating memory for event\n");
+    return NULL;
+  }
+
+  event->id = event_id;
+  event->rows = num_rows;
+  event->cols = num_cols;
+  event->reservations = 0;
+  event->res_index = NULL;
+  event->res_index_cap = 0;
+  event->res_seats = NULL;
+  event->res_seat_width = seat_index_width(num_rows * num_cols);
+  event->res_seats_len = 0;
+  event->res_seats_cap = 0;
+  event->res_seats_dead = 0;
+  event->sold = 0;
+  event->active = 0;
+  event->version = 0;
+  event->snapshot = NULL;
+  if (pthread_mutex_init(&event->mutex, NULL) != 0) {
+    slab_free(&event_list->event_slab, event);
+    return NULL;
+  }
+  if (seat_grid_init(&event->seats, num_rows * num_cols) != 0) {
+    fprintf(stderr, "Error allocating memory for event data\n");
+    slab_free(&event_list->event_slab, event);
+    return NULL;
+  }
+
+  //Every seat starts free
+  event->row_free = malloc(num_rows * sizeof(size_t));
+  if (event->row_free == NULL && num_rows > 0) {
+    fprintf(stderr, "Error allocating memory for event data\n");
+    seat_grid_destroy(&event->seats);
+    slab_free(&event_list->event_slab, event);
+    return NULL;
+  }
+  for (size_t row = 0; row < num_rows; row++) {
+    event->row_free[row] = num_cols;
+  }
+
+  if (append_to_list(event_list, event) != 0) {
+    fprintf(stderr, "Error appending event to list\n");
+    seat_grid_destroy(&event->seats);
+    free(event->row_free);
+    slab_free(&event_list->event_slab, event);
+    return NULL;
+  }
+
+  return event;
+}
+
+int ems_init(unsigned int delay_us, size_t cache_size) {
   if (event_list != NULL) {
     fprintf(stderr, "EMS state has already been initialized\n");
     return 1;
   }
 
+  if (cache_init(cache_size) != 0) {
+    fprintf(stderr, "Error allocating event cache\n");
+    return 1;
+  }
+
   event_list = create_list();
   state_access_delay_us = delay_us;
 
@@ -65,6 +340,7 @@ int ems_terminate() {
   }
 
   free_list(event_list);
+  cache_destroy();
   pthread_rwlock_unlock(&event_list->rwl);
   return 0;
 }
@@ -80,45 +356,21 @@ int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols) {
     return 1;
   }
 
-  if (get_event_with_delay(event_id, event_list->head, event_list->tail) != NULL) {
+  if (get_event_with_delay(event_id) != NULL) {
     fprintf(stderr, "Event already exists\n");
     pthread_rwlock_unlock(&event_list->rwl);
     return 1;
   }
 
-  struct Event* event = malloc(sizeof(struct Event));
-
+  struct Event* event = add_event(event_id, num_rows, num_cols);
   if (event == NULL) {
-    fprintf(stderr, "Error allocating memory for event\n");
     pthread_rwlock_unlock(&event_list->rwl);
     return 1;
   }
 
-  event->id = event_id;
-  event->rows = num_rows;
-  event->cols = num_cols;
-  event->reservations = 0;
-  if (pthread_mutex_init(&event->mutex, NULL) != 0) {
-    pthread_rwlock_unlock(&event_list->rwl);
-    free(event);
-    return 1;
-  }
-  event->data = calloc(num_rows * num_cols, sizeof(unsigned int));
-
-  if (event->data == NULL) {
-    fprintf(stderr, "Error allocating memory for event data\n");
-    pthread_rwlock_unlock(&event_list->rwl);
-    free(event);
-    return 1;
-  }
-
-  if (append_to_list(event_list, event) != 0) {
-    fprintf(stderr, "Error appending event to list\n");
-    pthread_rwlock_unlock(&event_list->rwl);
-    free(event->data);
-    free(event);
-    return 1;
-  }
+  //New events are usually used right away
+  cache_insert(event_id, event);
+  repl_log_create(event_id, num_rows, num_cols);
 
   pthread_rwlock_unlock(&event_list->rwl);
   return 0;
@@ -130,12 +382,18 @@ int ems_reserve(unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys)
     return 1;
   }
 
+  //An empty reservation would take an id that looks cancelled from the start
+  if (num_seats == 0) {
+    fprintf(stderr, "Reservation without seats\n");
+    return 1;
+  }
+
   if (pthread_rwlock_rdlock(&event_list->rwl) != 0) {
     fprintf(stderr, "Error locking list rwl\n");
     return 1;
   }
 
-  struct Event* event = get_event_with_delay(event_id, event_list->head, event_list->tail);
+  struct Event* event = get_event_with_delay(event_id);
 
   pthread_rwlock_unlock(&event_list->rwl);
 
@@ -157,33 +415,51 @@ int ems_reserve(unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys)
     }
   }
 
-  for (size_t i = 0; i < event->rows * event->cols; i++) {
-    for (size_t j = 0; j < num_seats; j++) {
-      if (seat_index(event, xs[j], ys[j]) != i) {
-        continue;
-      }
-
-      if (event->data[i] != 0) {
-        fprintf(stderr, "Seat already reserved\n");
-        pthread_mutex_unlock(&event->mutex);
-        return 1;
-      }
-
-      break;
-    }
+  if (reserve_index_room(event, num_seats) != 0) {
+    fprintf(stderr, "Error allocating memory for reservation index\n");
+    pthread_mutex_unlock(&event->mutex);
+    return 1;
   }
 
-  unsigned int reservation_id = ++event->reservations;
+  unsigned int reservation_id = event->reservations + 1;
+  struct Reservation* res = &event->res_index[event->reservations];
+  res->offset = event->res_seats_len;
+  res->count = 0;
 
+  //Claim seats directly, undoing the claimed ones if any of them is taken
   for (size_t i = 0; i < num_seats; i++) {
-    event->data[seat_index(event, xs[i], ys[i])] = reservation_id;
+    size_t index = seat_index(event, xs[i], ys[i]);
+
+    unsigned int seat = seat_get(&event->seats, index);
+
+    //Same seat requested twice in one reservation
+    if (seat == reservation_id) continue;
+
+    if (seat != 0 || seat_set(&event->seats, index, reservation_id) != 0) {
+      fprintf(stderr, seat != 0 ? "Seat already reserved\n" : "Error allocating memory for seats\n");
+      for (size_t j = 0; j < res->count; j++) {
+        seat_set(&event->seats, seat_index_get(reservation_seats(event, res), event->res_seat_width, j), 0);
+      }
+      pthread_mutex_unlock(&event->mutex);
+      return 1;
+    }
+
+    seat_index_set(reservation_seats(event, res), event->res_seat_width, res->count++, index);
   }
 
+  void* seats = reservation_seats(event, res);
+  event->res_seats_len += res->count;
+  event->reservations = reservation_id;
+  count_seats(event, seats, res->count, 1);
+  invalidate_snapshot(event);
+  notify_seats(event->id, event->cols, seats, event->res_seat_width, res->count, reservation_id);
+  repl_log_reserve(event->id, reservation_id, seats, event->res_seat_width, res->count);
+
   pthread_mutex_unlock(&event->mutex);
   return 0;
 }
 
-int ems_show(int out_fd, unsigned int event_id) {
+int ems_cancel(unsigned int event_id, unsigned int reservation_id) {
   if (event_list == NULL) {
     fprintf(stderr, "EMS state must be initialized\n");
     return 1;
@@ -194,7 +470,7 @@ int ems_show(int out_fd, unsigned int event_id) {
     return 1;
   }
 
-  struct Event* event = get_event_with_delay(event_id, event_list->head, event_list->tail);
+  struct Event* event = get_event_with_delay(event_id);
 
   pthread_rwlock_unlock(&event_list->rwl);
 
@@ -208,35 +484,75 @@ int ems_show(int out_fd, unsigned int event_id) {
     return 1;
   }
 
-  for (size_t i = 1; i <= event->rows; i++) {
-    for (size_t j = 1; j <= event->cols; j++) {
-      char buffer[16];
-      sprintf(buffer, "%u", event->data[seat_index(event, i, j)]);
+  if (reservation_id == 0 || reservation_id > event->reservations ||
+      event->res_index[reservation_id - 1].count == 0) {
+    fprintf(stderr, "Reservation not found\n");
+    pthread_mutex_unlock(&event->mutex);
+    return 1;
+  }
 
-      if (print_str(out_fd, buffer)) {
-        perror("Error writing to file descriptor");
-        pthread_mutex_unlock(&event->mutex);
-        return 1;
-      }
+  //Release only the seats held by the reservation
+  struct Reservation* res = &event->res_index[reservation_id - 1];
+  void* seats = reservation_seats(event, res);
+  for (size_t i = 0; i < res->count; i++) {
+    seat_set(&event->seats, seat_index_get(seats, event->res_seat_width, i), 0);
+  }
 
-      if (j < event->cols) {
-        if (print_str(out_fd, " ")) {
-          perror("Error writing to file descriptor");
-          pthread_mutex_unlock(&event->mutex);
-          return 1;
-        }
-      }
-    }
+  notify_seats(event->id, event->cols, seats, event->res_seat_width, res->count, 0);
+  repl_log_cancel(event->id, reservation_id);
+  count_seats(event, seats, res->count, 0);
+  event->res_seats_dead += res->count;
+  res->count = 0;
+  invalidate_snapshot(event);
 
-    if (print_str(out_fd, "\n")) {
-      perror("Error writing to file descriptor");
-      pthread_mutex_unlock(&event->mutex);
-      return 1;
-    }
+  pthread_mutex_unlock(&event->mutex);
+  return 0;
+}
+
+int ems_show(int out_fd, unsigned int event_id) {
+  if (event_list == NULL) {
+    fprintf(stderr, "EMS state must be initialized\n");
+    return 1;
+  }
+
+  if (pthread_rwlock_rdlock(&event_list->rwl) != 0) {
+    fprintf(stderr, "Error locking list rwl\n");
+    return 1;
   }
 
+  struct Event* event = get_event_with_delay(event_id);
+
+  pthread_rwlock_unlock(&event_list->rwl);
+
+  if (event == NULL) {
+    fprintf(stderr, "Event not found\n");
+    return 1;
+  }
+
+  if (pthread_mutex_lock(&event->mutex) != 0) {
+    fprintf(stderr, "Error locking mutex\n");
+    return 1;
+  }
+
+  //Format the seats once per version, every SHOW of it shares the text
+  struct Snapshot* snapshot = acquire_snapshot(event);
+  if (snapshot == NULL || render_snapshot_text(snapshot) != 0) {
+    fprintf(stderr, "Error rendering event\n");
+    snapshot_release(snapshot);
+    pthread_mutex_unlock(&event->mutex);
+    return 1;
+  }
   pthread_mutex_unlock(&event->mutex);
-  return 0;
+
+  //Write outside the lock, the snapshot stays valid while referenced
+  int ret = 0;
+  if (write_parts(out_fd, snapshot->text, snapshot->text_parts)) {
+    perror("Error writing to file descriptor");
+    ret = 1;
+  }
+
+  snapshot_release(snapshot);
+  return ret;
 }
 
 int ems_list_events(int out_fd) {
@@ -294,7 +610,7 @@ int ems_list_events(int out_fd) {
 
 
 
-unsigned int* ems_show_to_client(unsigned int event_id, size_t *num_rows, size_t *num_cols){
+struct Snapshot* ems_show_snapshot(unsigned int event_id) {
   //Verify initial conditions
   if (event_list == NULL) {
     fprintf(stderr, "EMS state must be initialized\n");
@@ -307,7 +623,7 @@ unsigned int* ems_show_to_client(unsigned int event_id, size_t *num_rows, size_t
   }
 
   //Get event and lock it
-  struct Event* event = get_event_with_delay(event_id, event_list->head, event_list->tail);
+  struct Event* event = get_event_with_delay(event_id);
   pthread_rwlock_unlock(&event_list->rwl);
 
   //Validate
@@ -320,25 +636,14 @@ unsigned int* ems_show_to_client(unsigned int event_id, size_t *num_rows, size_t
     return NULL;
   }
 
-  //Read seat list
-  unsigned int* seats = malloc(sizeof(unsigned int) * event->rows * event->cols);
-
-  for (size_t i = 1; i <= event->rows; i++) {
-    for (size_t j = 1; j <= event->cols; j++) {
-      seats[seat_index(event, i, j)] = event->data[seat_index(event, i, j)];
-    }
-  }
-
-  //Set size arguments
-  *num_rows = event->rows;
-  *num_cols = event->cols;
+  struct Snapshot* snapshot = acquire_snapshot(event);
 
   //Unlock and return
   pthread_mutex_unlock(&event->mutex);
-  return seats;
+  return snapshot;
 }
 
-unsigned int* ems_list_events_to_client(size_t* length){
+unsigned int* ems_list_events_to_client(size_t* length, struct Arena* arena){
   //Verify initial conditions
   if (event_list == NULL) {
     fprintf(stderr, "EMS state must be initialized\n");
@@ -362,7 +667,12 @@ unsigned int* ems_list_events_to_client(size_t* length){
   }
 
   //Create array
-  unsigned int* events = malloc(sizeof(unsigned int) * (size_t)event_list->size);
+  unsigned int* events = arena_alloc(arena, sizeof(unsigned int) * (size_t)event_list->size);
+  if (events == NULL) {
+    fprintf(stderr, "Error allocating memory for event list\n");
+    pthread_rwlock_unlock(&event_list->rwl);
+    return NULL;
+  }
 
   //Read event ids
   int i = 0;
@@ -382,3 +692,414 @@ unsigned int* ems_list_events_to_client(size_t* length){
   pthread_rwlock_unlock(&event_list->rwl);
   return events;
 }
+
+/// Counts the seats of an event not held by any reservation.
+static size_t free_seats(struct Event* event) {
+  pthread_mutex_lock(&event->mutex);
+  size_t sold = event->sold;
+  pthread_mutex_unlock(&event->mutex);
+  return event->rows * event->cols - sold;
+}
+
+int ems_list_page(unsigned int from_id, unsigned int to_id, size_t min_free_seats, size_t page_size,
+                  unsigned int* ids, size_t* count, unsigned int* next_id, int* more) {
+  if (event_list == NULL) {
+    fprintf(stderr, "EMS state must be initialized\n");
+    return 1;
+  }
+
+  //Walk the index without the list lock, a page only ever waits on the events it filters
+  *count = 0;
+  *more = 0;
+  size_t scanned = 0;
+  struct IndexNode* node = from_id <= to_id ? index_seek(event_list, from_id) : NULL;
+  for (; node != NULL && node->id <= to_id; node = index_next(node)) {
+    //Page full, or a selective filter already skipped many events: the client continues from here
+    if (*count == page_size || scanned++ == LIST_PAGE_SCAN_MAX) {
+      *next_id = node->id;
+      *more = 1;
+      break;
+    }
+
+    if (min_free_seats > 0 && free_seats(node->event) < min_free_seats) continue;
+    ids[(*count)++] = node->id;
+  }
+
+  return 0;
+}
+
+int ems_stats(unsigned int event_id, struct EventStats* stats, struct Arena* arena) {
+  if (event_list == NULL) {
+    fprintf(stderr, "EMS state must be initialized\n");
+    return 1;
+  }
+
+  if (pthread_rwlock_rdlock(&event_list->rwl) != 0) {
+    fprintf(stderr, "Error locking list rwl\n");
+    return 1;
+  }
+
+  struct Event* event = get_event_with_delay(event_id);
+
+  pthread_rwlock_unlock(&event_list->rwl);
+
+  if (event == NULL) {
+    return 1;
+  }
+
+  //Rows never change, so the array can be sized before taking the mutex
+  stats->row_free = arena_alloc(arena, event->rows * sizeof(size_t));
+  if (stats->row_free == NULL && event->rows > 0) {
+    fprintf(stderr, "Error allocating memory for stats\n");
+    return 1;
+  }
+
+  //Counters are maintained by every seat change, reading them costs nothing per seat
+  pthread_mutex_lock(&event->mutex);
+  stats->rows = event->rows;
+  stats->cols = event->cols;
+  stats->sold = event->sold;
+  stats->reservations = event->active;
+  if (event->rows > 0) memcpy(stats->row_free, event->row_free, event->rows * sizeof(size_t));
+  pthread_mutex_unlock(&event->mutex);
+
+  return 0;
+}
+
+int ems_reservation_seats(unsigned int event_id, unsigned int reservation_id, size_t* num_seats, size_t** xs,
+                          size_t** ys, struct Arena* arena) {
+  if (event_list == NULL) {
+    fprintf(stderr, "EMS state must be initialized\n");
+    return 1;
+  }
+
+  if (pthread_rwlock_rdlock(&event_list->rwl) != 0) {
+    fprintf(stderr, "Error locking list rwl\n");
+    return 1;
+  }
+
+  struct Event* event = get_event_with_delay(event_id);
+
+  pthread_rwlock_unlock(&event_list->rwl);
+
+  if (event == NULL) {
+    fprintf(stderr, "Event not found\n");
+    return 1;
+  }
+
+  pthread_mutex_lock(&event->mutex);
+
+  if (reservation_id == 0 || reservation_id > event->reservations ||
+      event->res_index[reservation_id - 1].count == 0) {
+    fprintf(stderr, "Reservation not found\n");
+    pthread_mutex_unlock(&event->mutex);
+    return 1;
+  }
+
+  //Only the seats of the reservation are read, the grid is never scanned
+  struct Reservation* res = &event->res_index[reservation_id - 1];
+  *xs = arena_alloc(arena, res->count * sizeof(size_t));
+  *ys = arena_alloc(arena, res->count * sizeof(size_t));
+  if (*xs == NULL || *ys == NULL) {
+    fprintf(stderr, "Error allocating memory for reservation seats\n");
+    pthread_mutex_unlock(&event->mutex);
+    return 1;
+  }
+
+  const void* seats = reservation_seats(event, res);
+  for (size_t i = 0; i < res->count; i++) {
+    size_t index = seat_index_get(seats, event->res_seat_width, i);
+    (*xs)[i] = index / event->cols + 1;
+    (*ys)[i] = index % event->cols + 1;
+  }
+  *num_seats = res->count;
+
+  pthread_mutex_unlock(&event->mutex);
+  return 0;
+}
+
+int ems_export(int fd) {
+  if (event_list == NULL) {
+    fprintf(stderr, "EMS state must be initialized\n");
+    return 1;
+  }
+
+  //Buffer the many small records, the descriptor itself stays open
+  int dup_fd = dup(fd);
+  FILE* out = dup_fd == -1 ? NULL : fdopen(dup_fd, "w");
+  if (out == NULL) {
+    if (dup_fd != -1) close(dup_fd);
+    return 1;
+  }
+
+  if (pthread_rwlock_wrlock(&event_list->rwl) != 0) {
+    fprintf(stderr, "Error locking list rwl\n");
+    fclose(out);
+    return 1;
+  }
+
+  struct StateHeader header = {.version = STATE_VERSION, .event_count = (uint64_t)event_list->size};
+  memcpy(header.magic, STATE_MAGIC, sizeof(header.magic));
+  int ret = fwrite(&header, sizeof(header), 1, out) != 1;
+
+  //Seats are rebuilt from the reservations, which also keeps CANCEL working after the import
+  for (struct ListNode* node = event_list->head; node != NULL && ret == 0; node = node->next) {
+    struct Event* event = node->event;
+    pthread_mutex_lock(&event->mutex);
+
+    struct StateEvent record = {event->id, event->reservations, event->rows, event->cols};
+    ret = fwrite(&record, sizeof(record), 1, out) != 1;
+    for (size_t i = 0; i < event->reservations && ret == 0; i++) {
+      struct Reservation* res = &event->res_index[i];
+      uint64_t count = res->count;
+      ret = fwrite(&count, sizeof(count), 1, out) != 1;
+      for (size_t j = 0; j < res->count && ret == 0; j++) {
+        uint64_t index = seat_index_get(reservation_seats(event, res), event->res_seat_width, j);
+        ret = fwrite(&index, sizeof(index), 1, out) != 1;
+      }
+    }
+
+    pthread_mutex_unlock(&event->mutex);
+    if (node == event_list->tail) break;
+  }
+
+  pthread_rwlock_unlock(&event_list->rwl);
+  if (fclose(out) != 0) ret = 1;
+  return ret;
+}
+
+/// Cursor over an exported state.
+struct StateReader {
+  const char* pos;  /// Next byte to read.
+  const char* end;  /// End of the state.
+};
+
+/// Reads len bytes of the state.
+/// @return 0 if the bytes were read, 1 if the state is truncated.
+static int state_read(struct StateReader* reader, void* buf, size_t len) {
+  if ((size_t)(reader->end - reader->pos) < len) return 1;
+
+  memcpy(buf, reader->pos, len);
+  reader->pos += len;
+  return 0;
+}
+
+/// Cancels every reservation of an event, so it can be rebuilt from an export.
+/// @note The event mutex must be held.
+static void clear_reservations(struct Event* event) {
+  for (unsigned int id = 1; id <= event->reservations; id++) {
+    struct Reservation* res = &event->res_index[id - 1];
+    void* seats = reservation_seats(event, res);
+    for (size_t i = 0; i < res->count; i++) {
+      seat_set(&event->seats, seat_index_get(seats, event->res_seat_width, i), 0);
+    }
+
+    notify_seats(event->id, event->cols, seats, event->res_seat_width, res->count, 0);
+    count_seats(event, seats, res->count, 0);
+    res->count = 0;
+  }
+
+  event->reservations = 0;
+  event->res_seats_len = 0;
+  event->res_seats_dead = 0;
+  invalidate_snapshot(event);
+}
+
+/// Rebuilds the reservations of one exported event.
+/// @note The event mutex must be held.
+/// @return 0 if the reservations were rebuilt, 1 otherwise.
+static int import_reservations(struct StateReader* reader, struct Event* event, unsigned int reservations) {
+  size_t seat_count = event->rows * event->cols;
+  for (unsigned int id = 1; id <= reservations; id++) {
+    uint64_t count;
+    if (state_read(reader, &count, sizeof(count)) != 0 || count > seat_count ||
+        reserve_index_room(event, count) != 0) {
+      return 1;
+    }
+
+    struct Reservation* res = &event->res_index[id - 1];
+    res->offset = event->res_seats_len;
+    size_t taken = 0;
+    uint64_t index;
+    while (taken < count && state_read(reader, &index, sizeof(index)) == 0 && index < seat_count &&
+           seat_set(&event->seats, index, id) == 0) {
+      seat_index_set(reservation_seats(event, res), event->res_seat_width, taken++, index);
+    }
+
+    //Seats taken before a failure stay recorded, so the next import clears them
+    res->count = taken;
+    event->res_seats_len += taken;
+    event->reservations = id;
+    count_seats(event, reservation_seats(event, res), taken, 1);
+    notify_seats(event->id, event->cols, reservation_seats(event, res), event->res_seat_width, taken, id);
+    if (taken < count) return 1;
+  }
+
+  invalidate_snapshot(event);
+  return 0;
+}
+
+/// Rebuilds one exported event, with its reservations. An event that already exists, on a replica resyncing with
+/// its primary, has its reservations replaced.
+/// @note The list rwl must be held for writing.
+/// @return 0 if the event was rebuilt, 1 otherwise.
+static int import_event(struct StateReader* reader) {
+  struct StateEvent record;
+  if (state_read(reader, &record, sizeof(record)) != 0) return 1;
+
+  struct Event* event = index_find(event_list, record.id);
+  if (event != NULL && (event->rows != record.rows || event->cols != record.cols)) return 1;
+  if (event == NULL) event = add_event(record.id, record.rows, record.cols);
+  if (event == NULL) return 1;
+
+  //Readers find events without the list rwl
+  pthread_mutex_lock(&event->mutex);
+  clear_reservations(event);
+  int ret = import_reservations(reader, event, record.reservations);
+  pthread_mutex_unlock(&event->mutex);
+  return ret;
+}
+
+int ems_import(int fd) {
+  if (event_list == NULL) {
+    fprintf(stderr, "EMS state must be initialized\n");
+    return 1;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(struct StateHeader)) {
+    fprintf(stderr, "Invalid exported state\n");
+    return 1;
+  }
+
+  size_t size = (size_t)st.st_size;
+  const char* data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (data == MAP_FAILED) {
+    fprintf(stderr, "Error mapping exported state\n");
+    return 1;
+  }
+
+  struct StateReader reader = {data, data + size};
+  struct StateHeader header;
+  state_read(&reader, &header, sizeof(header));
+  if (memcmp(header.magic, STATE_MAGIC, sizeof(header.magic)) != 0 || header.version != STATE_VERSION) {
+    fprintf(stderr, "Invalid exported state\n");
+    munmap((void*)data, size);
+    return 1;
+  }
+
+  if (pthread_rwlock_wrlock(&event_list->rwl) != 0) {
+    fprintf(stderr, "Error locking list rwl\n");
+    munmap((void*)data, size);
+    return 1;
+  }
+
+  int ret = 0;
+  for (uint64_t i = 0; i < header.event_count && ret == 0; i++) {
+    ret = import_event(&reader);
+  }
+  if (ret != 0) fprintf(stderr, "Invalid exported state\n");
+
+  pthread_rwlock_unlock(&event_list->rwl);
+  munmap((void*)data, size);
+  return ret;
+}
+
+int ems_apply_create(unsigned int event_id, size_t num_rows, size_t num_cols) {
+  if (pthread_rwlock_wrlock(&event_list->rwl) != 0) {
+    fprintf(stderr, "Error locking list rwl\n");
+    return 1;
+  }
+
+  //Created before the primary exported its state
+  int ret = index_find(event_list, event_id) == NULL && add_event(event_id, num_rows, num_cols) == NULL;
+
+  pthread_rwlock_unlock(&event_list->rwl);
+  return ret;
+}
+
+int ems_apply_reserve(unsigned int event_id, unsigned int reservation_id, size_t num_seats, const size_t* seats) {
+  //Replicas only apply what the primary already paid the access delay for
+  struct Event* event = index_find(event_list, event_id);
+  if (event == NULL) {
+    fprintf(stderr, "Event not found\n");
+    return 1;
+  }
+
+  pthread_mutex_lock(&event->mutex);
+
+  //Made before the primary exported its state
+  if (reservation_id <= event->reservations) {
+    pthread_mutex_unlock(&event->mutex);
+    return 0;
+  }
+
+  if (reservation_id != event->reservations + 1 || reserve_index_room(event, num_seats) != 0) {
+    fprintf(stderr, "Error applying reservation\n");
+    pthread_mutex_unlock(&event->mutex);
+    return 1;
+  }
+
+  struct Reservation* res = &event->res_index[event->reservations];
+  res->offset = event->res_seats_len;
+  res->count = num_seats;
+  void* res_seats = reservation_seats(event, res);
+  for (size_t i = 0; i < num_seats; i++) {
+    if (seat_set(&event->seats, seats[i], reservation_id) != 0) {
+      //Freeing seats never allocates, undo the ones already taken and leave the replica to resync
+      fprintf(stderr, "Error applying reservation\n");
+      while (i-- > 0) seat_set(&event->seats, seats[i], 0);
+      pthread_mutex_unlock(&event->mutex);
+      return 1;
+    }
+    seat_index_set(res_seats, event->res_seat_width, i, seats[i]);
+  }
+
+  event->res_seats_len += num_seats;
+  event->reservations = reservation_id;
+  count_seats(event, res_seats, num_seats, 1);
+  invalidate_snapshot(event);
+  notify_seats(event->id, event->cols, res_seats, event->res_seat_width, res->count, reservation_id);
+
+  pthread_mutex_unlock(&event->mutex);
+  return 0;
+}
+
+int ems_apply_cancel(unsigned int event_id, unsigned int reservation_id) {
+  //Replicas only apply what the primary already paid the access delay for
+  struct Event* event = index_find(event_list, event_id);
+  if (event == NULL) {
+    fprintf(stderr, "Event not found\n");
+    return 1;
+  }
+
+  pthread_mutex_lock(&event->mutex);
+
+  if (reservation_id == 0 || reservation_id > event->reservations) {
+    fprintf(stderr, "Reservation not found\n");
+    pthread_mutex_unlock(&event->mutex);
+    return 1;
+  }
+
+  //Cancelled before the primary exported its state, or nothing left to release
+  struct Reservation* res = &event->res_index[reservation_id - 1];
+  void* seats = reservation_seats(event, res);
+  for (size_t i = 0; i < res->count; i++) {
+    if (seat_set(&event->seats, seat_index_get(seats, event->res_seat_width, i), 0) != 0) {
+      fprintf(stderr, "Error applying cancellation\n");
+      pthread_mutex_unlock(&event->mutex);
+      return 1;
+    }
+  }
+
+  if (res->count > 0) {
+    notify_seats(event->id, event->cols, seats, event->res_seat_width, res->count, 0);
+    count_seats(event, seats, res->count, 0);
+    event->res_seats_dead += res->count;
+    res->count = 0;
+    invalidate_snapshot(event);
+  }
+
+  pthread_mutex_unlock(&event->mutex);
+  return 0;
+}
@@ -3,10 +3,13 @@
 
 #include <stddef.h>
 
+#include "arena.h"
+
 /// Initializes the EMS state.
 /// @param delay_us Delay in microseconds.
+/// @param cache_size Number of events cached in front of the delayed state access, 0 to disable caching.
 /// @return 0 if the EMS state was initialized successfully, 1 otherwise.
-int ems_init(unsigned int delay_us);
+int ems_init(unsigned int delay_us, size_t cache_size);
 
 /// Destroys the EMS state.
 int ems_terminate();
@@ -20,12 +23,18 @@ int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols);
 
 /// Creates a new reservation for the given event.
 /// @param event_id Id of the event to create a reservation for.
-/// @param num_seats Number of seats to reserve.
+/// @param num_seats Number of seats to reserve, at least 1.
 /// @param xs Array of rows of the seats to reserve.
 /// @param ys Array of columns of the seats to reserve.
 /// @return 0 if the reservation was created successfully, 1 otherwise.
 int ems_reserve(unsigned int event_id, size_t num_seats, size_t *xs, size_t *ys);
 
+/// Cancels a reservation, releasing all of its seats.
+/// @param event_id Id of the event the reservation belongs to.
+/// @param reservation_id Id of the reservation to cancel.
+/// @return 0 if the reservation was cancelled successfully, 1 otherwise.
+int ems_cancel(unsigned int event_id, unsigned int reservation_id);
+
 /// Prints the given event.
 /// @param out_fd File descriptor to print the event to.
 /// @param event_id Id of the event to print.
@@ -37,15 +46,79 @@ int ems_show(int out_fd, unsigned int event_id);
 /// @return 0 if the events were printed successfully, 1 otherwise.
 int ems_list_events(int out_fd);
 
-/// Returns all the events in array.
+/// Returns a snapshot of the seats of an event.
 /// @param event_id Id of the event to return.
-/// @param length length of the array
-/// @return array of events
-unsigned int* ems_show_to_client(unsigned int event_id, size_t *num_rows, size_t *num_cols);
+/// @return Snapshot shared with other callers, to be released with snapshot_release, NULL on failure.
+struct Snapshot* ems_show_snapshot(unsigned int event_id);
 
 /// Returns all the events in array.
 /// @param length length of the array
-/// @return array of events
-unsigned int* ems_list_events_to_client(size_t* length);
+/// @param arena Arena the array is allocated from.
+/// @return array of events, valid until the arena is reset
+unsigned int* ems_list_events_to_client(size_t* length, struct Arena* arena);
+
+/// Lists a page of the events with ids in a range, in id order, without holding the list lock.
+/// @param from_id First event id of the page.
+/// @param to_id Last event id of the range.
+/// @param min_free_seats Only events with at least this many free seats are listed, 0 to list all.
+/// @param page_size Most event ids written to ids.
+/// @param ids Array of page_size entries the event ids are written to.
+/// @param count Set to the number of ids written.
+/// @param next_id Set to the first id of the next page, when there is one.
+/// @param more Set to 1 if the range has events past this page, 0 otherwise.
+/// @return 0 if the page was listed, 1 otherwise.
+int ems_list_page(unsigned int from_id, unsigned int to_id, size_t min_free_seats, size_t page_size,
+                  unsigned int* ids, size_t* count, unsigned int* next_id, int* more);
+
+/// Occupancy of one event.
+struct EventStats {
+  size_t rows;                /// Number of rows.
+  size_t cols;                /// Number of columns.
+  size_t sold;                /// Seats held by a reservation.
+  unsigned int reservations;  /// Reservations holding seats, cancelled ones excluded.
+  size_t* row_free;           /// Free seats of each row, rows entries.
+};
+
+/// Gets the occupancy of an event from the counters kept by every reservation and cancellation.
+/// @param event_id Id of the event.
+/// @param stats Filled with the occupancy of the event.
+/// @param arena Arena the free seats of each row are allocated from.
+/// @return 0 if the event was found, 1 otherwise.
+int ems_stats(unsigned int event_id, struct EventStats* stats, struct Arena* arena);
+
+/// Gets the seats held by a reservation from the reservation index, in time linear in its seats.
+/// @param event_id Id of the event.
+/// @param reservation_id Id of the reservation.
+/// @param num_seats Set to the number of seats of the reservation.
+/// @param xs Set to the rows of the seats, in the order they were reserved, allocated from the arena.
+/// @param ys Set to the columns of the seats, allocated from the arena.
+/// @param arena Arena the coordinates are allocated from.
+/// @return 0 if the reservation holds seats, 1 if it does not exist or was cancelled.
+int ems_reservation_seats(unsigned int event_id, unsigned int reservation_id, size_t* num_seats, size_t** xs,
+                          size_t** ys, struct Arena* arena);
+
+/// Writes every event, with its reservations, to a file descriptor.
+/// @param fd File descriptor to write the state to.
+/// @return 0 if the state was exported successfully, 1 otherwise.
+int ems_export(int fd);
+
+/// Adds the events of a state written by ems_export, skipping the access delay. Events that already exist have their
+/// reservations replaced by the exported ones.
+/// @param fd File the state was exported to, read from its start.
+/// @return 0 if the state was imported successfully, 1 otherwise.
+int ems_import(int fd);
+
+/// Creates an event logged by the primary, unless the replica already has it.
+/// @return 0 if the event exists, 1 otherwise.
+int ems_apply_create(unsigned int event_id, size_t num_rows, size_t num_cols);
+
+/// Makes a reservation logged by the primary, unless the replica already has it.
+/// @param seats Seat indices of the reservation, already checked by the primary.
+/// @return 0 if the reservation exists, 1 otherwise.
+int ems_apply_reserve(unsigned int event_id, unsigned int reservation_id, size_t num_seats, const size_t* seats);
+
+/// Cancels a reservation logged by the primary, unless the replica already cancelled it.
+/// @return 0 if the reservation is cancelled, 1 otherwise.
+int ems_apply_cancel(unsigned int event_id, unsigned int reservation_id);
 
 #endif  // SERVER_OPERATIONS_H
@@ -0,0 +1,211 @@
+#include "render.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+
+#include "common/io.h"
+#include "seats.h"
+
+/// Rendering of one snapshot, shared by the thread asking for it and the helpers.
+/// @note Every field but the seats, parts and layout is protected by the pool mutex.
+struct RenderJob {
+  const struct iovec* tiles;  /// Tiles of the seats to render.
+  size_t cols;                /// Number of columns.
+  size_t rows;                /// Number of rows.
+  unsigned int width;         /// Cell width the seats came from.
+  size_t block_rows;          /// Rows of every block but the last.
+  size_t blocks;              /// Number of blocks.
+  struct iovec* parts;        /// Text of each block, filled in as they are rendered.
+
+  size_t claimed;             /// Blocks handed out.
+  size_t done;                /// Blocks rendered.
+  int failed;                 /// Whether a block could not be rendered.
+  pthread_cond_t finished;    /// Signaled when the last block is rendered.
+  struct RenderJob* next;     /// Next job waiting for helpers.
+};
+
+static size_t parallel_min = RENDER_PARALLEL_MIN_SEATS;
+
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_work = PTHREAD_COND_INITIALIZER;
+static struct RenderJob* pool_jobs = NULL;  // Jobs with blocks left to hand out, oldest first
+
+void render_set_parallel_min(size_t min_seats) { parallel_min = min_seats; }
+
+/// Renders seats copied from a grid with 8 bit cells, at most 3 digits each.
+/// @param col Column of the first seat, set to the column following the last one.
+/// @return End of the text written.
+static char* render_u8(const unsigned int* seats, size_t count, size_t cols, size_t* col, char* out) {
+  for (size_t i = 0; i < count; i++) {
+    unsigned int value = seats[i];
+    if (value >= 100) *out++ = (char)('0' + value / 100);
+    if (value >= 10) *out++ = (char)('0' + value / 10 % 10);
+    *out++ = (char)('0' + value % 10);
+    *out++ = ++*col == cols ? '\n' : ' ';
+    if (*col == cols) *col = 0;
+  }
+
+  return out;
+}
+
+/// Renders seats of any width.
+/// @param col Column of the first seat, set to the column following the last one.
+/// @return End of the text written.
+static char* render_any(const unsigned int* seats, size_t count, size_t cols, size_t* col, char* out) {
+  for (size_t i = 0; i < count; i++) {
+    out += format_uint(out, seats[i]);
+    *out++ = ++*col == cols ? '\n' : ' ';
+    if (*col == cols) *col = 0;
+  }
+
+  return out;
+}
+
+/// Renders whole rows of seats into a new buffer.
+/// @param first Row-major index of the first seat of the rows.
+/// @return 0 if the rows were rendered, 1 otherwise.
+static int render_rows(const struct iovec* tiles, size_t first, size_t rows, size_t cols, unsigned int width,
+                       struct iovec* part) {
+  //Up to 3, 5 or 10 digits depending on the cell width, and a separator per seat
+  size_t count = rows * cols;
+  size_t digits = width == 1 ? 3 : width == 2 ? 5 : 10;
+  char* text = malloc(count * (digits + 1) + 1);
+  if (text == NULL) return 1;
+
+  //Rows may start and end anywhere in a tile, render the piece of each tile they cover
+  char* end = text;
+  size_t col = 0;
+  while (count > 0) {
+    const unsigned int* seats = (const unsigned int*)tiles[first / SEAT_TILE_SEATS].iov_base + first % SEAT_TILE_SEATS;
+    size_t len = SEAT_TILE_SEATS - first % SEAT_TILE_SEATS;
+    if (len > count) len = count;
+
+    end = width == 1 ? render_u8(seats, len, cols, &col, end) : render_any(seats, len, cols, &col, end);
+    first += len;
+    count -= len;
+  }
+  part->iov_base = text;
+  part->iov_len = (size_t)(end - text);
+  return 0;
+}
+
+/// Claims and renders blocks of a job until none is left to hand out.
+/// @note The pool mutex must be held, it is released while rendering. The job may be gone once this returns.
+static void run_blocks(struct RenderJob* job) {
+  while (job->claimed < job->blocks) {
+    size_t block = job->claimed++;
+    if (job->claimed == job->blocks) {
+      //Nothing left to hand out, take the job off the queue
+      struct RenderJob** link = &pool_jobs;
+      while (*link != NULL && *link != job) link = &(*link)->next;
+      if (*link != NULL) *link = job->next;
+    }
+    pthread_mutex_unlock(&pool_mutex);
+
+    size_t first = block * job->block_rows;
+    size_t rows = block + 1 == job->blocks ? job->rows - first : job->block_rows;
+    int ret = render_rows(job->tiles, first * job->cols, rows, job->cols, job->width, &job->parts[block]);
+
+    pthread_mutex_lock(&pool_mutex);
+    job->failed |= ret;
+    if (++job->done == job->blocks) {
+      pthread_cond_signal(&job->finished);
+      return;
+    }
+  }
+}
+
+/// Renders blocks of queued jobs, forever.
+static void* helper_main(void* arg) {
+  (void)arg;
+
+  pthread_mutex_lock(&pool_mutex);
+  while (1) {
+    while (pool_jobs == NULL) pthread_cond_wait(&pool_work, &pool_mutex);
+    run_blocks(pool_jobs);
+  }
+
+  return NULL;
+}
+
+/// Starts the helpers, on the first parallel rendering.
+static void start_helpers(void) {
+  //Helpers never take signals, they are left to the threads that handle them
+  sigset_t all, old;
+  sigfillset(&all);
+  pthread_sigmask(SIG_BLOCK, &all, &old);
+
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  for (int i = 0; i < RENDER_HELPERS; i++) {
+    //Missing helpers only mean fewer threads rendering, the caller renders whatever is left
+    pthread_t thread;
+    pthread_create(&thread, &attr, helper_main, NULL);
+  }
+  pthread_attr_destroy(&attr);
+
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+}
+
+int render_seats(const struct iovec* tiles, size_t rows, size_t cols, unsigned int width, struct iovec** parts,
+                 size_t* count) {
+  //Split into blocks of whole rows, only as many as are worth handing out
+  size_t seats_count = rows * cols;
+  size_t blocks = 1;
+  if (parallel_min != 0 && seats_count >= parallel_min) {
+    blocks = RENDER_MAX_BLOCKS;
+    if (blocks > seats_count / RENDER_MIN_BLOCK_SEATS) blocks = seats_count / RENDER_MIN_BLOCK_SEATS;
+    if (blocks > rows) blocks = rows;
+    if (blocks == 0) blocks = 1;
+  }
+
+  *parts = calloc(blocks, sizeof(struct iovec));
+  if (*parts == NULL) return 1;
+  *count = blocks;
+
+  //Small snapshots keep the single-threaded path
+  if (blocks == 1) {
+    if (render_rows(tiles, 0, rows, cols, width, &(*parts)[0]) != 0) {
+      render_free(*parts, 1);
+      return 1;
+    }
+    return 0;
+  }
+
+  pthread_once(&pool_once, start_helpers);
+
+  struct RenderJob job = {.tiles = tiles, .cols = cols, .rows = rows, .width = width,
+                          .block_rows = (rows + blocks - 1) / blocks, .parts = *parts, .next = NULL};
+  //Rounding up the block rows may leave trailing blocks empty, drop them
+  job.blocks = (rows + job.block_rows - 1) / job.block_rows;
+  *count = job.blocks;
+  pthread_cond_init(&job.finished, NULL);
+
+  //Queue the job for the helpers and render alongside them
+  pthread_mutex_lock(&pool_mutex);
+  struct RenderJob** link = &pool_jobs;
+  while (*link != NULL) link = &(*link)->next;
+  *link = &job;
+  pthread_cond_broadcast(&pool_work);
+
+  run_blocks(&job);
+  while (job.done < job.blocks) pthread_cond_wait(&job.finished, &pool_mutex);
+  pthread_mutex_unlock(&pool_mutex);
+  pthread_cond_destroy(&job.finished);
+
+  if (job.failed) {
+    render_free(*parts, job.blocks);
+    return 1;
+  }
+  return 0;
+}
+
+void render_free(struct iovec* parts, size_t count) {
+  if (parts == NULL) return;
+
+  for (size_t i = 0; i < count; i++) free(parts[i].iov_base);
+  free(parts);
+}
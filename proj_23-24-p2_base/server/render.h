@@ -0,0 +1,39 @@
+#ifndef SERVER_RENDER_H
+#define SERVER_RENDER_H
+
+#include <stddef.h>
+#include <sys/uio.h>
+
+#define RENDER_HELPERS 3                     // Threads helping whoever renders a large snapshot
+#define RENDER_PARALLEL_MIN_SEATS (1 << 20)  // Smallest snapshot rendered in parallel, unless changed at startup
+#define RENDER_BLOCKS_PER_THREAD 4           // Row blocks per rendering thread, so uneven blocks even out
+#define RENDER_MIN_BLOCK_SEATS 65536         // Smallest row block worth handing to another thread
+#define RENDER_MAX_BLOCKS ((RENDER_HELPERS + 1) * RENDER_BLOCKS_PER_THREAD)  // Most blocks a snapshot is split into
+
+/// Text rendering of seats, one row per line, seats separated by spaces.
+///
+/// Snapshots below the parallel threshold are rendered by the calling thread into a single buffer. Larger ones are
+/// split into blocks of whole rows, rendered into separate buffers by a pool of helpers started on first use, with
+/// the calling thread rendering blocks as well. The blocks are meant to be written out in order with writev.
+
+/// Sets the smallest number of seats rendered in parallel.
+/// @param min_seats Seats of the smallest snapshot split into blocks, 0 to always render on the calling thread.
+void render_set_parallel_min(size_t min_seats);
+
+/// Renders seats as text.
+/// @param tiles Reservation ids of the seats, in row-major order, in tiles of SEAT_TILE_SEATS.
+/// @param rows Number of rows.
+/// @param cols Number of columns.
+/// @param width Cell width of the grid the seats came from, in bytes, bounding their values.
+/// @param parts Set to the text blocks, in order, to be freed with render_free.
+/// @param count Set to the number of blocks.
+/// @return 0 if the seats were rendered, 1 otherwise.
+int render_seats(const struct iovec* tiles, size_t rows, size_t cols, unsigned int width, struct iovec** parts,
+                 size_t* count);
+
+/// Frees text blocks made by render_seats.
+/// @param parts Blocks to free, may be NULL.
+/// @param count Number of blocks.
+void render_free(struct iovec* parts, size_t count);
+
+#endif  // SERVER_RENDER_H
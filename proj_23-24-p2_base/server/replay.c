@@ -0,0 +1,356 @@
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "common/constants.h"
+#include "common/messages.h"
+#include "arena.h"
+#include "cache.h"
+#include "eventlist.h"
+#include "operations.h"
+#include "trace.h"
+
+#define OPCODE_COUNT (MSG_SEATS + 1)
+
+static const char* opcode_names[OPCODE_COUNT] = {"?",         "setup",    "quit",      "create",
+                                                 "reserve",   "show",     "list",      "cancel",
+                                                 "subscribe", "unsubscribe", "staleness", "list_page",
+                                                 "stats",     "seats"};
+
+/// Latencies measured for one opcode.
+struct OpStats {
+  uint64_t* latencies_ns;
+  size_t count;
+  double mean_us;
+  double p50_us;
+  double p99_us;
+};
+
+/// Summary of a replay, as written to and read from summary files.
+struct Summary {
+  struct OpStats ops[OPCODE_COUNT];
+  size_t total;
+  double seconds;
+  double throughput;
+};
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/// Executes a traced request against the EMS state, as process_command would.
+/// Request-scoped buffers come from arena, as they do in a worker.
+static void execute(const struct TraceEntry* entry, struct Arena* arena) {
+  const char* payload = entry->payload;
+  size_t len = entry->record.payload_len;
+
+  switch (entry->record.opcode) {
+    case MSG_CREATE: {
+      create_request req;
+      if (len < sizeof(req)) return;
+      memcpy(&req, payload, sizeof(req));
+      ems_create(req.event_id, req.num_rows, req.num_cols);
+      break;
+    }
+
+    case MSG_RESERVE: {
+      reserve_request req;
+      if (len < sizeof(req)) return;
+      memcpy(&req, payload, sizeof(req));
+      if (len != sizeof(req) + 2 * req.num_seats * sizeof(size_t)) return;
+
+      size_t* xs = arena_alloc(arena, req.num_seats * sizeof(size_t));
+      size_t* ys = arena_alloc(arena, req.num_seats * sizeof(size_t));
+      if (xs != NULL && ys != NULL) {
+        memcpy(xs, payload + sizeof(req), req.num_seats * sizeof(size_t));
+        memcpy(ys, payload + sizeof(req) + req.num_seats * sizeof(size_t), req.num_seats * sizeof(size_t));
+        ems_reserve(req.event_id, req.num_seats, xs, ys);
+      }
+      break;
+    }
+
+    case MSG_CANCEL: {
+      cancel_request req;
+      if (len < sizeof(req)) return;
+      memcpy(&req, payload, sizeof(req));
+      ems_cancel(req.event_id, req.reservation_id);
+      break;
+    }
+
+    case MSG_SHOW: {
+      show_request req;
+      if (len < sizeof(req)) return;
+      memcpy(&req, payload, sizeof(req));
+      snapshot_release(ems_show_snapshot(req.event_id));
+      break;
+    }
+
+    case MSG_LIST: {
+      size_t count;
+      ems_list_events_to_client(&count, arena);
+      break;
+    }
+
+    case MSG_LIST_PAGE: {
+      list_page_request req;
+      if (len < sizeof(req)) return;
+      memcpy(&req, payload, sizeof(req));
+
+      size_t page_size = req.page_size == 0 || req.page_size > LIST_PAGE_MAX ? LIST_PAGE_MAX : req.page_size;
+      unsigned int* ids = arena_alloc(arena, page_size * sizeof(unsigned int));
+      size_t count;
+      unsigned int next_id;
+      int more;
+      if (ids != NULL) {
+        ems_list_page(req.from_id, req.to_id, req.min_free_seats, page_size, ids, &count, &next_id, &more);
+      }
+      break;
+    }
+
+    case MSG_STATS: {
+      stats_request req;
+      if (len < sizeof(req)) return;
+      memcpy(&req, payload, sizeof(req));
+      if (len != sizeof(req) + req.num_events * sizeof(unsigned int) || req.num_events > STATS_MAX_EVENTS) return;
+
+      for (size_t i = 0; i < req.num_events; i++) {
+        unsigned int event_id;
+        struct EventStats stats;
+        memcpy(&event_id, payload + sizeof(req) + i * sizeof(unsigned int), sizeof(unsigned int));
+        ems_stats(event_id, &stats, arena);
+      }
+      break;
+    }
+
+    case MSG_SEATS: {
+      seats_request req;
+      if (len < sizeof(req)) return;
+      memcpy(&req, payload, sizeof(req));
+
+      size_t num_seats;
+      size_t *xs, *ys;
+      ems_reservation_seats(req.event_id, req.reservation_id, &num_seats, &xs, &ys, arena);
+      break;
+    }
+
+    default:
+      break;
+  }
+}
+
+static int compare_u64(const void* a, const void* b) {
+  uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+  return x < y ? -1 : x > y;
+}
+
+/// Computes mean and percentiles of every opcode.
+static void summarize(struct Summary* summary) {
+  for (int op = 0; op < OPCODE_COUNT; op++) {
+    struct OpStats* stats = &summary->ops[op];
+    if (stats->count == 0) continue;
+
+    qsort(stats->latencies_ns, stats->count, sizeof(uint64_t), compare_u64);
+    double sum = 0;
+    for (size_t i = 0; i < stats->count; i++) sum += (double)stats->latencies_ns[i];
+
+    stats->mean_us = sum / (double)stats->count / 1e3;
+    stats->p50_us = (double)stats->latencies_ns[stats->count / 2] / 1e3;
+    stats->p99_us = (double)stats->latencies_ns[(stats->count * 99) / 100] / 1e3;
+  }
+}
+
+/// Prints a summary, in the format read back by read_summary.
+static void write_summary(FILE* out, const struct Summary* summary) {
+  fprintf(out, "total %zu %.6f %.1f\n", summary->total, summary->seconds, summary->throughput);
+  for (int op = 0; op < OPCODE_COUNT; op++) {
+    const struct OpStats* stats = &summary->ops[op];
+    if (stats->count == 0) continue;
+    fprintf(out, "%s %zu %.1f %.1f %.1f\n", opcode_names[op], stats->count, stats->mean_us, stats->p50_us,
+            stats->p99_us);
+  }
+}
+
+/// Reads a summary written by write_summary.
+/// @return 0 if the summary was read, 1 otherwise.
+static int read_summary(const char* path, struct Summary* summary) {
+  FILE* in = fopen(path, "r");
+  if (in == NULL) return 1;
+
+  memset(summary, 0, sizeof(*summary));
+  if (fscanf(in, "total %zu %lf %lf\n", &summary->total, &summary->seconds, &summary->throughput) != 3) {
+    fclose(in);
+    return 1;
+  }
+
+  char name[16];
+  size_t count;
+  double mean, p50, p99;
+  while (fscanf(in, "%15s %zu %lf %lf %lf\n", name, &count, &mean, &p50, &p99) == 5) {
+    for (int op = 0; op < OPCODE_COUNT; op++) {
+      if (strcmp(name, opcode_names[op]) != 0) continue;
+      summary->ops[op] = (struct OpStats){NULL, count, mean, p50, p99};
+    }
+  }
+
+  fclose(in);
+  return 0;
+}
+
+/// Relative change from base to value, in percent.
+static double delta(double base, double value) { return base > 0 ? (value - base) / base * 100 : 0; }
+
+/// Prints how a summary compares with a baseline summary.
+static void print_deltas(const struct Summary* base, const struct Summary* current) {
+  printf("Compared with baseline:\n");
+  printf("  throughput %.1f -> %.1f req/s (%+.1f%%)\n", base->throughput, current->throughput,
+         delta(base->throughput, current->throughput));
+  for (int op = 0; op < OPCODE_COUNT; op++) {
+    const struct OpStats* b = &base->ops[op];
+    const struct OpStats* c = &current->ops[op];
+    if (b->count == 0 || c->count == 0) continue;
+    printf("  %-8s mean %+.1f%%  p50 %+.1f%%  p99 %+.1f%%\n", opcode_names[op], delta(b->mean_us, c->mean_us),
+           delta(b->p50_us, c->p50_us), delta(b->p99_us, c->p99_us));
+  }
+}
+
+/**
+ * Replays a request trace recorded by the server (ems -t) straight into the EMS operations,
+ * and reports throughput and per-opcode latency.
+ *
+ * Usage: replay [-s scale] [-c cache_size] [-o summary_file] [-b baseline_file] <trace_file> [delay]
+ *   -s: 0 replays as fast as possible (default), otherwise arrival times are multiplied by scale.
+ *   -c: number of events cached in front of the delayed state access, 0 disables the cache.
+ *   -o: writes the summary to a file, to be used as the baseline of another build.
+ *   -b: compares the replay with a summary written by another build.
+ *   delay: state access delay in microseconds, as given to the server.
+ */
+int main(int argc, char* argv[]) {
+  double scale = 0;
+  char* summary_path = NULL;
+  char* baseline_path = NULL;
+  size_t cache_size = EVENT_CACHE_SIZE;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "s:c:o:b:")) != -1) {
+    switch (opt) {
+      case 's':
+        scale = strtod(optarg, NULL);
+        break;
+      case 'c':
+        cache_size = strtoul(optarg, NULL, 10);
+        break;
+      case 'o':
+        summary_path = optarg;
+        break;
+      case 'b':
+        baseline_path = optarg;
+        break;
+      default:
+        return 1;
+    }
+  }
+
+  if (argc - optind < 1 || argc - optind > 2 || scale < 0) {
+    fprintf(stderr, "Usage: %s [-s scale] [-c cache_size] [-o summary_file] [-b baseline_file] <trace_file> [delay]\n", argv[0]);
+    return 1;
+  }
+
+  unsigned int delay_us = STATE_ACCESS_DELAY_US;
+  if (argc - optind == 2) {
+    char* endptr;
+    unsigned long delay = strtoul(argv[optind + 1], &endptr, 10);
+    if (*endptr != '\0' || delay > UINT_MAX) {
+      fprintf(stderr, "Invalid delay value or value too large\n");
+      return 1;
+    }
+    delay_us = (unsigned int)delay;
+  }
+
+  struct TraceEntry* entries;
+  size_t count;
+  char* data;
+  if (trace_load(argv[optind], &entries, &count, &data)) return 1;
+
+  if (ems_init(delay_us, cache_size)) {
+    fprintf(stderr, "Failed to initialize EMS\n");
+    return 1;
+  }
+
+  struct Summary summary;
+  memset(&summary, 0, sizeof(summary));
+  for (int op = 0; op < OPCODE_COUNT; op++) {
+    summary.ops[op].latencies_ns = malloc(count * sizeof(uint64_t) + 1);
+  }
+
+  //Replay in arrival order, on a single thread so the outcome is deterministic
+  struct Arena arena;
+  arena_init(&arena);
+  uint64_t start = now_ns();
+  for (size_t i = 0; i < count; i++) {
+    const struct TraceEntry* entry = &entries[i];
+    int op = entry->record.opcode;
+    if (op <= 0 || op >= OPCODE_COUNT) continue;
+
+    if (scale > 0) {
+      uint64_t due = start + (uint64_t)((double)entry->record.timestamp_ns * scale);
+      uint64_t now = now_ns();
+      if (due > now) {
+        struct timespec delay = {(time_t)((due - now) / 1000000000ULL), (long)((due - now) % 1000000000ULL)};
+        nanosleep(&delay, NULL);
+      }
+    }
+
+    uint64_t before = now_ns();
+    execute(entry, &arena);
+    arena_reset(&arena);
+    summary.ops[op].latencies_ns[summary.ops[op].count++] = now_ns() - before;
+    summary.total++;
+  }
+  arena_destroy(&arena);
+
+  summary.seconds = (double)(now_ns() - start) / 1e9;
+  summary.throughput = summary.seconds > 0 ? (double)summary.total / summary.seconds : 0;
+  summarize(&summary);
+
+  printf("Replayed %zu requests in %.3f s (%.1f req/s)\n", summary.total, summary.seconds, summary.throughput);
+  unsigned long hits, misses;
+  cache_stats(&hits, &misses);
+  printf("Event cache: %lu hits, %lu misses\n", hits, misses);
+  printf("  %-8s %8s %12s %12s %12s\n", "opcode", "count", "mean_us", "p50_us", "p99_us");
+  for (int op = 0; op < OPCODE_COUNT; op++) {
+    const struct OpStats* stats = &summary.ops[op];
+    if (stats->count == 0) continue;
+    printf("  %-8s %8zu %12.1f %12.1f %12.1f\n", opcode_names[op], stats->count, stats->mean_us, stats->p50_us,
+           stats->p99_us);
+  }
+
+  if (summary_path != NULL) {
+    FILE* out = fopen(summary_path, "w");
+    if (out == NULL) {
+      fprintf(stderr, "Failed to open summary file\n");
+    } else {
+      write_summary(out, &summary);
+      fclose(out);
+    }
+  }
+
+  if (baseline_path != NULL) {
+    struct Summary baseline;
+    if (read_summary(baseline_path, &baseline)) {
+      fprintf(stderr, "Failed to read baseline summary\n");
+    } else {
+      print_deltas(&baseline, &summary);
+    }
+  }
+
+  for (int op = 0; op < OPCODE_COUNT; op++) free(summary.ops[op].latencies_ns);
+  free(entries);
+  free(data);
+  ems_terminate();
+  return 0;
+}
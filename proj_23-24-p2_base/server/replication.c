@@ -0,0 +1,394 @@
+#include "replication.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "handoff.h"
+#include "operations.h"
+#include "seats.h"
+
+/// Replica connected to the primary.
+struct Replica {
+  int sock;         /// Connection to the replica.
+  uint64_t cursor;  /// Log offset of the next byte to send.
+};
+
+//===Primary state===
+static char* log_ring = NULL;       // Last REPL_LOG_SIZE bytes of log
+static uint64_t log_head = 0;       // Bytes ever appended to the log
+static atomic_int log_enabled = 0;  // Set once the first replica connects, nothing is logged before
+static pthread_mutex_t log_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t log_grown = PTHREAD_COND_INITIALIZER;
+static int listener = -1;
+static const char* listener_path = NULL;
+
+//===Replica state===
+static int is_replica = 0;
+static const char* primary_path = NULL;
+static int primary_sock = -1;
+static atomic_ulong synced_at_ms = 0;  // Last time the whole log of the primary was applied
+static atomic_int resyncing = 0;       // Set while the log is lost, until the events are loaded again
+
+/// Gets the time in milliseconds, from an arbitrary start.
+static unsigned long now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long)ts.tv_sec * 1000 + (unsigned long)ts.tv_nsec / 1000000;
+}
+
+/// Blocks the signals handled by the main thread in the calling thread.
+static void block_signals(void) {
+  sigset_t sigset;
+  sigemptyset(&sigset);
+  sigaddset(&sigset, SIGUSR1);
+  sigaddset(&sigset, SIGUSR2);
+  pthread_sigmask(SIG_BLOCK, &sigset, NULL);
+}
+
+/// Writes exactly len bytes to a socket.
+/// @return 0 if the bytes were written, 1 otherwise.
+static int send_all(int sock, const void* buf, size_t len) {
+  const char* src = buf;
+  while (len > 0) {
+    ssize_t ret = send(sock, src, len, MSG_NOSIGNAL);
+    if (ret == -1 && errno == EINTR) continue;
+    if (ret <= 0) return 1;
+
+    src += ret;
+    len -= (size_t)ret;
+  }
+  return 0;
+}
+
+/// Reads exactly len bytes from a socket.
+/// @return 0 if the bytes were read, 1 on error or end of file.
+static int recv_all(int sock, void* buf, size_t len) {
+  char* dst = buf;
+  while (len > 0) {
+    ssize_t ret = recv(sock, dst, len, 0);
+    if (ret == -1 && errno == EINTR) continue;
+    if (ret <= 0) return 1;
+
+    dst += ret;
+    len -= (size_t)ret;
+  }
+  return 0;
+}
+
+
+//===Primary===
+/// Appends bytes to the log ring.
+/// @note log_mutex must be held.
+static void ring_write(const void* data, size_t len) {
+  size_t pos = (size_t)(log_head % REPL_LOG_SIZE);
+  size_t first = len < REPL_LOG_SIZE - pos ? len : REPL_LOG_SIZE - pos;
+  memcpy(log_ring + pos, data, first);
+  memcpy(log_ring, (const char*)data + first, len - first);
+  log_head += len;
+}
+
+/// Copies bytes out of the log ring.
+/// @note log_mutex must be held, and the bytes must still be in the ring.
+static void ring_read(uint64_t from, void* buf, size_t len) {
+  size_t pos = (size_t)(from % REPL_LOG_SIZE);
+  size_t first = len < REPL_LOG_SIZE - pos ? len : REPL_LOG_SIZE - pos;
+  memcpy(buf, log_ring + pos, first);
+  memcpy((char*)buf + first, log_ring, len - first);
+}
+
+/// Appends a record to the log and wakes the senders.
+static void log_append(const struct ReplRecord* record, const void* seats, unsigned int width) {
+  if (!atomic_load(&log_enabled)) return;
+
+  pthread_mutex_lock(&log_mutex);
+
+  //Too large for the ring: skip past it, so every replica falls behind and resyncs from an export that has it
+  size_t len = sizeof(*record) + record->seat_count * sizeof(uint64_t);
+  if (len > REPL_LOG_SIZE) {
+    fprintf(stderr, "Record larger than the replication log, replicas resync\n");
+    log_head += len;
+    pthread_cond_broadcast(&log_grown);
+    pthread_mutex_unlock(&log_mutex);
+    return;
+  }
+
+  ring_write(record, sizeof(*record));
+  for (size_t i = 0; i < record->seat_count; i++) {
+    uint64_t index = seat_index_get(seats, width, i);
+    ring_write(&index, sizeof(index));
+  }
+  pthread_cond_broadcast(&log_grown);
+  pthread_mutex_unlock(&log_mutex);
+}
+
+void repl_log_create(unsigned int event_id, size_t rows, size_t cols) {
+  struct ReplRecord record = {.kind = REPL_CREATE, .event_id = event_id, .rows = rows, .cols = cols};
+  log_append(&record, NULL, 0);
+}
+
+void repl_log_reserve(unsigned int event_id, unsigned int reservation_id, const void* seats, unsigned int width,
+                      size_t count) {
+  struct ReplRecord record = {
+      .kind = REPL_RESERVE, .event_id = event_id, .reservation_id = reservation_id, .seat_count = count};
+  log_append(&record, seats, width);
+}
+
+void repl_log_cancel(unsigned int event_id, unsigned int reservation_id) {
+  struct ReplRecord record = {.kind = REPL_CANCEL, .event_id = event_id, .reservation_id = reservation_id};
+  log_append(&record, NULL, 0);
+}
+
+/// Streams the log to a replica until it disconnects or falls too far behind.
+static void* sender_thread_main(void* arg) {
+  struct Replica* replica = arg;
+  struct ReplRecord heartbeat = {.kind = REPL_HEARTBEAT};
+  char* chunk = malloc(REPL_SEND_CHUNK);
+
+  pthread_mutex_lock(&log_mutex);
+  while (chunk != NULL) {
+    //Caught up: wait for more, telling the replica it is in sync every period
+    if (replica->cursor == log_head) {
+      struct timespec deadline;
+      clock_gettime(CLOCK_REALTIME, &deadline);
+      deadline.tv_nsec += REPL_HEARTBEAT_MS * 1000000L;
+      if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+      }
+      pthread_cond_timedwait(&log_grown, &log_mutex, &deadline);
+
+      if (replica->cursor == log_head) {
+        pthread_mutex_unlock(&log_mutex);
+        int ret = send_all(replica->sock, &heartbeat, sizeof(heartbeat));
+        pthread_mutex_lock(&log_mutex);
+        if (ret) break;
+        continue;
+      }
+    }
+
+    if (log_head - replica->cursor > REPL_LOG_SIZE) {
+      fprintf(stderr, "Replica fell behind the replication log, disconnecting it\n");
+      break;
+    }
+
+    //Send outside the lock, records keep being appended meanwhile
+    size_t len = log_head - replica->cursor < REPL_SEND_CHUNK ? (size_t)(log_head - replica->cursor) : REPL_SEND_CHUNK;
+    ring_read(replica->cursor, chunk, len);
+    replica->cursor += len;
+    int caught_up = replica->cursor == log_head;
+    pthread_mutex_unlock(&log_mutex);
+
+    int ret = send_all(replica->sock, chunk, len) || (caught_up && send_all(replica->sock, &heartbeat, sizeof(heartbeat)));
+    pthread_mutex_lock(&log_mutex);
+    if (ret) break;
+  }
+  pthread_mutex_unlock(&log_mutex);
+
+  close(replica->sock);
+  free(replica);
+  free(chunk);
+  return NULL;
+}
+
+/// Accepts replicas, sending each the exported events before streaming the log to it.
+static void* accept_thread_main(void* arg) {
+  (void)arg;
+  block_signals();
+
+  while (1) {
+    int sock = handoff_accept(listener);
+    if (sock == -1) return NULL;
+
+    //Log from now on, the export may already contain some of the records that follow
+    pthread_mutex_lock(&log_mutex);
+    atomic_store(&log_enabled, 1);
+    uint64_t start = log_head;
+    pthread_mutex_unlock(&log_mutex);
+
+    int state_fd = handoff_state_file();
+    int ret = state_fd == -1 || ems_export(state_fd) != 0;
+    if (ret == 0) {
+      int fds[] = {state_fd};
+      struct HandoffMessage msg = {.kind = HANDOFF_STATE, .pending_len = 0};
+      ret = handoff_send(sock, &msg, fds, 1, NULL);
+    }
+    if (state_fd != -1) close(state_fd);
+
+    struct Replica* replica = ret == 0 ? malloc(sizeof(struct Replica)) : NULL;
+    pthread_t thread;
+    if (replica == NULL) {
+      fprintf(stderr, "Failed to set up replica\n");
+      close(sock);
+      continue;
+    }
+
+    replica->sock = sock;
+    replica->cursor = start;
+    if (pthread_create(&thread, NULL, sender_thread_main, replica) != 0) {
+      close(sock);
+      free(replica);
+      continue;
+    }
+    pthread_detach(thread);
+  }
+}
+
+int repl_primary_start(const char* fifo_path) {
+  log_ring = malloc(REPL_LOG_SIZE);
+  if (log_ring == NULL) return 1;
+
+  listener = handoff_listen(fifo_path, REPL_SOCKET_SUFFIX);
+  if (listener == -1) return 1;
+  listener_path = fifo_path;
+
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, accept_thread_main, NULL) != 0) return 1;
+  pthread_detach(thread);
+  return 0;
+}
+
+void repl_primary_stop(void) {
+  if (listener == -1) return;
+
+  handoff_unlink(listener_path, REPL_SOCKET_SUFFIX);
+}
+
+
+//===Replica===
+/// Applies the log of the primary as it arrives, until the connection is lost or a record cannot be applied.
+/// @param seats Buffer for the seat indices of reservations, grown as needed.
+/// @param seats_cap Capacity of the buffer.
+/// @return 0 if the connection was lost, 1 if the events may no longer match those of the primary.
+static int apply_log(size_t** seats, size_t* seats_cap) {
+  struct ReplRecord record;
+  while (recv_all(primary_sock, &record, sizeof(record)) == 0) {
+    if (record.kind == REPL_HEARTBEAT) {
+      atomic_store(&synced_at_ms, now_ms());
+      continue;
+    }
+
+    if (record.kind == REPL_CREATE) {
+      if (ems_apply_create(record.event_id, record.rows, record.cols) != 0) return 1;
+      continue;
+    }
+
+    if (record.kind == REPL_CANCEL) {
+      if (ems_apply_cancel(record.event_id, record.reservation_id) != 0) return 1;
+      continue;
+    }
+
+    if (record.kind != REPL_RESERVE) {
+      fprintf(stderr, "Invalid replication record\n");
+      return 1;
+    }
+
+    //Seat indices are sent as uint64_t, the same size as size_t on the platforms we run on
+    if (record.seat_count > *seats_cap) {
+      size_t* grown = realloc(*seats, record.seat_count * sizeof(size_t));
+      if (grown == NULL) return 1;
+      *seats = grown;
+      *seats_cap = record.seat_count;
+    }
+    for (size_t i = 0; i < record.seat_count; i++) {
+      uint64_t index;
+      if (recv_all(primary_sock, &index, sizeof(index)) != 0) return 0;
+      (*seats)[i] = index;
+    }
+    if (ems_apply_reserve(record.event_id, record.reservation_id, record.seat_count, *seats) != 0) return 1;
+  }
+
+  return 0;
+}
+
+/// Connects to the primary and loads its events, replacing those already loaded.
+/// @return 0 if the replica is in sync with the primary, 1 otherwise.
+static int sync_with_primary(void) {
+  primary_sock = handoff_connect(primary_path, REPL_SOCKET_SUFFIX);
+  if (primary_sock == -1) return 1;
+
+  struct HandoffMessage msg;
+  int fds[HANDOFF_MAX_FDS];
+  int fd_count;
+  char* pending;
+  if (handoff_recv(primary_sock, &msg, fds, &fd_count, &pending) != 0 || msg.kind != HANDOFF_STATE || fd_count != 1) {
+    fprintf(stderr, "Error receiving the state of the primary\n");
+    close(primary_sock);
+    primary_sock = -1;
+    return 1;
+  }
+  free(pending);
+
+  int ret = ems_import(fds[0]);
+  close(fds[0]);
+  if (ret) {
+    close(primary_sock);
+    primary_sock = -1;
+    return 1;
+  }
+
+  atomic_store(&synced_at_ms, now_ms());
+  atomic_store(&resyncing, 0);
+  return 0;
+}
+
+/// Applies the log of the primary, resyncing whenever it is lost.
+static void* apply_thread_main(void* arg) {
+  (void)arg;
+  block_signals();
+
+  size_t* seats = NULL;
+  size_t seats_cap = 0;
+  while (1) {
+    //Records applied up to a lost connection are a prefix of the log, the replica only gets staler. A record that
+    //could not be applied leaves events the primary never had, reads go to the primary until resynced
+    if (apply_log(&seats, &seats_cap) != 0) {
+      fprintf(stderr, "Failed to apply the log of the primary, resyncing\n");
+      atomic_store(&resyncing, 1);
+    } else {
+      fprintf(stderr, "Lost the log of the primary, resyncing\n");
+    }
+    close(primary_sock);
+    primary_sock = -1;
+
+    do {
+      struct timespec delay = {.tv_sec = 0, .tv_nsec = REPL_RESYNC_DELAY_MS * 1000000L};
+      nanosleep(&delay, NULL);
+    } while (sync_with_primary() != 0);
+    fprintf(stderr, "Resynced with the primary\n");
+  }
+
+  return NULL;
+}
+
+int repl_replica_start(const char* primary_fifo_path) {
+  primary_path = primary_fifo_path;
+  if (sync_with_primary() != 0) {
+    fprintf(stderr, "No primary accepting replicas at %s\n", primary_fifo_path);
+    return 1;
+  }
+
+  is_replica = 1;
+
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, apply_thread_main, NULL) != 0) return 1;
+  pthread_detach(thread);
+  return 0;
+}
+
+int repl_is_replica(void) { return is_replica; }
+
+unsigned int repl_staleness_ms(void) {
+  if (!is_replica) return 0;
+  if (atomic_load(&resyncing)) return UINT32_MAX;
+
+  unsigned long staleness = now_ms() - atomic_load(&synced_at_ms);
+  return staleness > UINT32_MAX ? UINT32_MAX : (unsigned int)staleness;
+}
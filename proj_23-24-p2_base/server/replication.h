@@ -0,0 +1,79 @@
+#ifndef SERVER_REPLICATION_H
+#define SERVER_REPLICATION_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// Read replicas: a primary streams every committed change to replica processes, which serve SHOW and LIST.
+///
+/// A replica connects to the socket next to the registration FIFO of the primary and receives the events exported
+/// to a memory file (see ems_export), then the log of changes committed since the export started. Log records are
+/// applied idempotently, so changes committed while the export runs may appear in both. Whenever a replica has been
+/// sent the whole log, a heartbeat follows: the time the replica last applied one bounds how stale its state is.
+///
+/// Each record is a ReplRecord followed, for REPL_RESERVE, by seat_count uint64_t seat indices. The primary keeps
+/// the log in a ring of REPL_LOG_SIZE bytes; a replica falling further behind is disconnected, as is every replica
+/// when a single record does not fit in the ring. A replica that is disconnected, or fails to apply a record, is
+/// marked stale so reads fall back to the primary, and resyncs from a new export every REPL_RESYNC_DELAY_MS until
+/// it succeeds.
+
+#define REPL_SOCKET_SUFFIX ".replicas"  // Appended to the registration FIFO path to name the socket
+#define REPL_LOG_SIZE (4 << 20)         // Bytes of log kept for replicas that are behind
+#define REPL_HEARTBEAT_MS 10            // Period of the heartbeats sent to replicas that are caught up
+#define REPL_SEND_CHUNK (64 << 10)      // Bytes of log sent to a replica at once
+#define REPL_RESYNC_DELAY_MS 100        // Wait between the attempts of a replica to resync with its primary
+
+/// Kinds of log records.
+enum ReplKind {
+  REPL_CREATE = 1,     /// Event created with rows x cols seats.
+  REPL_RESERVE = 2,    /// Reservation made, with its seat indices.
+  REPL_CANCEL = 3,     /// Reservation cancelled.
+  REPL_HEARTBEAT = 4,  /// The replica has been sent the whole log.
+};
+
+/// Header of a log record.
+struct ReplRecord {
+  char kind;                /// ReplKind.
+  uint32_t event_id;        /// Event changed.
+  uint32_t reservation_id;  /// Reservation made or cancelled.
+  uint64_t rows;            /// Rows of a created event.
+  uint64_t cols;            /// Columns of a created event.
+  uint64_t seat_count;      /// Seat indices following a REPL_RESERVE record.
+} __attribute__((packed));
+
+/// Starts accepting replicas.
+/// @param fifo_path Path of the registration FIFO of the server.
+/// @return 0 if replicas can connect, 1 otherwise.
+int repl_primary_start(const char* fifo_path);
+
+/// Removes the socket replicas connect to.
+void repl_primary_stop(void);
+
+/// Connects to a primary and loads its events, then keeps applying its log in the background, resyncing whenever
+/// the log is lost.
+/// @param primary_fifo_path Path of the registration FIFO of the primary.
+/// @return 0 if the replica is in sync with the primary, 1 otherwise.
+int repl_replica_start(const char* primary_fifo_path);
+
+/// Checks if the server is a replica.
+int repl_is_replica(void);
+
+/// Gets how long ago the replica was last known to be in sync with its primary.
+/// @return Staleness in milliseconds, 0 on a primary.
+unsigned int repl_staleness_ms(void);
+
+/// Logs the creation of an event.
+/// @note Called with the event list locked for writing, so the log follows the order of the changes.
+void repl_log_create(unsigned int event_id, size_t rows, size_t cols);
+
+/// Logs a reservation.
+/// @note Called with the event locked, as are the other changes of an event.
+/// @param seats Seat indices of the reservation, of width bytes each, see seat_index_width.
+void repl_log_reserve(unsigned int event_id, unsigned int reservation_id, const void* seats, unsigned int width,
+                      size_t count);
+
+/// Logs the cancellation of a reservation.
+/// @note Called with the event locked.
+void repl_log_cancel(unsigned int event_id, unsigned int reservation_id);
+
+#endif  // SERVER_REPLICATION_H
@@ -0,0 +1,169 @@
+#include "seats.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "memory.h"
+
+//Seen in place of every tile without reservations, wide enough for any cell width
+static const uint32_t zero_cells[SEAT_TILE_SEATS];
+
+/// Gets the size of a tile with cells of the given width.
+static size_t tile_size(unsigned int width) { return sizeof(struct SeatTile) + (size_t)width * SEAT_TILE_SEATS; }
+
+/// Gets the cells of a tile, for scans.
+/// @return SEAT_TILE_SEATS cells of the grid width, from the shared zeros if none of them is reserved.
+static const void* tile_cells(const struct SeatGrid* grid, size_t tile) {
+  return grid->tiles[tile] == NULL ? (const void*)zero_cells : grid->tiles[tile]->cells;
+}
+
+int seat_grid_init(struct SeatGrid* grid, size_t count) {
+  grid->count = count;
+  grid->tile_count = (count + SEAT_TILE_SEATS - 1) / SEAT_TILE_SEATS;
+  grid->width = 1;
+
+  //Large directories are mapped, so only the pages of reserved tiles are ever touched
+  grid->tiles = grid_alloc(grid->tile_count * sizeof(struct SeatTile*));
+  return grid->tiles == NULL;
+}
+
+void seat_grid_destroy(struct SeatGrid* grid) {
+  if (grid->tiles == NULL) return;
+
+  for (size_t i = 0; i < grid->tile_count; i++) free(grid->tiles[i]);
+  grid_free(grid->tiles, grid->tile_count * sizeof(struct SeatTile*));
+  grid->tiles = NULL;
+}
+
+unsigned int seat_get(const struct SeatGrid* grid, size_t index) {
+  const struct SeatTile* tile = grid->tiles[index / SEAT_TILE_SEATS];
+  if (tile == NULL) return 0;
+
+  size_t offset = index % SEAT_TILE_SEATS;
+  switch (grid->width) {
+    case 1:
+      return tile->cells[offset];
+    case 2:
+      return ((const uint16_t*)tile->cells)[offset];
+    default:
+      return ((const uint32_t*)tile->cells)[offset];
+  }
+}
+
+/// Widens the cells of a tile in place, from the last one so none is overwritten before it is moved.
+static void widen_tile(struct SeatTile* tile, unsigned int from, unsigned int to) {
+  if (from == 1 && to == 2) {
+    uint16_t* cells = (uint16_t*)tile->cells;
+    for (size_t i = SEAT_TILE_SEATS; i-- > 0;) cells[i] = tile->cells[i];
+  } else if (from == 1) {
+    uint32_t* cells = (uint32_t*)tile->cells;
+    for (size_t i = SEAT_TILE_SEATS; i-- > 0;) cells[i] = tile->cells[i];
+  } else {
+    uint32_t* cells = (uint32_t*)tile->cells;
+    const uint16_t* old = (const uint16_t*)tile->cells;
+    for (size_t i = SEAT_TILE_SEATS; i-- > 0;) cells[i] = old[i];
+  }
+}
+
+/// Widens every cell of a grid so it can hold the given value.
+/// @return 0 if the grid was widened, 1 if a tile could not be grown. The grid keeps its width then, some tiles may
+/// just have spare room.
+static int widen_grid(struct SeatGrid* grid, unsigned int value) {
+  unsigned int width = value > UINT16_MAX ? 4 : 2;
+
+  //Grow every tile first, so a failure leaves all of them readable at the old width
+  for (size_t i = 0; i < grid->tile_count; i++) {
+    if (grid->tiles[i] == NULL) continue;
+
+    struct SeatTile* grown = realloc(grid->tiles[i], tile_size(width));
+    if (grown == NULL) return 1;
+    grid->tiles[i] = grown;
+  }
+
+  for (size_t i = 0; i < grid->tile_count; i++) {
+    if (grid->tiles[i] != NULL) widen_tile(grid->tiles[i], grid->width, width);
+  }
+  grid->width = width;
+  return 0;
+}
+
+int seat_set(struct SeatGrid* grid, size_t index, unsigned int value) {
+  struct SeatTile** slot = &grid->tiles[index / SEAT_TILE_SEATS];
+  size_t offset = index % SEAT_TILE_SEATS;
+
+  if (*slot == NULL) {
+    if (value == 0) return 0;
+
+    *slot = calloc(1, tile_size(grid->width));
+    if (*slot == NULL) return 1;
+  }
+
+  //Reservation ids only grow, so a grid widens at most twice
+  if ((grid->width == 1 && value > UINT8_MAX) || (grid->width == 2 && value > UINT16_MAX)) {
+    if (widen_grid(grid, value) != 0) return 1;
+  }
+
+  struct SeatTile* tile = *slot;
+  unsigned int old = seat_get(grid, index);
+  switch (grid->width) {
+    case 1:
+      tile->cells[offset] = (uint8_t)value;
+      break;
+    case 2:
+      ((uint16_t*)tile->cells)[offset] = (uint16_t)value;
+      break;
+    default:
+      ((uint32_t*)tile->cells)[offset] = value;
+  }
+
+  if (old == 0 && value != 0) tile->used++;
+  if (old != 0 && value == 0 && --tile->used == 0) {
+    //Last reservation of the tile gone, go back to the shared zeros
+    free(tile);
+    *slot = NULL;
+  }
+
+  return 0;
+}
+
+//Copy kernels, one per width, simple enough loops for the compiler to vectorize
+static void copy_u8(const uint8_t* cells, unsigned int* out, size_t len) {
+  for (size_t i = 0; i < len; i++) out[i] = cells[i];
+}
+
+static void copy_u16(const uint16_t* cells, unsigned int* out, size_t len) {
+  for (size_t i = 0; i < len; i++) out[i] = cells[i];
+}
+
+const unsigned int* seat_tile_copy(const struct SeatGrid* grid, size_t tile) {
+  if (grid->tiles[tile] == NULL) return seat_zero_tile();
+
+  unsigned int* out = malloc(SEAT_TILE_SEATS * sizeof(unsigned int));
+  if (out == NULL) return NULL;
+
+  const void* cells = tile_cells(grid, tile);
+  switch (grid->width) {
+    case 1:
+      copy_u8(cells, out, SEAT_TILE_SEATS);
+      break;
+    case 2:
+      copy_u16(cells, out, SEAT_TILE_SEATS);
+      break;
+    default:
+      memcpy(out, cells, SEAT_TILE_SEATS * sizeof(unsigned int));
+  }
+  return out;
+}
+
+const unsigned int* seat_zero_tile(void) { return (const unsigned int*)zero_cells; }
+
+unsigned int seat_index_width(size_t count) { return count > (size_t)UINT32_MAX + 1 ? 8 : 4; }
+
+size_t seat_index_get(const void* indices, unsigned int width, size_t i) {
+  return width == 4 ? ((const uint32_t*)indices)[i] : (size_t)((const uint64_t*)indices)[i];
+}
+
+void seat_index_set(void* indices, unsigned int width, size_t i, size_t index) {
+  if (width == 4) ((uint32_t*)indices)[i] = (uint32_t)index;
+  else ((uint64_t*)indices)[i] = index;
+}
@@ -0,0 +1,75 @@
+#ifndef SERVER_SEATS_H
+#define SERVER_SEATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SEAT_TILE_SEATS 4096  // Seats per tile, 4KB to 16KB of reservation ids depending on the cell width
+
+/// Fixed-size run of consecutive seats, allocated once one of them is reserved.
+struct SeatTile {
+  size_t used;                         /// Seats of the tile holding a reservation.
+  _Alignas(uint32_t) uint8_t cells[];  /// Reservation id of each seat, 0 if free, in cells of the grid width.
+};
+
+/// Seats of an event, stored sparsely so memory scales with the seats actually reserved.
+///
+/// Seats are numbered in row-major order and grouped into tiles of SEAT_TILE_SEATS. A tile is allocated on its
+/// first reservation and freed when its last one is cancelled. Missing tiles read as free: scans see them through a
+/// single shared tile of zeros.
+///
+/// Cells start 8 bits wide and the whole grid widens to 16 and then 32 bits the first time a reservation id does not
+/// fit, so events with few reservations move a quarter of the bytes on every scan and copy.
+struct SeatGrid {
+  size_t count;             /// Number of seats.
+  size_t tile_count;        /// Number of tiles, the last one may be partially used.
+  unsigned int width;       /// Bytes per cell: 1, 2 or 4.
+  struct SeatTile** tiles;  /// Tiles of the grid, NULL while all of their seats are free.
+};
+
+/// Sets up a grid with all seats free and 8 bit cells. Only the tile directory is allocated.
+/// @param grid Grid to set up.
+/// @param count Number of seats.
+/// @return 0 if the grid was set up, 1 otherwise.
+int seat_grid_init(struct SeatGrid* grid, size_t count);
+
+/// Frees the tiles and directory of a grid.
+void seat_grid_destroy(struct SeatGrid* grid);
+
+/// Gets the reservation id of a seat.
+/// @param index Row-major index of the seat.
+/// @return Reservation id, 0 if the seat is free.
+unsigned int seat_get(const struct SeatGrid* grid, size_t index);
+
+/// Sets the reservation id of a seat, allocating or freeing its tile and widening the grid as needed.
+/// @param index Row-major index of the seat.
+/// @param value Reservation id, 0 to free the seat.
+/// @return 0 if the seat was set, 1 if its tile could not be allocated or the grid widened. Freeing a seat never
+/// fails.
+int seat_set(struct SeatGrid* grid, size_t index, unsigned int value);
+
+/// Copies the seats of one tile of a grid, widening the cells to 32 bits.
+/// Tiles without reservations are not copied, they all read as the shared tile of zeros of seat_zero_tile.
+/// @param tile Index of the tile.
+/// @return SEAT_TILE_SEATS seats, from malloc or the shared zeros, NULL if the copy could not be allocated.
+const unsigned int* seat_tile_copy(const struct SeatGrid* grid, size_t tile);
+
+/// Gets the tile of SEAT_TILE_SEATS zeros shared by the copies of every tile without reservations, never freed.
+const unsigned int* seat_zero_tile(void);
+
+/// Gets the width of the seat indices of a grid, for arrays of indices such as the seats of a reservation.
+/// @param count Number of seats of the grid.
+/// @return Bytes per index: 4, or 8 if the grid has more seats than 32 bits can number.
+unsigned int seat_index_width(size_t count);
+
+/// Gets an entry of an array of seat indices.
+/// @param indices Array of indices of the given width.
+/// @return Row-major index of the seat.
+size_t seat_index_get(const void* indices, unsigned int width, size_t i);
+
+/// Sets an entry of an array of seat indices.
+/// @param indices Array of indices of the given width.
+/// @param index Row-major index of the seat, below the seat count the width was picked for.
+void seat_index_set(void* indices, unsigned int width, size_t i, size_t index);
+
+#endif  // SERVER_SEATS_H
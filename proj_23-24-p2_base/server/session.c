@@ -0,0 +1,402 @@
+#define _GNU_SOURCE  // vmsplice()
+
+#include "session.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+//Tags of ring operations
+#define OP_READ 1
+#define OP_WRITE 2
+
+//Indexes of the registered buffers
+#define IN_BUFFER_INDEX 0
+#define OUT_BUFFER_INDEX 1
+
+/// Writes a whole buffer with plain write calls.
+static int write_all(int fd, const char* buf, size_t len) {
+  while (len > 0) {
+    ssize_t written = write(fd, buf, len);
+    if (written == -1) return 1;
+
+    buf += written;
+    len -= (size_t)written;
+  }
+
+  return 0;
+}
+
+/// Drops the first len bytes of an iovec array, the array then starts inside the first part not fully dropped.
+static void skip_parts(struct iovec** iov, int* count, size_t len) {
+  while (*count > 0 && len >= (*iov)->iov_len) {
+    len -= (*iov)->iov_len;
+    (*iov)++;
+    (*count)--;
+  }
+  if (*count > 0) {
+    (*iov)->iov_base = (char*)(*iov)->iov_base + len;
+    (*iov)->iov_len -= len;
+  }
+}
+
+/// Writes every byte of an iovec array with writev calls, resuming after partial writes.
+/// @note The array is modified.
+static int writev_all(int fd, struct iovec* iov, int count) {
+  while (count > 0) {
+    ssize_t written = writev(fd, iov, count);
+    if (written == -1) {
+      if (errno == EINTR) continue;
+      return 1;
+    }
+
+    skip_parts(&iov, &count, (size_t)written);
+  }
+
+  return 0;
+}
+
+int session_init(struct Session* session, unsigned int id, int use_ring) {
+  memset(session, 0, sizeof(*session));
+  session->id = id;
+  session->req_fd = -1;
+  session->resp_fd = -1;
+  session->ring.fd = -1;
+
+  //Requests are read ahead whatever the I/O path
+  session->in = malloc(SESSION_IN_BUFFER_SIZE);
+  if (session->in == NULL) return 1;
+
+  if (!use_ring) return 0;
+
+  //Fall back to plain I/O whenever any step of the io_uring setup fails
+  session->out = malloc(SESSION_OUT_BUFFER_SIZE);
+  if (session->out == NULL || ring_init(&session->ring, SESSION_RING_ENTRIES) != 0) {
+    free(session->out);
+    session->out = NULL;
+    return 0;
+  }
+
+  struct iovec buffers[2] = {{session->in, SESSION_IN_BUFFER_SIZE}, {session->out, SESSION_OUT_BUFFER_SIZE}};
+  if (ring_register_buffers(&session->ring, buffers, 2) != 0) {
+    ring_destroy(&session->ring);
+    free(session->out);
+    session->out = NULL;
+    return 0;
+  }
+
+  session->use_ring = 1;
+  return 0;
+}
+
+void session_destroy(struct Session* session) {
+  free(session->in);
+  session->in = NULL;
+  if (!session->use_ring) return;
+
+  ring_destroy(&session->ring);
+  free(session->out);
+  session->use_ring = 0;
+}
+
+void session_attach(struct Session* session, int req_fd, int resp_fd) {
+  session->req_fd = req_fd;
+  session->resp_fd = resp_fd;
+  session->request_id = 0;
+  session->payload_left = 0;
+  session->in_pos = session->in_len = 0;
+  session->out_len = 0;
+}
+
+void session_carry(struct Session* session, char* carried, size_t len) {
+  session->carried = carried;
+  session->carried_pos = 0;
+  session->carried_len = len;
+}
+
+char* session_unread(struct Session* session, size_t* len) {
+  size_t carried_left = session->carried_len - session->carried_pos;
+  size_t in_left = session->in_len - session->in_pos;
+  *len = carried_left + in_left;
+  if (*len == 0) return NULL;
+
+  char* bytes = malloc(*len);
+  if (bytes == NULL) return NULL;
+
+  if (carried_left > 0) memcpy(bytes, session->carried + session->carried_pos, carried_left);
+  if (in_left > 0) memcpy(bytes + carried_left, session->in + session->in_pos, in_left);
+  return bytes;
+}
+
+int session_detach(struct Session* session) {
+  int ret = session_flush(session);
+
+  free(session->carried);
+  session->carried = NULL;
+  session->carried_pos = session->carried_len = 0;
+
+  if (close(session->req_fd) == -1) ret = 1;
+  if (close(session->resp_fd) == -1) ret = 1;
+  session->req_fd = session->resp_fd = -1;
+  return ret;
+}
+
+/// Handles the completion of a batched response write.
+/// @return 0 if the whole batch was written, 1 otherwise.
+static int complete_write(struct Session* session, int32_t res) {
+  if (res < 0) return 1;
+
+  //Pipes may take a batch partially, write the rest directly
+  size_t written = (size_t)res;
+  int ret = written < session->out_len ? write_all(session->resp_fd, session->out + written, session->out_len - written)
+                                       : 0;
+  session->out_len = 0;
+  return ret;
+}
+
+int session_flush(struct Session* session) {
+  if (!session->use_ring || session->out_len == 0) return 0;
+
+  if (ring_queue_write_fixed(&session->ring, session->resp_fd, session->out, session->out_len, OUT_BUFFER_INDEX,
+                             OP_WRITE) != 0 ||
+      ring_submit_and_wait(&session->ring, 1) != 0) {
+    return 1;
+  }
+
+  struct RingCompletion completion;
+  while (!ring_next_completion(&session->ring, &completion)) {
+    if (ring_submit_and_wait(&session->ring, 1) != 0) return 1;
+  }
+
+  return complete_write(session, completion.res);
+}
+
+/// Refills the read-ahead buffer, submitting held back responses in the same system call with io_uring.
+/// @return 0 if some bytes were read, 1 on error or end of file.
+static int fill(struct Session* session) {
+  //Keep unread bytes at the start of the buffer
+  size_t left = session->in_len - session->in_pos;
+  memmove(session->in, session->in + session->in_pos, left);
+  session->in_pos = 0;
+  session->in_len = left;
+
+  //As much as the client has written, usually the rest of the frame and any frame pipelined after it
+  if (!session->use_ring) {
+    ssize_t ret;
+    do {
+      ret = read(session->req_fd, session->in + left, SESSION_IN_BUFFER_SIZE - left);
+    } while (ret == -1 && errno == EINTR);
+    if (ret <= 0) return 1;
+
+    session->in_len += (size_t)ret;
+    return 0;
+  }
+
+  unsigned expected = 1;
+  if (session->out_len > 0) {
+    if (ring_queue_write_fixed(&session->ring, session->resp_fd, session->out, session->out_len, OUT_BUFFER_INDEX,
+                               OP_WRITE) != 0) {
+      return 1;
+    }
+    expected++;
+  }
+
+  if (ring_queue_read_fixed(&session->ring, session->req_fd, session->in + left, SESSION_IN_BUFFER_SIZE - left,
+                            IN_BUFFER_INDEX, OP_READ) != 0) {
+    return 1;
+  }
+
+  //One system call: responses go out, the next request comes in
+  int ret = 0, read_done = 0;
+  while (expected > 0) {
+    if (ring_submit_and_wait(&session->ring, 1) != 0) return 1;
+
+    struct RingCompletion completion;
+    while (ring_next_completion(&session->ring, &completion)) {
+      expected--;
+      if (completion.user_data == OP_WRITE) {
+        ret |= complete_write(session, completion.res);
+      } else {
+        read_done = 1;
+        if (completion.res <= 0) ret = 1;
+        else session->in_len += (size_t)completion.res;
+      }
+    }
+  }
+
+  return ret || !read_done;
+}
+
+/// Consumes len request bytes, from the bytes carried over from the previous server first, then the read-ahead buffer.
+/// @param buf Buffer the bytes are copied to, NULL to discard them.
+/// @return 0 if the bytes were consumed, 1 on error or end of file.
+static int take(struct Session* session, void* buf, size_t len) {
+  char* dst = buf;
+
+  if (session->carried != NULL) {
+    size_t chunk = session->carried_len - session->carried_pos;
+    if (chunk > len) chunk = len;
+    if (dst != NULL) memcpy(dst, session->carried + session->carried_pos, chunk);
+    session->carried_pos += chunk;
+    if (dst != NULL) dst += chunk;
+    len -= chunk;
+
+    if (session->carried_pos == session->carried_len) {
+      free(session->carried);
+      session->carried = NULL;
+      session->carried_pos = session->carried_len = 0;
+    }
+  }
+
+  while (len > 0) {
+    if (session->in_pos == session->in_len && fill(session) != 0) return 1;
+
+    size_t chunk = session->in_len - session->in_pos;
+    if (chunk > len) chunk = len;
+    if (dst != NULL) memcpy(dst, session->in + session->in_pos, chunk);
+    session->in_pos += chunk;
+    if (dst != NULL) dst += chunk;
+    len -= chunk;
+  }
+
+  return 0;
+}
+
+int session_next_request(struct Session* session, core_request* core) {
+  //Payload a handler did not understand is dropped, the next frame starts right after it
+  if (take(session, NULL, session->payload_left) != 0 || take(session, core, sizeof(core_request)) != 0) return 1;
+
+  session->request_id = core->request_id;
+  session->payload_left = core->payload_len;
+  return 0;
+}
+
+int session_read(struct Session* session, void* buf, size_t len) {
+  //Reading past the payload would eat into the next frame
+  if (len > session->payload_left) return 1;
+
+  session->payload_left -= len;
+  return take(session, buf, len);
+}
+
+int session_write(struct Session* session, const void* buf, size_t len) {
+  if (!session->use_ring) return write_all(session->resp_fd, buf, len);
+
+  //Small responses are batched until the next read
+  if (session->out_len + len <= SESSION_OUT_BUFFER_SIZE) {
+    memcpy(session->out + session->out_len, buf, len);
+    session->out_len += len;
+    return 0;
+  }
+
+  //Large ones go out right away, after what was batched before them
+  if (session_flush(session) != 0) return 1;
+  if (len <= SESSION_OUT_BUFFER_SIZE) {
+    memcpy(session->out, buf, len);
+    session->out_len = len;
+    return 0;
+  }
+
+  if (ring_queue_write(&session->ring, session->resp_fd, buf, len, OP_WRITE) != 0 ||
+      ring_submit_and_wait(&session->ring, 1) != 0) {
+    return 1;
+  }
+
+  struct RingCompletion completion;
+  while (!ring_next_completion(&session->ring, &completion)) {
+    if (ring_submit_and_wait(&session->ring, 1) != 0) return 1;
+  }
+  if (completion.res < 0) return 1;
+
+  size_t written = (size_t)completion.res;
+  return written < len ? write_all(session->resp_fd, (const char*)buf + written, len - written) : 0;
+}
+
+/// Writes a response header announcing payload_len bytes, followed by the given parts.
+/// @return 0 if the bytes were written or queued, 1 otherwise.
+static int respond(struct Session* session, size_t payload_len, const struct iovec* parts, int count) {
+  if (count > SESSION_RESPONSE_MAX_PARTS) return 1;
+
+  response_header header = {.request_id = session->request_id, .payload_len = (unsigned int)payload_len};
+  struct iovec iov[SESSION_RESPONSE_MAX_PARTS + 1];
+  iov[0].iov_base = &header;
+  iov[0].iov_len = sizeof(response_header);
+  memcpy(iov + 1, parts, (size_t)count * sizeof(struct iovec));
+
+  //With io_uring the parts are batched, the whole batch is still a single write
+  if (session->use_ring) {
+    for (int i = 0; i <= count; i++) {
+      if (session_write(session, iov[i].iov_base, iov[i].iov_len) != 0) return 1;
+    }
+    return 0;
+  }
+
+  return writev_all(session->resp_fd, iov, count + 1);
+}
+
+int session_respond(struct Session* session, const struct iovec* parts, int count) {
+  size_t payload_len = 0;
+  for (int i = 0; i < count; i++) {
+    payload_len += parts[i].iov_len;
+  }
+
+  return respond(session, payload_len, parts, count);
+}
+
+int session_respond_pages(struct Session* session, const void* head, size_t head_len, const struct iovec* pages,
+                          size_t count, int map) {
+  size_t pages_len = 0;
+  for (size_t i = 0; i < count; i++) {
+    pages_len += pages[i].iov_len;
+  }
+  if (pages_len < SESSION_SPLICE_MIN_SIZE) map = 0;
+
+  //Payloads of a few pieces are copied as a single frame
+  struct iovec parts[SESSION_RESPONSE_MAX_PARTS] = {{(void*)head, head_len}};
+  if (!map && count < SESSION_RESPONSE_MAX_PARTS) {
+    memcpy(parts + 1, pages, count * sizeof(struct iovec));
+    return respond(session, head_len + pages_len, parts, (int)count + 1);
+  }
+
+  //Header and head are copied, responses held back go out with them to keep the order
+  if (respond(session, head_len + pages_len, parts, 1) != 0) return 1;
+  if (!map && session->use_ring) {
+    for (size_t i = 0; i < count; i++) {
+      if (session_write(session, pages[i].iov_base, pages[i].iov_len) != 0) return 1;
+    }
+    return 0;
+  }
+  if (session_flush(session) != 0) return 1;
+
+  //Batches of pieces per call, the array is modified when resuming after partial writes
+  struct iovec batch[SESSION_PAGES_BATCH];
+  while (count > 0) {
+    int batch_count = count < SESSION_PAGES_BATCH ? (int)count : SESSION_PAGES_BATCH;
+    memcpy(batch, pages, (size_t)batch_count * sizeof(struct iovec));
+    pages += batch_count;
+    count -= (size_t)batch_count;
+
+    struct iovec* iov = batch;
+    while (map && batch_count > 0) {
+      ssize_t spliced = vmsplice(session->resp_fd, iov, (unsigned long)batch_count, 0);
+      if (spliced == -1) {
+        if (errno == EINTR) continue;
+
+        //Not a pipe or no vmsplice support, copy what is left
+        map = 0;
+        break;
+      }
+
+      skip_parts(&iov, &batch_count, (size_t)spliced);
+    }
+
+    if (writev_all(session->resp_fd, iov, batch_count) != 0) return 1;
+  }
+
+  return 0;
+}
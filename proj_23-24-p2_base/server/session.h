@@ -0,0 +1,105 @@
+#ifndef SERVER_SESSION_H
+#define SERVER_SESSION_H
+
+#include <stddef.h>
+#include <sys/uio.h>
+
+#include "common/messages.h"
+#include "uring.h"
+
+#define SESSION_IN_BUFFER_SIZE 65536   // Bytes of requests read ahead, whole frames whenever they fit
+#define SESSION_OUT_BUFFER_SIZE 65536  // Bytes of responses batched with io_uring
+#define SESSION_RING_ENTRIES 8         // Submission entries of each worker ring
+#define SESSION_SPLICE_MIN_SIZE 4096   // Smallest payload mapped into the pipe instead of copied
+#define SESSION_RESPONSE_MAX_PARTS 4   // Parts a response frame may be gathered from
+#define SESSION_PAGES_BATCH 64         // Pages handed to a single writev or vmsplice call
+
+/// I/O state of the session served by a worker.
+/// Requests are read ahead into a buffer, so a read brings in whole frames, often several of them.
+/// With io_uring, responses are batched in a registered buffer and submitted together with the read of
+/// the next request, in one system call. Without it, each response frame goes out with a single writev.
+struct Session {
+  unsigned int id;  /// Session id, equal to the worker index.
+  int req_fd;       /// Request pipe of the client being served.
+  int resp_fd;      /// Response pipe of the client being served.
+
+  unsigned int request_id;  /// Request id of the frame being handled, echoed by its response.
+  size_t payload_left;      /// Payload bytes of the frame being handled not consumed yet.
+
+  int use_ring;      /// 1 if the io_uring path is in use.
+  struct Ring ring;  /// Ring of the worker, when use_ring.
+  char* in;          /// Read-ahead buffer, registered with the ring when use_ring.
+  size_t in_pos;     /// Bytes of in already consumed.
+  size_t in_len;     /// Bytes of in filled.
+  char* out;         /// Registered buffer of responses not yet written.
+  size_t out_len;    /// Bytes of out filled.
+
+  char* carried;       /// Request bytes read by a previous server, handed out before the pipe, NULL if none.
+  size_t carried_pos;  /// Bytes of carried already consumed.
+  size_t carried_len;  /// Size of carried.
+};
+
+/// Sets up the I/O state of a worker.
+/// @param session Session to set up.
+/// @param id Session id.
+/// @param use_ring 1 to use io_uring if the system supports it.
+/// @return 0 if the session was set up, 1 otherwise.
+int session_init(struct Session* session, unsigned int id, int use_ring);
+
+/// Releases the I/O state of a worker.
+void session_destroy(struct Session* session);
+
+/// Starts serving a client on the given pipes.
+void session_attach(struct Session* session, int req_fd, int resp_fd);
+
+/// Resumes a session started by a previous server, with the request bytes it had already read.
+/// @param carried malloc'd bytes to hand out before reading the pipe, owned by the session from now on.
+/// @param len Size of carried.
+void session_carry(struct Session* session, char* carried, size_t len);
+
+/// Copies every request byte received but not consumed yet, so the session can be resumed by another server.
+/// @param len Set to the number of bytes.
+/// @return malloc'd copy of the bytes, NULL if there are none or on failure.
+char* session_unread(struct Session* session, size_t* len);
+
+/// Writes pending responses and closes the client pipes.
+/// @return 0 if the session ended cleanly, 1 otherwise.
+int session_detach(struct Session* session);
+
+/// Reads the header of the next request frame, skipping whatever the previous request left of its payload.
+/// @param core Set to the header.
+/// @return 0 if a header was read, 1 on error or end of file.
+int session_next_request(struct Session* session, core_request* core);
+
+/// Reads exactly len bytes of the payload of the request being handled.
+/// @return 0 if the bytes were read, 1 on error, end of file or if the payload is shorter.
+int session_read(struct Session* session, void* buf, size_t len);
+
+/// Writes len bytes outside of any frame, only used for the setup response.
+/// They may be held back until the next read or flush.
+/// @return 0 if the bytes were written or queued, 1 otherwise.
+int session_write(struct Session* session, const void* buf, size_t len);
+
+/// Writes a response frame to the request being handled: a response_header and the given parts, gathered in a
+/// single writev. They may be held back until the next read or flush.
+/// @param count Number of parts, at most SESSION_RESPONSE_MAX_PARTS.
+/// @return 0 if the frame was written or queued, 1 otherwise.
+int session_respond(struct Session* session, const struct iovec* parts, int count);
+
+/// Writes a response frame made of a small head followed by a large payload gathered from pages, which are handed to
+/// the response pipe with vmsplice, without copying them. Small payloads, and pipes that refuse vmsplice, are
+/// written normally.
+/// @note The pipe keeps referencing mapped pages: they must stay allocated and unchanged until the client has read
+/// them.
+/// @param pages Pieces of the payload, in order.
+/// @param count Number of pieces.
+/// @param map 0 to copy the pages even if they are large.
+/// @return 0 if the frame was written, 1 otherwise.
+int session_respond_pages(struct Session* session, const void* head, size_t head_len, const struct iovec* pages,
+                          size_t count, int map);
+
+/// Writes every response held back.
+/// @return 0 if the responses were written, 1 otherwise.
+int session_flush(struct Session* session);
+
+#endif  // SERVER_SESSION_H
@@ -0,0 +1,300 @@
+#include "trace.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/// Per-worker trace buffer. Only its worker appends to it, the flusher swaps it out.
+struct TraceBuffer {
+  char* data;              /// Buffer being appended to.
+  size_t len;              /// Bytes used in data.
+  char* spare;             /// Empty buffer swapped in when data is flushed.
+  int flushing;            /// 1 while the previous data is written, spare is only given back afterwards.
+  pthread_mutex_t mutex;   /// Protects data, len, spare and flushing against the flusher.
+  pthread_cond_t flushed;  /// Signalled when a flush ends.
+};
+
+static int trace_fd = -1;
+static struct TraceBuffer* buffers = NULL;
+static unsigned int buffer_count = 0;
+static pthread_mutex_t file_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t flusher;
+static volatile int flusher_running = 0;
+static struct timespec trace_epoch;
+
+/// Request started on this worker by trace_begin.
+static _Thread_local struct {
+  unsigned int session_id;
+  char opcode;
+  uint64_t timestamp_ns;
+} pending;
+
+/// Writes a whole chunk to the trace file.
+/// @note file_mutex must be held.
+static void write_locked(const char* data, size_t len) {
+  while (len > 0) {
+    ssize_t written = write(trace_fd, data, len);
+    if (written == -1) {
+      fprintf(stderr, "Error writing to trace file\n");
+      return;
+    }
+
+    data += written;
+    len -= (size_t)written;
+  }
+}
+
+/// Writes a whole chunk to the trace file.
+static void write_chunk(const char* data, size_t len) {
+  pthread_mutex_lock(&file_mutex);
+  write_locked(data, len);
+  pthread_mutex_unlock(&file_mutex);
+}
+
+/// Swaps out the contents of a buffer and writes them to the file.
+/// Flushes of a buffer run one at a time, so the buffer being written is never swapped back in meanwhile.
+static void flush_buffer(struct TraceBuffer* buffer) {
+  pthread_mutex_lock(&buffer->mutex);
+  while (buffer->flushing) pthread_cond_wait(&buffer->flushed, &buffer->mutex);
+  buffer->flushing = 1;
+  char* data = buffer->data;
+  size_t len = buffer->len;
+  buffer->data = buffer->spare;
+  buffer->len = 0;
+  pthread_mutex_unlock(&buffer->mutex);
+
+  //Workers keep appending to the swapped in buffer while this one is written
+  if (len > 0) write_chunk(data, len);
+
+  pthread_mutex_lock(&buffer->mutex);
+  buffer->spare = data;
+  buffer->flushing = 0;
+  pthread_cond_broadcast(&buffer->flushed);
+  pthread_mutex_unlock(&buffer->mutex);
+}
+
+/// Frees the first count worker buffers and the array holding them, and closes the trace file.
+static void release_buffers(unsigned int count) {
+  for (unsigned int i = 0; i < count; i++) {
+    free(buffers[i].data);
+    free(buffers[i].spare);
+    pthread_mutex_destroy(&buffers[i].mutex);
+    pthread_cond_destroy(&buffers[i].flushed);
+  }
+  free(buffers);
+  buffers = NULL;
+  buffer_count = 0;
+
+  close(trace_fd);
+  trace_fd = -1;
+}
+
+/// Background thread writing out the worker buffers periodically.
+static void* flusher_main(void* arg) {
+  (void)arg;
+
+  struct timespec delay = {0, TRACE_FLUSH_INTERVAL_MS * 1000000L};
+  while (flusher_running) {
+    nanosleep(&delay, NULL);
+    for (unsigned int i = 0; i < buffer_count; i++) flush_buffer(&buffers[i]);
+  }
+
+  return NULL;
+}
+
+int trace_start(const char* path, unsigned int worker_count) {
+  trace_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (trace_fd == -1) {
+    fprintf(stderr, "Error opening trace file\n");
+    return 1;
+  }
+
+  struct TraceHeader header;
+  memcpy(header.magic, TRACE_MAGIC, 4);
+  header.version = TRACE_VERSION;
+  write_chunk((const char*)&header, sizeof(header));
+
+  buffers = calloc(worker_count, sizeof(struct TraceBuffer));
+  if (buffers == NULL) {
+    close(trace_fd);
+    trace_fd = -1;
+    return 1;
+  }
+
+  for (unsigned int i = 0; i < worker_count; i++) {
+    pthread_mutex_init(&buffers[i].mutex, NULL);
+    pthread_cond_init(&buffers[i].flushed, NULL);
+    buffers[i].data = malloc(TRACE_BUFFER_SIZE);
+    buffers[i].spare = malloc(TRACE_BUFFER_SIZE);
+    if (buffers[i].data == NULL || buffers[i].spare == NULL) {
+      fprintf(stderr, "Error allocating trace buffers\n");
+      release_buffers(i + 1);
+      return 1;
+    }
+  }
+  buffer_count = worker_count;
+
+  clock_gettime(CLOCK_MONOTONIC, &trace_epoch);
+  flusher_running = 1;
+  if (pthread_create(&flusher, NULL, flusher_main, NULL) != 0) {
+    flusher_running = 0;
+    release_buffers(worker_count);
+    return 1;
+  }
+
+  return 0;
+}
+
+void trace_stop(void) {
+  if (trace_fd == -1) return;
+
+  flusher_running = 0;
+  pthread_join(flusher, NULL);
+
+  for (unsigned int i = 0; i < buffer_count; i++) flush_buffer(&buffers[i]);
+  release_buffers(buffer_count);
+}
+
+void trace_begin(unsigned int session_id, char opcode) {
+  if (trace_fd == -1) return;
+
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  pending.session_id = session_id;
+  pending.opcode = opcode;
+  pending.timestamp_ns = (uint64_t)(now.tv_sec - trace_epoch.tv_sec) * 1000000000ULL +
+                         (uint64_t)(now.tv_nsec - trace_epoch.tv_nsec);
+}
+
+void trace_commit(const struct iovec* parts, int count) {
+  if (trace_fd == -1 || pending.session_id >= buffer_count) return;
+
+  size_t payload_len = 0;
+  for (int i = 0; i < count; i++) payload_len += parts[i].iov_len;
+
+  struct TraceRecord record = {.timestamp_ns = pending.timestamp_ns,
+                               .session_id = pending.session_id,
+                               .payload_len = (uint32_t)payload_len,
+                               .opcode = pending.opcode};
+  size_t total = sizeof(record) + payload_len;
+
+  struct TraceBuffer* buffer = &buffers[pending.session_id];
+
+  //Workers are cancelled on shutdown, never while holding the trace locks
+  int cancel_state;
+  pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cancel_state);
+
+  //Records too big for a buffer go straight to the file, after what was buffered before them
+  if (total > TRACE_BUFFER_SIZE) {
+    flush_buffer(buffer);
+    pthread_mutex_lock(&file_mutex);
+    write_locked((const char*)&record, sizeof(record));
+    for (int i = 0; i < count; i++) write_locked(parts[i].iov_base, parts[i].iov_len);
+    pthread_mutex_unlock(&file_mutex);
+    pthread_setcancelstate(cancel_state, NULL);
+    return;
+  }
+
+  //Make room by flushing on this worker, only when the flusher fell behind
+  pthread_mutex_lock(&buffer->mutex);
+  if (buffer->len + total > TRACE_BUFFER_SIZE) {
+    pthread_mutex_unlock(&buffer->mutex);
+    flush_buffer(buffer);
+    pthread_mutex_lock(&buffer->mutex);
+  }
+
+  char* out = buffer->data + buffer->len;
+  memcpy(out, &record, sizeof(record));
+  out += sizeof(record);
+  for (int i = 0; i < count; i++) {
+    memcpy(out, parts[i].iov_base, parts[i].iov_len);
+    out += parts[i].iov_len;
+  }
+  buffer->len += total;
+  pthread_mutex_unlock(&buffer->mutex);
+  pthread_setcancelstate(cancel_state, NULL);
+}
+
+/// Orders entries by arrival time, then by session.
+static int compare_entries(const void* a, const void* b) {
+  const struct TraceRecord* ra = &((const struct TraceEntry*)a)->record;
+  const struct TraceRecord* rb = &((const struct TraceEntry*)b)->record;
+  if (ra->timestamp_ns != rb->timestamp_ns) return ra->timestamp_ns < rb->timestamp_ns ? -1 : 1;
+  if (ra->session_id != rb->session_id) return ra->session_id < rb->session_id ? -1 : 1;
+  return 0;
+}
+
+int trace_load(const char* path, struct TraceEntry** entries, size_t* count, char** data) {
+  int fd = open(path, O_RDONLY);
+  if (fd == -1) {
+    fprintf(stderr, "Error opening trace file\n");
+    return 1;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    close(fd);
+    return 1;
+  }
+
+  //Read the whole file
+  size_t size = (size_t)st.st_size;
+  char* contents = malloc(size ? size : 1);
+  size_t done = 0;
+  while (contents != NULL && done < size) {
+    ssize_t ret = read(fd, contents + done, size - done);
+    if (ret <= 0) break;
+    done += (size_t)ret;
+  }
+  close(fd);
+
+  if (contents == NULL || done < size || size < sizeof(struct TraceHeader) ||
+      memcmp(contents, TRACE_MAGIC, 4) != 0 || ((struct TraceHeader*)contents)->version != TRACE_VERSION) {
+    fprintf(stderr, "Invalid trace file\n");
+    free(contents);
+    return 1;
+  }
+
+  //Index records
+  size_t capacity = 1024, n = 0;
+  struct TraceEntry* list = malloc(capacity * sizeof(struct TraceEntry));
+  size_t offset = sizeof(struct TraceHeader);
+  while (list != NULL && offset + sizeof(struct TraceRecord) <= size) {
+    struct TraceRecord record;
+    memcpy(&record, contents + offset, sizeof(record));
+    offset += sizeof(record);
+    if (offset + record.payload_len > size) break;
+
+    if (n == capacity) {
+      capacity *= 2;
+      struct TraceEntry* grown = realloc(list, capacity * sizeof(struct TraceEntry));
+      if (grown == NULL) {
+        free(list);
+        list = NULL;
+        break;
+      }
+      list = grown;
+    }
+
+    list[n].record = record;
+    list[n].payload = contents + offset;
+    n++;
+    offset += record.payload_len;
+  }
+
+  if (list == NULL) {
+    free(contents);
+    return 1;
+  }
+
+  qsort(list, n, sizeof(struct TraceEntry), compare_entries);
+  *entries = list;
+  *count = n;
+  *data = contents;
+  return 0;
+}
@@ -0,0 +1,68 @@
+#ifndef SERVER_TRACE_H
+#define SERVER_TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+/// Trace files hold every decoded request received by the server.
+///
+/// Layout: a TraceHeader followed by records, each a TraceRecord followed by payload_len bytes of
+/// request body (the request struct and any arrays after it, as read from the request pipe).
+/// Records of different workers are interleaved in chunks, sort them by timestamp before use.
+
+#define TRACE_MAGIC "EMST"
+#define TRACE_VERSION 1
+#define TRACE_BUFFER_SIZE (1 << 20)  // Bytes buffered per worker before a flush is forced
+#define TRACE_FLUSH_INTERVAL_MS 100  // Period of the background flush
+
+/// Header of a trace file.
+struct TraceHeader {
+  char magic[4];     /// TRACE_MAGIC.
+  uint32_t version;  /// TRACE_VERSION.
+} __attribute__((packed));
+
+/// Header of a trace record.
+struct TraceRecord {
+  uint64_t timestamp_ns;  /// Arrival time, relative to the start of the trace.
+  uint32_t session_id;    /// Session the request arrived on.
+  uint32_t payload_len;   /// Size of the request body following the record.
+  char opcode;            /// Opcode of the request.
+} __attribute__((packed));
+
+/// A trace record loaded in memory.
+struct TraceEntry {
+  struct TraceRecord record;  /// Record header.
+  const char* payload;        /// Request body, record.payload_len bytes.
+};
+
+/// Starts recording requests to the given file, flushed by a background thread.
+/// @param path Path of the trace file, truncated if it exists.
+/// @param worker_count Number of workers that will record requests.
+/// @return 0 if recording started, 1 otherwise.
+int trace_start(const char* path, unsigned int worker_count);
+
+/// Flushes everything recorded so far and stops recording.
+void trace_stop(void);
+
+/// Marks the arrival of a request on the calling worker.
+/// @note Does nothing if recording is off.
+/// @param session_id Session (and worker) the request arrived on.
+/// @param opcode Opcode of the request.
+void trace_begin(unsigned int session_id, char opcode);
+
+/// Records the request started by trace_begin, once its body has been decoded.
+/// @note Does nothing if recording is off.
+/// @param parts Pieces of the request body, in wire order.
+/// @param count Number of pieces.
+void trace_commit(const struct iovec* parts, int count);
+
+/// Loads a whole trace file, sorted by arrival time.
+/// @param path Path of the trace file.
+/// @param entries Set to a malloc'd array of entries, pointing into *data.
+/// @param count Set to the number of entries.
+/// @param data Set to the malloc'd file contents, to be freed along with entries.
+/// @return 0 if the trace was loaded, 1 otherwise.
+int trace_load(const char* path, struct TraceEntry** entries, size_t* count, char** data);
+
+#endif  // SERVER_TRACE_H
@@ -0,0 +1,192 @@
+#define _GNU_SOURCE  // syscall()
+
+#include "uring.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define HAVE_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#else
+#define HAVE_IO_URING 0
+#endif
+
+#if HAVE_IO_URING
+
+int ring_init(struct Ring* ring, unsigned entries) {
+  memset(ring, 0, sizeof(*ring));
+  ring->fd = -1;
+
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  int fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+  if (fd < 0) return 1;
+
+  //Older kernels map the submission and completion rings separately
+  ring->sq_map_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  ring->cq_map_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    if (ring->cq_map_size > ring->sq_map_size) ring->sq_map_size = ring->cq_map_size;
+    ring->cq_map_size = ring->sq_map_size;
+  }
+
+  ring->sq_map = mmap(NULL, ring->sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                      IORING_OFF_SQ_RING);
+  if (ring->sq_map == MAP_FAILED) {
+    close(fd);
+    return 1;
+  }
+
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    ring->cq_map = ring->sq_map;
+  } else {
+    ring->cq_map = mmap(NULL, ring->cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                        IORING_OFF_CQ_RING);
+    if (ring->cq_map == MAP_FAILED) {
+      munmap(ring->sq_map, ring->sq_map_size);
+      close(fd);
+      return 1;
+    }
+  }
+
+  ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+  ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+  if (ring->sqes == MAP_FAILED) {
+    if (ring->cq_map != ring->sq_map) munmap(ring->cq_map, ring->cq_map_size);
+    munmap(ring->sq_map, ring->sq_map_size);
+    close(fd);
+    return 1;
+  }
+
+  char* sq = ring->sq_map;
+  char* cq = ring->cq_map;
+  ring->sq_head = (unsigned*)(sq + params.sq_off.head);
+  ring->sq_tail = (unsigned*)(sq + params.sq_off.tail);
+  ring->sq_mask = (unsigned*)(sq + params.sq_off.ring_mask);
+  ring->sq_array = (unsigned*)(sq + params.sq_off.array);
+  ring->cq_head = (unsigned*)(cq + params.cq_off.head);
+  ring->cq_tail = (unsigned*)(cq + params.cq_off.tail);
+  ring->cq_mask = (unsigned*)(cq + params.cq_off.ring_mask);
+  ring->cqes = cq + params.cq_off.cqes;
+  ring->fd = fd;
+  return 0;
+}
+
+void ring_destroy(struct Ring* ring) {
+  if (ring->fd == -1) return;
+
+  munmap(ring->sqes, ring->sqes_size);
+  if (ring->cq_map != ring->sq_map) munmap(ring->cq_map, ring->cq_map_size);
+  munmap(ring->sq_map, ring->sq_map_size);
+  close(ring->fd);
+  ring->fd = -1;
+}
+
+int ring_register_buffers(struct Ring* ring, const struct iovec* buffers, unsigned count) {
+  return syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_BUFFERS, buffers, count) < 0;
+}
+
+/// Fills the next free submission entry.
+/// @return 0 if queued, 1 if the submission queue is full.
+static int queue(struct Ring* ring, uint8_t opcode, int fd, const void* buf, size_t len, int buf_index,
+                 uint64_t user_data) {
+  unsigned tail = *ring->sq_tail;
+  unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+  if (tail - head > *ring->sq_mask) return 1;
+
+  unsigned index = tail & *ring->sq_mask;
+  struct io_uring_sqe* sqe = &((struct io_uring_sqe*)ring->sqes)[index];
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = opcode;
+  sqe->fd = fd;
+  sqe->addr = (uint64_t)(uintptr_t)buf;
+  sqe->len = (uint32_t)len;
+  sqe->off = (uint64_t)-1;  // Pipes have no offset, use the current position
+  sqe->buf_index = (uint16_t)(buf_index < 0 ? 0 : buf_index);
+  sqe->user_data = user_data;
+
+  ring->sq_array[index] = index;
+  __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+  ring->queued++;
+  return 0;
+}
+
+int ring_queue_read_fixed(struct Ring* ring, int fd, void* buf, size_t len, int buf_index, uint64_t user_data) {
+  return queue(ring, IORING_OP_READ_FIXED, fd, buf, len, buf_index, user_data);
+}
+
+int ring_queue_write_fixed(struct Ring* ring, int fd, const void* buf, size_t len, int buf_index, uint64_t user_data) {
+  return queue(ring, IORING_OP_WRITE_FIXED, fd, buf, len, buf_index, user_data);
+}
+
+int ring_queue_write(struct Ring* ring, int fd, const void* buf, size_t len, uint64_t user_data) {
+  return queue(ring, IORING_OP_WRITE, fd, buf, len, -1, user_data);
+}
+
+int ring_submit_and_wait(struct Ring* ring, unsigned wait_nr) {
+  while (1) {
+    long ret = syscall(__NR_io_uring_enter, ring->fd, ring->queued, wait_nr, IORING_ENTER_GETEVENTS, NULL, 0);
+    if (ret >= 0) {
+      ring->queued -= (unsigned)ret;
+      return 0;
+    }
+    if (errno != EINTR) return 1;
+  }
+}
+
+int ring_next_completion(struct Ring* ring, struct RingCompletion* completion) {
+  unsigned head = *ring->cq_head;
+  if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) return 0;
+
+  struct io_uring_cqe* cqe = &((struct io_uring_cqe*)ring->cqes)[head & *ring->cq_mask];
+  completion->user_data = cqe->user_data;
+  completion->res = cqe->res;
+  __atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+  return 1;
+}
+
+#else  // !HAVE_IO_URING
+
+int ring_init(struct Ring* ring, unsigned entries) {
+  (void)entries;
+  ring->fd = -1;
+  return 1;
+}
+
+void ring_destroy(struct Ring* ring) { (void)ring; }
+
+int ring_register_buffers(struct Ring* ring, const struct iovec* buffers, unsigned count) {
+  (void)ring, (void)buffers, (void)count;
+  return 1;
+}
+
+int ring_queue_read_fixed(struct Ring* ring, int fd, void* buf, size_t len, int buf_index, uint64_t user_data) {
+  (void)ring, (void)fd, (void)buf, (void)len, (void)buf_index, (void)user_data;
+  return 1;
+}
+
+int ring_queue_write_fixed(struct Ring* ring, int fd, const void* buf, size_t len, int buf_index, uint64_t user_data) {
+  (void)ring, (void)fd, (void)buf, (void)len, (void)buf_index, (void)user_data;
+  return 1;
+}
+
+int ring_queue_write(struct Ring* ring, int fd, const void* buf, size_t len, uint64_t user_data) {
+  (void)ring, (void)fd, (void)buf, (void)len, (void)user_data;
+  return 1;
+}
+
+int ring_submit_and_wait(struct Ring* ring, unsigned wait_nr) {
+  (void)ring, (void)wait_nr;
+  return 1;
+}
+
+int ring_next_completion(struct Ring* ring, struct RingCompletion* completion) {
+  (void)ring, (void)completion;
+  return 0;
+}
+
+#endif  // HAVE_IO_URING
@@ -0,0 +1,69 @@
+#ifndef SERVER_URING_H
+#define SERVER_URING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+/// Minimal io_uring wrapper over the raw system calls, so no liburing is needed.
+/// Every function fails cleanly when io_uring is not available (kernel, headers or seccomp),
+/// letting callers fall back to plain read/write.
+
+/// Completion of a submitted operation.
+struct RingCompletion {
+  uint64_t user_data;  /// Tag given when the operation was queued.
+  int32_t res;         /// Result, as read/write would return, or -errno.
+};
+
+/// A submission/completion ring pair. Not thread safe, each worker owns one.
+struct Ring {
+  int fd;  /// Ring file descriptor, -1 if not set up.
+
+  unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+  unsigned *cq_head, *cq_tail, *cq_mask;
+  void* sqes;  /// Submission queue entries.
+  void* cqes;  /// Completion queue entries.
+
+  void* sq_map;
+  size_t sq_map_size;
+  void* cq_map;
+  size_t cq_map_size;
+  size_t sqes_size;
+
+  unsigned queued;  /// Entries queued but not yet submitted.
+};
+
+/// Sets up a ring.
+/// @param ring Ring to set up.
+/// @param entries Number of submission entries.
+/// @return 0 if the ring was set up, 1 if io_uring is unavailable.
+int ring_init(struct Ring* ring, unsigned entries);
+
+/// Tears down a ring, if it was set up.
+void ring_destroy(struct Ring* ring);
+
+/// Registers fixed buffers, referenced by index from ring_queue_read_fixed/ring_queue_write_fixed.
+/// @return 0 if the buffers were registered, 1 otherwise.
+int ring_register_buffers(struct Ring* ring, const struct iovec* buffers, unsigned count);
+
+/// Queues a read into a registered buffer.
+/// @return 0 if queued, 1 if the submission queue is full.
+int ring_queue_read_fixed(struct Ring* ring, int fd, void* buf, size_t len, int buf_index, uint64_t user_data);
+
+/// Queues a write from a registered buffer.
+/// @return 0 if queued, 1 if the submission queue is full.
+int ring_queue_write_fixed(struct Ring* ring, int fd, const void* buf, size_t len, int buf_index, uint64_t user_data);
+
+/// Queues a write from any memory, which must stay valid until its completion is reaped.
+/// @return 0 if queued, 1 if the submission queue is full.
+int ring_queue_write(struct Ring* ring, int fd, const void* buf, size_t len, uint64_t user_data);
+
+/// Submits every queued entry and waits for at least wait_nr completions, in a single system call.
+/// @return 0 on success, 1 otherwise.
+int ring_submit_and_wait(struct Ring* ring, unsigned wait_nr);
+
+/// Takes the next completion, if any.
+/// @return 1 if a completion was taken, 0 if the completion queue is empty.
+int ring_next_completion(struct Ring* ring, struct RingCompletion* completion);
+
+#endif  // SERVER_URING_H